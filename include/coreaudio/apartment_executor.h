@@ -0,0 +1,196 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_APARTMENT_EXECUTOR_H_
+#define WINDOWS_COREAUDIO_WRAPPER_APARTMENT_EXECUTOR_H_
+
+#include "windows.h"
+#include "combaseapi.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "coreaudio/com_context.h"
+#include "coreaudio/util/agile_reference.h"
+#include "coreaudio/util/h_optional.h"
+
+
+namespace coreaudio {
+
+namespace detail {
+
+// How a task reports that it couldn't run (e.g. a handle couldn't be unmarshaled): `HRESULT` or `h_optional<T>`
+template<typename R>
+struct failed_result {
+    static_assert(sizeof(R) == 0, "apartment_executor::submit: a task taking handles must return HRESULT or h_optional<T>");
+};
+template<>
+struct failed_result<HRESULT> {
+    static HRESULT make(HRESULT status) noexcept { return status; }
+};
+template<typename T>
+struct failed_result<h_optional<T>> {
+    static h_optional<T> make(HRESULT status) { return { status, T() }; }
+};
+
+}
+
+/**
+ * A pool of MTA threads, each with its own `com_context`, for running Core Audio calls on many cores instead of
+ * funneling them through one STA thread.
+ *
+ * `submit(f, handles...)` takes wrappers (`device`, `endpoint_volume`, ...) from the calling thread, marshals them
+ * unless they are agile (see `agile_reference`), and calls `f` on a worker with wrappers valid there. `f` returns an
+ * `HRESULT` or an `h_optional<T>`; if a handle can't be unmarshaled, the future holds that failure instead.
+ * Exceptions thrown by `f` are stored in the future.
+ *
+ * Tasks run in the order they were submitted, on whichever worker is free. `submit` is thread-safe.
+ */
+struct apartment_executor {
+    apartment_executor(const apartment_executor&) = delete;
+    apartment_executor& operator=(const apartment_executor&) = delete;
+
+    /**
+     * Starts `threads` workers (the number of hardware threads if 0). Fails with the first worker's failure to
+     * initialize COM. Throws whatever `std::thread` throws.
+     */
+    static h_optional<std::unique_ptr<apartment_executor>> make(std::size_t threads = 0) {
+        if (threads == 0) threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 1;
+        std::unique_ptr<apartment_executor> result(new apartment_executor());
+        std::vector<std::future<HRESULT>> started;
+        started.reserve(threads);
+        result->workers.reserve(threads);
+        for (std::size_t i = 0; i < threads; ++i) {
+            std::promise<HRESULT> p;
+            started.push_back(p.get_future());
+            apartment_executor* raw = result.get();
+            result->workers.emplace_back([raw](std::promise<HRESULT>&& p) {
+                raw->run(p);
+            }, static_cast<std::promise<HRESULT>&&>(p));
+        }
+        HRESULT status = S_OK;
+        for (std::future<HRESULT>& s : started) {
+            HRESULT worker_status = s.get();
+            if (SUCCEEDED(status) && FAILED(worker_status)) status = worker_status;
+        }
+        if (FAILED(status)) return { status, nullptr };
+        return { S_OK, static_cast<std::unique_ptr<apartment_executor>&&>(result) };
+    }
+
+    // Runs every task already submitted, then stops the workers
+    ~apartment_executor() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& t : workers) {
+            if (t.joinable()) t.join();
+        }
+    }
+
+    /**
+     * Calls `f(handles...)` on a worker. The handles are marshaled on the calling thread (which must have COM
+     * initialized), so they can be released or moved away as soon as this returns.
+     * Throws whatever `std::make_shared` and `std::deque` throw.
+     */
+    template<typename F, typename... Wrappers>
+    auto submit(F&& f, const Wrappers&... handles) -> std::future<decltype(f(std::declval<const Wrappers&>()...))> {
+        using result_type = decltype(f(std::declval<const Wrappers&>()...));
+        using references = std::tuple<agile_reference<Wrappers>...>;
+
+        HRESULT status = S_OK;
+        references refs(make_reference(status, handles)...);
+        if (FAILED(status)) {
+            std::promise<result_type> failed;
+            failed.set_value(detail::failed_result<result_type>::make(status));
+            return failed.get_future();
+        }
+
+        auto task = std::make_shared<std::packaged_task<result_type()>>(
+            [f = std::forward<F>(f), refs = static_cast<references&&>(refs)]() mutable -> result_type {
+                return call_resolved<result_type>(f, refs, std::index_sequence_for<Wrappers...>());
+            });
+        std::future<result_type> result = task->get_future();
+        enqueue([task] { (*task)(); });
+        return result;
+    }
+
+    std::size_t thread_count() const noexcept {
+        return workers.size();
+    }
+    // Tasks submitted but not yet started
+    std::size_t queued() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return tasks.size();
+    }
+private:
+    apartment_executor() = default;
+
+    template<typename Wrapper>
+    static agile_reference<Wrapper> make_reference(HRESULT& status, const Wrapper& handle) noexcept {
+        h_optional<agile_reference<Wrapper>> r = agile_reference<Wrapper>::make(handle);
+        if (SUCCEEDED(status) && !r) status = r.get_status();
+        return static_cast<agile_reference<Wrapper>&&>(r.get_unchecked());
+    }
+
+    template<typename R, typename F, typename... Wrappers, std::size_t... I>
+    static R call_resolved(F& f, const std::tuple<agile_reference<Wrappers>...>& refs, std::index_sequence<I...>) {
+        std::tuple<h_optional<Wrappers>...> resolved(std::get<I>(refs).resolve(std::nothrow)...);
+        HRESULT status = S_OK;
+        const HRESULT statuses[] = { S_OK, std::get<I>(resolved).get_status()... };
+        for (HRESULT s : statuses) {
+            if (FAILED(s)) {
+                status = s;
+                break;
+            }
+        }
+        if (FAILED(status)) return detail::failed_result<R>::make(status);
+        return f(static_cast<const Wrappers&>(std::get<I>(resolved).get_unchecked())...);
+    }
+
+    template<typename F>
+    void enqueue(F&& f) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace_back(std::forward<F>(f));
+        }
+        wake.notify_one();
+    }
+
+    void run(std::promise<HRESULT>& started) noexcept {
+        h_optional<com_context> com = com_context::make(COINIT_MULTITHREADED);
+        started.set_value(com.get_status());
+        if (!com) return;
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return;
+                task = static_cast<std::function<void()>&&>(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_APARTMENT_EXECUTOR_H_
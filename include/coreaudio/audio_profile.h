@@ -0,0 +1,412 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_AUDIO_PROFILE_H_
+#define WINDOWS_COREAUDIO_WRAPPER_AUDIO_PROFILE_H_
+
+#include "windows.h"
+#include "mmdeviceapi.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "coreaudio/apartment_executor.h"
+#include "coreaudio/device.h"
+#include "coreaudio/device_enumerator.h"
+#include "coreaudio/device_interfaces/endpoint_volume.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/smart_pointers.h"
+
+
+namespace coreaudio {
+
+// A setting that an `endpoint_profile` either leaves as it is or sets
+enum class profile_switch : signed char { keep = -1, off = 0, on = 1 };
+
+// The desired state of one endpoint. Anything left at its default is not touched.
+struct endpoint_profile {
+    std::wstring id;
+    float volume = -1;  // Master volume scalar, negative to keep
+    std::vector<float> channel_volumes;  // Channel volume scalars by channel, negative to keep
+    profile_switch muted = profile_switch::keep;
+    profile_switch enabled = profile_switch::keep;
+    bool default_for[ERole_enum_count] = {};  // Roles to make it the default endpoint of its data flow for
+};
+
+/**
+ * A desired-state description of the audio endpoints of a machine, applied through `profile_diff`.
+ *
+ * Usually parsed from text, one section per endpoint:
+ *
+ *     # Lines starting with '#' or ';' are comments
+ *     [{0.0.0.00000000}.{5f0e3cb0-...}]
+ *     volume = 0.5
+ *     channel_volumes = 1 0.8       # Only the channels listed; '-' keeps one
+ *     muted = false
+ *     enabled = true
+ *     default = console multimedia  # And/or communications
+ */
+struct audio_profile {
+    std::vector<endpoint_profile> endpoints;
+
+    /**
+     * Parses `text` as above. Fails with E_INVALIDARG on the first malformed line, whose (1-based) number is written
+     * to `error_line` if given. Throws whatever `std::wstring` and `std::vector` throw.
+     */
+    static h_optional<audio_profile> parse(const std::string& text, std::size_t* error_line = nullptr) {
+        audio_profile result;
+        std::size_t line_number = 0;
+        std::size_t at = 0;
+        while (at < text.size()) {
+            std::size_t end = text.find('\n', at);
+            if (end == std::string::npos) end = text.size();
+            ++line_number;
+            std::string line = trim(text.substr(at, end - at));
+            at = end + 1;
+            if (line.empty() || line[0] == '#' || line[0] == ';') continue;
+
+            bool ok = true;
+            if (line[0] == '[') {
+                ok = line.size() > 2 && line.back() == ']';
+                endpoint_profile e;
+                for (std::size_t i = 1; ok && i + 1 < line.size(); ++i) {
+                    // Endpoint IDs are ASCII
+                    unsigned char c = static_cast<unsigned char>(line[i]);
+                    ok = c < 0x80;
+                    e.id.push_back(static_cast<wchar_t>(c));
+                }
+                if (ok) result.endpoints.push_back(static_cast<endpoint_profile&&>(e));
+            } else {
+                std::size_t equals = line.find('=');
+                ok = equals != std::string::npos && !result.endpoints.empty();
+                if (ok) ok = parse_setting(result.endpoints.back(), trim(line.substr(0, equals)), strip_comment(line.substr(equals + 1)));
+            }
+            if (!ok) {
+                if (error_line) *error_line = line_number;
+                return { E_INVALIDARG, static_cast<audio_profile&&>(result) };
+            }
+        }
+        return { S_OK, static_cast<audio_profile&&>(result) };
+    }
+private:
+    static std::string trim(const std::string& s) {
+        std::size_t first = s.find_first_not_of(" \t\r");
+        if (first == std::string::npos) return std::string();
+        return s.substr(first, s.find_last_not_of(" \t\r") - first + 1);
+    }
+
+    static std::string strip_comment(const std::string& s) {
+        return trim(s.substr(0, s.find('#')));
+    }
+
+    static bool parse_scalar(const std::string& s, float& out) {
+        if (s.empty()) return false;
+        char* end = nullptr;
+        double v = std::strtod(s.c_str(), &end);
+        if (end != s.c_str() + s.size() || !(v >= 0 && v <= 1)) return false;
+        out = static_cast<float>(v);
+        return true;
+    }
+
+    static bool parse_switch(const std::string& s, profile_switch& out) {
+        if (s == "true" || s == "yes" || s == "on" || s == "1") out = profile_switch::on;
+        else if (s == "false" || s == "no" || s == "off" || s == "0") out = profile_switch::off;
+        else return false;
+        return true;
+    }
+
+    static bool parse_setting(endpoint_profile& e, const std::string& key, const std::string& value) {
+        if (key == "volume") return parse_scalar(value, e.volume);
+        if (key == "muted") return parse_switch(value, e.muted);
+        if (key == "enabled") return parse_switch(value, e.enabled);
+
+        // Space-separated lists
+        std::vector<std::string> words;
+        for (std::size_t at = 0; at < value.size();) {
+            std::size_t end = value.find_first_of(" \t,", at);
+            if (end == std::string::npos) end = value.size();
+            if (end > at) words.push_back(value.substr(at, end - at));
+            at = end + 1;
+        }
+        if (words.empty()) return false;
+        if (key == "channel_volumes") {
+            e.channel_volumes.assign(words.size(), -1);
+            for (std::size_t i = 0; i < words.size(); ++i) {
+                if (words[i] != "-" && !parse_scalar(words[i], e.channel_volumes[i])) return false;
+            }
+            return true;
+        }
+        if (key == "default") {
+            for (const std::string& w : words) {
+                if (w == "console") e.default_for[eConsole] = true;
+                else if (w == "multimedia") e.default_for[eMultimedia] = true;
+                else if (w == "communications") e.default_for[eCommunications] = true;
+                else return false;
+            }
+            return true;
+        }
+        return false;
+    }
+};
+
+/**
+ * Default endpoints and enabling/disabling endpoints have no public Windows API. Implement this (e.g. over the
+ * undocumented `IPolicyConfig`) to let `profile_diff::apply` make those changes; without one they fail with E_NOTIMPL.
+ *
+ * Called from the executor's workers (MTA), possibly for several endpoints at the same time.
+ */
+struct endpoint_policy {
+    virtual ~endpoint_policy() = default;
+
+    virtual HRESULT set_default_endpoint(LPCWSTR id, ERole role) = 0;
+    virtual HRESULT set_endpoint_enabled(LPCWSTR id, bool enabled) = 0;
+};
+
+enum class profile_setting { enable, volume, channel_volume, mute, default_endpoint, disable };
+
+// One setting that differs from the profile
+struct profile_change {
+    std::size_t endpoint;  // In `profile_diff::ids`
+    profile_setting setting;
+    UINT index;  // The channel of a `channel_volume`, the `ERole` of a `default_endpoint`
+    float from;  // Current volume scalar or mute (0/1); negative if unknown (e.g. the endpoint is still disabled)
+    float to;
+};
+
+/**
+ * The settings of an `audio_profile` that differ from the current state, so that applying it only touches (and
+ * only notifies about) what actually changes.
+ *
+ * `compute` reads the current state of the profile's endpoints; `apply` makes the changes in parallel, one task per
+ * endpoint on an `apartment_executor`, each in the order enable, volumes, mute, default, disable. Volume and mute
+ * changes carry `event_context`, which listeners find in `AUDIO_VOLUME_NOTIFICATION_DATA::guidEventContext`, so they
+ * can ignore their own echo (default device and state notifications have no such context).
+ */
+struct profile_diff {
+    std::vector<std::wstring> ids;  // The profile's endpoints
+    std::vector<HRESULT> read_statuses;  // Of each endpoint: why (some of) its state couldn't be read
+    std::vector<profile_change> changes;  // Grouped by endpoint, in the order they are applied
+
+    bool empty() const noexcept {
+        return changes.empty();
+    }
+
+    /**
+     * Compares `profile` with the current state of its endpoints. Volumes within `tolerance` count as equal.
+     * Settings of an endpoint that can't be read are left out (see `read_statuses`), except those of an endpoint the
+     * profile enables, which are applied unconditionally. Fails with E_INVALIDARG if the profile makes two endpoints
+     * the default for the same data flow and role. Throws whatever the standard containers throw.
+     */
+    static h_optional<profile_diff> compute(const device_enumerator& e, const audio_profile& profile, float tolerance = 0.001f) {
+        profile_diff result;
+        result.ids.reserve(profile.endpoints.size());
+        result.read_statuses.assign(profile.endpoints.size(), S_OK);
+
+        // Current defaults, read once per data flow and role
+        std::wstring defaults[2][ERole_enum_count];
+        bool defaults_read[2] = {};
+        bool claimed[2][ERole_enum_count] = {};
+
+        for (std::size_t n = 0; n < profile.endpoints.size(); ++n) {
+            const endpoint_profile& p = profile.endpoints[n];
+            result.ids.push_back(p.id);
+            HRESULT& read_status = result.read_statuses[n];
+
+            h_optional<device> d = e.get_device(std::nothrow, p.id.c_str());
+            if (!d) {
+                read_status = d.get_status();
+                continue;
+            }
+            const device& endpoint = d.get_unchecked();
+            h_optional<DWORD> state = endpoint.state(std::nothrow);
+            if (!state) {
+                read_status = state.get_status();
+                continue;
+            }
+            bool disabled = state.get_unchecked() == DEVICE_STATE_DISABLED;
+            bool enabling = disabled && p.enabled == profile_switch::on;
+            if (enabling) result.changes.push_back({ n, profile_setting::enable, 0, 0, 1 });
+
+            bool wants_volume = p.volume >= 0 || p.muted != profile_switch::keep;
+            for (float v : p.channel_volumes) wants_volume = wants_volume || v >= 0;
+            if (wants_volume) {
+                h_optional<endpoint_volume> volume = endpoint.activate_endpoint_volume(std::nothrow);
+                if (!volume && !enabling) read_status = volume.get_status();
+                if (volume || enabling) add_volume_changes(result.changes, n, p, volume ? &volume.get_unchecked() : nullptr, tolerance);
+            }
+
+            bool wants_default = false;
+            for (bool b : p.default_for) wants_default = wants_default || b;
+            if (wants_default) {
+                h_optional<EDataFlow> data_flow = endpoint.data_flow(std::nothrow);
+                HRESULT status = data_flow.get_status();
+                EDataFlow flow = data_flow.get_unchecked();
+                if (FAILED(status) || (flow != eRender && flow != eCapture)) {
+                    read_status = FAILED(status) ? status : E_UNEXPECTED;
+                } else {
+                    if (!defaults_read[flow]) {
+                        read_defaults(e, flow, defaults[flow]);
+                        defaults_read[flow] = true;
+                    }
+                    for (UINT role = 0; role < ERole_enum_count; ++role) {
+                        if (!p.default_for[role]) continue;
+                        if (claimed[flow][role]) return { E_INVALIDARG, static_cast<profile_diff&&>(result) };
+                        claimed[flow][role] = true;
+                        if (defaults[flow][role] != p.id) result.changes.push_back({ n, profile_setting::default_endpoint, role, 0, 1 });
+                    }
+                }
+            }
+
+            if (!disabled && p.enabled == profile_switch::off) result.changes.push_back({ n, profile_setting::disable, 0, 1, 0 });
+        }
+        return { S_OK, static_cast<profile_diff&&>(result) };
+    }
+
+    /**
+     * Makes the changes on `executor`'s workers and waits for them. Returns the status of each change (indexed like
+     * `changes`). Volume settings fail with the endpoint's activation failure if it can't be activated, and the
+     * policy settings with E_NOTIMPL if there is no `policy`. Must be called on a thread with COM initialized.
+     * Throws whatever the standard containers and `apartment_executor::submit` throw.
+     */
+    std::vector<HRESULT> apply(apartment_executor& executor, const device_enumerator& e, const GUID& event_context,
+                               endpoint_policy* policy = nullptr) const {
+        std::vector<HRESULT> statuses(changes.size(), S_OK);
+        std::vector<std::pair<std::size_t, std::size_t>> ranges;
+        std::vector<std::future<HRESULT>> pending;
+
+        pending.reserve(changes.size());
+        ranges.reserve(changes.size());
+        try {
+            for (std::size_t first = 0; first < changes.size();) {
+                std::size_t last = first + 1;
+                while (last < changes.size() && changes[last].endpoint == changes[first].endpoint) ++last;
+                h_optional<device> d = e.get_device(std::nothrow, ids[changes[first].endpoint].c_str());
+                if (!d) {
+                    for (std::size_t k = first; k < last; ++k) statuses[k] = d.get_status();
+                } else {
+                    // Each task writes its own range of `statuses`; `get` below orders that before the reads
+                    HRESULT* out = statuses.data();
+                    const profile_diff* self = this;
+                    GUID context = event_context;
+                    pending.push_back(executor.submit([self, out, first, last, context, policy](const device& endpoint) -> HRESULT {
+                        self->apply_endpoint(endpoint, first, last, context, policy, out);
+                        return S_OK;
+                    }, d.get_unchecked()));
+                    ranges.emplace_back(first, last);
+                }
+                first = last;
+            }
+        } catch (...) {
+            // The tasks already submitted write into `statuses` (and read this diff), so they must finish first
+            for (std::future<HRESULT>& f : pending) f.wait();
+            throw;
+        }
+
+        for (std::size_t i = 0; i < pending.size(); ++i) {
+            HRESULT status = pending[i].get();
+            // The device couldn't be passed to the worker
+            if (FAILED(status)) {
+                for (std::size_t k = ranges[i].first; k < ranges[i].second; ++k) statuses[k] = status;
+            }
+        }
+        return statuses;
+    }
+private:
+    static bool differs(float current, float wanted, float tolerance) noexcept {
+        return current < 0 || std::fabs(current - wanted) > tolerance;
+    }
+
+    // `volume` is null if the endpoint can't be read yet
+    static void add_volume_changes(std::vector<profile_change>& out, std::size_t n, const endpoint_profile& p, const endpoint_volume* volume,
+                                   float tolerance) {
+        if (p.volume >= 0) {
+            float current = -1;
+            if (volume) {
+                h_optional<float> v = volume->get_master_volume_level_scalar(std::nothrow);
+                if (v) current = v.get_unchecked();
+            }
+            if (differs(current, p.volume, tolerance)) out.push_back({ n, profile_setting::volume, 0, current, p.volume });
+        }
+        for (std::size_t c = 0; c < p.channel_volumes.size(); ++c) {
+            float wanted = p.channel_volumes[c];
+            if (wanted < 0) continue;
+            float current = -1;
+            if (volume) {
+                // A channel the endpoint doesn't have is left to fail when applied
+                h_optional<float> v = volume->get_channel_volume_level_scalar(std::nothrow, static_cast<UINT>(c));
+                if (v) current = v.get_unchecked();
+            }
+            if (differs(current, wanted, tolerance)) out.push_back({ n, profile_setting::channel_volume, static_cast<UINT>(c), current, wanted });
+        }
+        if (p.muted != profile_switch::keep) {
+            float wanted = p.muted == profile_switch::on ? 1.0f : 0.0f;
+            float current = -1;
+            if (volume) {
+                h_optional<bool> m = volume->is_muted(std::nothrow);
+                if (m) current = m.get_unchecked() ? 1.0f : 0.0f;
+            }
+            if (current != wanted) out.push_back({ n, profile_setting::mute, 0, current, wanted });
+        }
+    }
+
+    static void read_defaults(const device_enumerator& e, EDataFlow flow, std::wstring (&out)[ERole_enum_count]) {
+        for (UINT role = 0; role < ERole_enum_count; ++role) {
+            h_optional<device> d = e.get_default_endpoint(std::nothrow, flow, static_cast<ERole>(role));
+            // No default (or none readable) differs from any endpoint
+            if (!d || !d.get_unchecked()) continue;
+            h_optional<task_memory_pointer<WCHAR>> id = d.get_unchecked().id(std::nothrow);
+            if (id) out[role] = id.get_unchecked().get();
+        }
+    }
+
+    void apply_endpoint(const device& endpoint, std::size_t first, std::size_t last, const GUID& event_context, endpoint_policy* policy,
+                        HRESULT* out) const {
+        LPCWSTR id = ids[changes[first].endpoint].c_str();
+        // Activated on first use, after any `enable`
+        endpoint_volume volume;
+        HRESULT volume_status = S_OK;
+        bool activated = false;
+        for (std::size_t k = first; k < last; ++k) {
+            const profile_change& c = changes[k];
+            bool uses_volume = c.setting == profile_setting::volume || c.setting == profile_setting::channel_volume || c.setting == profile_setting::mute;
+            if (uses_volume && !activated) {
+                h_optional<endpoint_volume> v = endpoint.activate_endpoint_volume(std::nothrow);
+                volume_status = v.get_status();
+                volume = static_cast<endpoint_volume&&>(v.get_unchecked());
+                activated = true;
+            }
+            if (uses_volume && FAILED(volume_status)) {
+                out[k] = volume_status;
+                continue;
+            }
+            switch (c.setting) {
+            case profile_setting::enable:
+                out[k] = policy ? policy->set_endpoint_enabled(id, true) : E_NOTIMPL;
+                break;
+            case profile_setting::volume:
+                out[k] = volume.set_master_volume_level_scalar(std::nothrow, c.to, event_context);
+                break;
+            case profile_setting::channel_volume:
+                out[k] = volume.set_channel_volume_level_scalar(std::nothrow, c.index, c.to, event_context);
+                break;
+            case profile_setting::mute:
+                out[k] = volume.set_mute(std::nothrow, c.to != 0, event_context);
+                break;
+            case profile_setting::default_endpoint:
+                out[k] = policy ? policy->set_default_endpoint(id, static_cast<ERole>(c.index)) : E_NOTIMPL;
+                break;
+            case profile_setting::disable:
+                out[k] = policy ? policy->set_endpoint_enabled(id, false) : E_NOTIMPL;
+                break;
+            }
+        }
+    }
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_AUDIO_PROFILE_H_
@@ -0,0 +1,313 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_CAPTURE_FILE_WRITER_H_
+#define WINDOWS_COREAUDIO_WRAPPER_CAPTURE_FILE_WRITER_H_
+
+#include "windows.h"
+#include "mmreg.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+
+#include "coreaudio/util/call_observer.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/wave_format.h"
+
+
+namespace coreaudio {
+
+enum class capture_container {
+    wav,  // RIFF/WAVE, promoted to RF64 by `finalize` if it grows past 4 GiB
+    rf64,  // Always RF64 (EBU Tech 3306)
+    raw,  // Just the samples
+};
+
+struct capture_writer_options {
+    capture_container container = capture_container::wav;
+    // Size of each write. Rounded up to a multiple of 4096 (the largest common sector size).
+    std::size_t block_bytes = 256 * 1024;
+    // Blocks that can be waiting for the disk before `write` starts dropping packets
+    std::size_t block_count = 16;
+};
+
+struct capture_writer_stats {
+    std::uint64_t bytes_written;  // Bytes of audio handed to the writer thread
+    std::uint64_t bytes_dropped;  // Bytes of audio dropped because every block was waiting for the disk
+    std::uint64_t writes_dropped;  // `write` calls dropped because every block was waiting for the disk
+    std::uint64_t backpressure_events;  // `write` calls made while at least half the blocks were waiting for the disk
+    std::uint64_t max_blocks_queued;  // Most blocks waiting for the disk at once
+    HRESULT write_status;  // First error from the writer thread, if any
+};
+
+/**
+ * Writes captured audio to a file without ever blocking the thread that calls `write` on I/O.
+ *
+ * `write` copies into one of `block_count` preallocated, page-aligned blocks; a full block is handed to a writer
+ * thread, which writes it with `FILE_FLAG_NO_BUFFERING` (one large aligned write per block). The WAV header is padded
+ * to 4096 bytes so the audio starts sector-aligned, and is patched by `finalize`. If the disk falls so far behind that
+ * every block is waiting, whole `write` calls are dropped and counted (see `stats`).
+ *
+ * `write` must only be called from one thread at a time, and not concurrently with `finalize`. `stats` is thread-safe.
+ */
+struct capture_file_writer {
+    capture_file_writer(const capture_file_writer&) = delete;
+    capture_file_writer& operator=(const capture_file_writer&) = delete;
+
+    ~capture_file_writer() {
+        finalize();
+        if (blocks) VirtualFree(blocks, 0, MEM_RELEASE);
+        if (block_ready) CloseHandle(block_ready);
+    }
+
+    /**
+     * Creates (or truncates) `path` and starts the writer thread. `format` is what `write` is given, e.g. the mix
+     * format of the stream. Throws whatever `std::wstring` and `std::thread` throw.
+     */
+    static h_optional<std::unique_ptr<capture_file_writer>> open(
+        LPCWSTR path, const WAVEFORMATEX* format, const capture_writer_options& options = {}
+    ) {
+        if (!path || !format || format->nBlockAlign == 0 || options.block_count < 2) return { E_INVALIDARG, nullptr };
+        std::unique_ptr<capture_file_writer> w(new capture_file_writer());
+        w->path = path;
+        w->container = options.container;
+        w->block_bytes = (options.block_bytes + sector_bytes - 1) / sector_bytes * sector_bytes;
+        w->block_count = options.block_count;
+        w->frame_bytes = format->nBlockAlign;
+        w->blocks = static_cast<unsigned char*>(VirtualAlloc(nullptr, w->block_bytes * w->block_count, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+        if (!w->blocks) return { E_OUTOFMEMORY, nullptr };
+        w->block_ready = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+        if (!w->block_ready) return { HRESULT_FROM_WIN32(GetLastError()), nullptr };
+
+        w->file = CreateFileW(path, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (w->file == INVALID_HANDLE_VALUE) return { HRESULT_FROM_WIN32(GetLastError()), nullptr };
+        if (w->container != capture_container::raw) {
+            HRESULT status = w->write_initial_header(format);
+            if (FAILED(status)) {
+                CloseHandle(w->file);
+                w->file = INVALID_HANDLE_VALUE;
+                return { status, nullptr };
+            }
+        }
+        capture_file_writer* raw = w.get();
+        w->thread = std::thread([raw] { raw->write_blocks(); });
+        return { S_OK, static_cast<std::unique_ptr<capture_file_writer>&&>(w) };
+    }
+
+    /**
+     * Appends `bytes` bytes (whole frames) of audio, or silence if `data` is nullptr. Never blocks and never
+     * allocates. Returns false if it was dropped (nothing of it is written) because the disk is too far behind.
+     */
+    bool write(const void* data, std::size_t bytes) noexcept {
+        if (finalized || bytes == 0) return bytes == 0;
+        std::uint64_t done = flushed.load(std::memory_order_acquire);
+        std::uint64_t queued = filled - done;
+        if (queued * 2 >= block_count) backpressure_events.fetch_add(1, std::memory_order_relaxed);
+        if (queued > max_blocks_queued.load(std::memory_order_relaxed)) max_blocks_queued.store(queued, std::memory_order_relaxed);
+        std::uint64_t available = (block_count - queued) * block_bytes - fill;
+        if (bytes > available) {
+            writes_dropped.fetch_add(1, std::memory_order_relaxed);
+            bytes_dropped.fetch_add(bytes, std::memory_order_relaxed);
+            detail::count_event("capture_writes_dropped");
+            return false;
+        }
+        const unsigned char* from = static_cast<const unsigned char*>(data);
+        while (bytes) {
+            unsigned char* block = blocks + (filled % block_count) * block_bytes;
+            std::size_t n = bytes < block_bytes - fill ? bytes : block_bytes - fill;
+            if (from) {
+                std::memcpy(block + fill, from, n);
+                from += n;
+            } else {
+                std::memset(block + fill, 0, n);
+            }
+            fill += n;
+            bytes -= n;
+            bytes_written.fetch_add(n, std::memory_order_relaxed);
+            if (fill == block_bytes) {
+                fill = 0;
+                ++filled;
+                filled_published.store(filled, std::memory_order_release);
+                SetEvent(block_ready);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Waits for the writer thread to write every full block, writes the partial last block and patches the header.
+     * Called by the destructor. Returns the first error of the writer thread or of finalizing.
+     */
+    HRESULT finalize() noexcept {
+        if (finalized) return write_status.load(std::memory_order_acquire);
+        finalized = true;
+        if (thread.joinable()) {
+            stop_requested.store(true, std::memory_order_release);
+            SetEvent(block_ready);
+            thread.join();
+        }
+        if (file == INVALID_HANDLE_VALUE) return write_status.load(std::memory_order_acquire);
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+
+        // The tail isn't a whole sector, so it's written without FILE_FLAG_NO_BUFFERING
+        HANDLE f = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (f == INVALID_HANDLE_VALUE) return fail(HRESULT_FROM_WIN32(GetLastError()));
+        std::uint64_t header_bytes = container == capture_container::raw ? 0 : sector_bytes;
+        std::uint64_t data_bytes = filled * block_bytes + fill;
+        unsigned char* tail = blocks + (filled % block_count) * block_bytes;
+        std::size_t tail_bytes = fill;
+        // RIFF chunks are padded to an even size
+        if (container != capture_container::raw && data_bytes % 2 != 0) tail[tail_bytes++] = 0;
+        HRESULT status = write_at(f, header_bytes + filled * block_bytes, tail, tail_bytes);
+        if (SUCCEEDED(status) && container != capture_container::raw) status = patch_header(f, data_bytes);
+        if (SUCCEEDED(status) && !FlushFileBuffers(f)) status = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(f);
+        if (FAILED(status)) return fail(status);
+        return write_status.load(std::memory_order_acquire);
+    }
+
+    capture_writer_stats stats() const noexcept {
+        return {
+            bytes_written.load(std::memory_order_relaxed), bytes_dropped.load(std::memory_order_relaxed),
+            writes_dropped.load(std::memory_order_relaxed), backpressure_events.load(std::memory_order_relaxed),
+            max_blocks_queued.load(std::memory_order_relaxed), write_status.load(std::memory_order_acquire)
+        };
+    }
+private:
+    static constexpr std::size_t sector_bytes = 4096;
+
+    capture_file_writer() noexcept = default;
+
+    HRESULT fail(HRESULT status) noexcept {
+        HRESULT expected = S_OK;
+        write_status.compare_exchange_strong(expected, status, std::memory_order_acq_rel);
+        return write_status.load(std::memory_order_acquire);
+    }
+
+    static HRESULT write_at(HANDLE f, std::uint64_t offset, const void* data, std::size_t bytes) noexcept {
+        LARGE_INTEGER position;
+        position.QuadPart = static_cast<LONGLONG>(offset);
+        if (!SetFilePointerEx(f, position, nullptr, FILE_BEGIN)) return HRESULT_FROM_WIN32(GetLastError());
+        DWORD n = 0;
+        if (bytes && (!WriteFile(f, data, static_cast<DWORD>(bytes), &n, nullptr) || n != bytes)) return HRESULT_FROM_WIN32(GetLastError());
+        return S_OK;
+    }
+
+    static void put32(unsigned char* p, std::uint32_t v) noexcept {
+        for (int i = 0; i < 4; ++i) p[i] = static_cast<unsigned char>(v >> (8 * i));
+    }
+    static void put64(unsigned char* p, std::uint64_t v) noexcept {
+        for (int i = 0; i < 8; ++i) p[i] = static_cast<unsigned char>(v >> (8 * i));
+    }
+
+    /**
+     * RIFF/WAVE header padded to `sector_bytes`:
+     *   "RIFF" size "WAVE"
+     *   "JUNK" 28 bytes (becomes "ds64" for RF64)
+     *   "fmt " the format
+     *   "JUNK" padding
+     *   "data" size (ending at `sector_bytes`)
+     * The sizes are filled in by `patch_header`.
+     */
+    HRESULT write_initial_header(const WAVEFORMATEX* format) noexcept {
+        unsigned char* h = blocks;  // The first block isn't in use yet
+        std::memset(h, 0, sector_bytes);
+        std::memcpy(h, "RIFF", 4);
+        std::memcpy(h + 8, "WAVE", 4);
+        std::memcpy(h + 12, "JUNK", 4);
+        put32(h + 16, 28);
+        std::size_t fmt_bytes = wave_format_size(format);
+        std::size_t at = 48;
+        if (at + 8 + fmt_bytes + 1 + 16 > sector_bytes) return E_INVALIDARG;
+        std::memcpy(h + at, "fmt ", 4);
+        put32(h + at + 4, static_cast<std::uint32_t>(fmt_bytes));
+        std::memcpy(h + at + 8, format, fmt_bytes);
+        at += 8 + fmt_bytes + fmt_bytes % 2;
+        std::memcpy(h + at, "JUNK", 4);
+        put32(h + at + 4, static_cast<std::uint32_t>(sector_bytes - 8 - (at + 8)));
+        std::memcpy(h + sector_bytes - 8, "data", 4);
+        DWORD n = 0;
+        if (!WriteFile(file, h, static_cast<DWORD>(sector_bytes), &n, nullptr) || n != sector_bytes) return HRESULT_FROM_WIN32(GetLastError());
+        return S_OK;
+    }
+
+    HRESULT patch_header(HANDLE f, std::uint64_t data_bytes) noexcept {
+        unsigned char riff[8];
+        unsigned char ds64[36];
+        unsigned char data_size[4];
+        std::uint64_t riff_bytes = sector_bytes - 8 + data_bytes + data_bytes % 2;
+        bool rf64 = container == capture_container::rf64 || riff_bytes > 0xFFFFFFFFu;
+        std::memcpy(riff, rf64 ? "RF64" : "RIFF", 4);
+        put32(riff + 4, rf64 ? 0xFFFFFFFFu : static_cast<std::uint32_t>(riff_bytes));
+        put32(data_size, rf64 ? 0xFFFFFFFFu : static_cast<std::uint32_t>(data_bytes));
+        HRESULT status = write_at(f, 0, riff, sizeof(riff));
+        if (SUCCEEDED(status) && rf64) {
+            std::memset(ds64, 0, sizeof(ds64));
+            std::memcpy(ds64, "ds64", 4);
+            put32(ds64 + 4, 28);
+            put64(ds64 + 8, riff_bytes);
+            put64(ds64 + 16, data_bytes);
+            put64(ds64 + 24, data_bytes / frame_bytes);
+            // Table length (ds64 + 32) stays 0
+            status = write_at(f, 12, ds64, sizeof(ds64));
+        }
+        if (SUCCEEDED(status)) status = write_at(f, sector_bytes - 4, data_size, sizeof(data_size));
+        return status;
+    }
+
+    // Runs on the writer thread
+    void write_blocks() noexcept {
+        for (;;) {
+            bool stopping = stop_requested.load(std::memory_order_acquire);
+            std::uint64_t ready = filled_published.load(std::memory_order_acquire);
+            std::uint64_t done = flushed.load(std::memory_order_relaxed);
+            for (; done < ready; ++done) {
+                if (write_status.load(std::memory_order_relaxed) == S_OK) {
+                    const unsigned char* block = blocks + (done % block_count) * block_bytes;
+                    DWORD n = 0;
+                    if (!WriteFile(file, block, static_cast<DWORD>(block_bytes), &n, nullptr) || n != block_bytes) {
+                        fail(HRESULT_FROM_WIN32(GetLastError()));
+                    }
+                }
+                // After an error, blocks are still recycled so `write` doesn't start dropping
+                flushed.store(done + 1, std::memory_order_release);
+            }
+            if (stopping) return;
+            WaitForSingleObject(block_ready, INFINITE);
+        }
+    }
+
+    std::wstring path;
+    capture_container container = capture_container::wav;
+    std::size_t block_bytes = 0;
+    std::size_t block_count = 0;
+    std::size_t frame_bytes = 1;
+    unsigned char* blocks = nullptr;
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE block_ready = nullptr;
+    std::thread thread;
+    bool finalized = false;
+
+    // Audio thread only
+    std::uint64_t filled = 0;  // Blocks handed to the writer thread
+    std::size_t fill = 0;  // Bytes in the current block
+
+    std::atomic<std::uint64_t> filled_published{0};
+    std::atomic<std::uint64_t> flushed{0};  // Blocks written (or discarded after an error) by the writer thread
+    std::atomic<bool> stop_requested{false};
+    std::atomic<HRESULT> write_status{S_OK};
+    std::atomic<std::uint64_t> bytes_written{0};
+    std::atomic<std::uint64_t> bytes_dropped{0};
+    std::atomic<std::uint64_t> writes_dropped{0};
+    std::atomic<std::uint64_t> backpressure_events{0};
+    std::atomic<std::uint64_t> max_blocks_queued{0};
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_CAPTURE_FILE_WRITER_H_
@@ -0,0 +1,437 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_CAPTURE_GROUP_H_
+#define WINDOWS_COREAUDIO_WRAPPER_CAPTURE_GROUP_H_
+
+#include "windows.h"
+#include "audioclient.h"
+#include "ksmedia.h"
+#include "mmreg.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "coreaudio/device.h"
+#include "coreaudio/device_interfaces/audio_capture_client.h"
+#include "coreaudio/device_interfaces/audio_client.h"
+#include "coreaudio/device_interfaces/audio_clock.h"
+#include "coreaudio/dsp/clock_regression.h"
+#include "coreaudio/dsp/resampler.h"
+#include "coreaudio/util/call_observer.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/throw_com_error.h"
+
+
+namespace coreaudio {
+
+struct capture_group_options {
+    // Every member is captured as float at this rate (the audio engine converts from the device rate)
+    DWORD sample_rate = 48000;
+    // Passed to `IAudioClient::Initialize`
+    REFERENCE_TIME buffer_duration = 200000;
+    // Aligned output kept for each member until `read`; the oldest is dropped beyond this
+    double buffer_seconds = 1.0;
+    // Alignment errors are corrected over about this long
+    double correction_seconds = 2.0;
+    // `poll`s remembered by each member's clock fit (see `dsp::clock_regression`)
+    double clock_memory = 256;
+};
+
+struct capture_member_stats {
+    double drift_ppm;  // Device clock rate relative to the performance counter
+    double correction_ppm;  // Current resampling ratio relative to the nominal one (drift plus alignment correction)
+    double min_correction_ppm;
+    double max_correction_ppm;
+    double alignment_error_frames;  // Latest; positive if the member is behind (outputting older input than the others)
+    double max_alignment_error_frames;  // Largest absolute error since aligning
+    double rms_alignment_error_frames;  // Exponentially weighted over about 100 polls
+    double clock_jitter_frames;  // RMS distance of position readings from the fitted clock
+    std::uint64_t frames_captured;
+    std::uint64_t frames_dropped;  // Aligned output dropped because it wasn't read in time
+    std::uint64_t gaps;  // Packets that didn't start where the last one ended (silence is inserted)
+};
+
+/**
+ * Captures from several devices at once (e.g. a set of USB microphones, each with its own clock) and outputs
+ * time-aligned blocks: frame k of every member was captured at the same time, to within a fraction of a frame.
+ *
+ * Each member's stream position is read with `IAudioClock::GetPosition` on every `poll` and fitted against the
+ * performance counter to estimate its rate. The member is resampled with a `dsp::polyphase_resampler` whose ratio is
+ * the estimated rate plus a correction proportional to the measured alignment error, so every member's output
+ * advances at exactly `sample_rate` frames per second of performance counter time.
+ *
+ * Call `poll` regularly (every 10 ms or so), then `read` up to `available` frames. Not thread-safe. Every member is
+ * output as interleaved float with the channel count of its mix format.
+ */
+struct capture_group {
+    explicit capture_group(const capture_group_options& options = {}) noexcept : options(options) {}
+    capture_group(capture_group&&) noexcept = default;
+    // Stops the streams of this group before taking over `other`'s
+    capture_group& operator=(capture_group&& other) noexcept {
+        if (this == &other) return *this;
+        stop(std::nothrow);
+        options = other.options;
+        members = static_cast<std::vector<member>&&>(other.members);
+        running = other.running;
+        aligned = other.aligned;
+        origin_seconds = other.origin_seconds;
+        other.members.clear();
+        other.running = false;
+        return *this;
+    }
+
+    ~capture_group() {
+        stop(std::nothrow);
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void add(const device& d) {
+        throw_com_error(add(std::nothrow, d));
+    }
+#endif
+    /**
+     * Activates and initializes a capture stream on `d` (a capture endpoint, or a render endpoint for loopback).
+     * Only before `start`. Returns E_OUTOFMEMORY if allocating the buffers fails.
+     */
+    HRESULT add(std::nothrow_t, const device& d) noexcept {
+        if (running) return E_ILLEGAL_METHOD_CALL;
+        h_optional<audio_client> c = d.activate_audio_client(std::nothrow);
+        if (!c) return c.get_status();
+        member m;
+        m.client = static_cast<audio_client&&>(c.get_unchecked());
+        h_optional<task_memory_pointer<WAVEFORMATEX>> mix = m.client.get_mix_format(std::nothrow);
+        if (!mix) return mix.get_status();
+        m.channels = mix.get_unchecked().get()->nChannels;
+
+        WAVEFORMATEXTENSIBLE f;
+        std::memset(&f, 0, sizeof(f));
+        f.Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+        f.Format.nChannels = static_cast<WORD>(m.channels);
+        f.Format.nSamplesPerSec = options.sample_rate;
+        f.Format.wBitsPerSample = 32;
+        f.Format.nBlockAlign = static_cast<WORD>(m.channels * sizeof(float));
+        f.Format.nAvgBytesPerSec = f.Format.nBlockAlign * options.sample_rate;
+        f.Format.cbSize = sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX);
+        f.Samples.wValidBitsPerSample = 32;
+        f.dwChannelMask = mix.get_unchecked().get()->wFormatTag == WAVE_FORMAT_EXTENSIBLE ?
+            reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(mix.get_unchecked().get())->dwChannelMask : 0;
+        f.SubFormat = KSDATAFORMAT_SUBTYPE_IEEE_FLOAT;
+
+        h_optional<com_pointer<IMMEndpoint>> endpoint = d.as_endpoint(std::nothrow);
+        EDataFlow flow = eCapture;
+        if (endpoint) endpoint.get_unchecked().get()->GetDataFlow(&flow);
+        DWORD flags = AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM | AUDCLNT_STREAMFLAGS_SRC_DEFAULT_QUALITY |
+            (flow == eRender ? AUDCLNT_STREAMFLAGS_LOOPBACK : 0);
+        HRESULT status = m.client.initialize(std::nothrow, AUDCLNT_SHAREMODE_SHARED, flags, options.buffer_duration, 0, &f.Format);
+        if (FAILED(status)) return status;
+
+        h_optional<com_pointer<IAudioCaptureClient>> capture = m.client.get_service<IAudioCaptureClient>(std::nothrow);
+        if (!capture) return capture.get_status();
+        m.capture = audio_capture_client(capture.get_unchecked().release());
+        h_optional<com_pointer<IAudioClock>> clock = m.client.get_service<IAudioClock>(std::nothrow);
+        if (!clock) return clock.get_status();
+        m.clock = audio_clock(clock.get_unchecked().release());
+        h_optional<UINT64> frequency = m.clock.get_frequency(std::nothrow);
+        if (!frequency) return frequency.get_status();
+        m.clock_frequency = frequency.get_unchecked();
+        m.fit.set_memory(options.clock_memory);
+
+        try {
+            const std::size_t block = options.sample_rate / 100;
+            if (!m.resampler.setup(m.channels, options.sample_rate, options.sample_rate, block, 32)) return E_INVALIDARG;
+            m.scratch.resize(m.resampler.max_output_frames(block) * 2 * m.channels);
+            m.silence.assign(static_cast<std::size_t>(block) * m.channels, 0.0f);
+            m.capacity = static_cast<std::size_t>(options.buffer_seconds * options.sample_rate);
+            m.fifo.resize(m.capacity * m.channels);
+            members.push_back(static_cast<member&&>(m));
+        } catch (const std::bad_alloc&) {
+            return E_OUTOFMEMORY;
+        }
+        return S_OK;
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void start() {
+        throw_com_error(start(std::nothrow));
+    }
+#endif
+    HRESULT start(std::nothrow_t) noexcept {
+        if (members.empty()) return E_ILLEGAL_METHOD_CALL;
+        for (member& m : members) {
+            HRESULT status = m.client.start(std::nothrow);
+            if (FAILED(status)) {
+                stop(std::nothrow);
+                return status;
+            }
+        }
+        running = true;
+        return S_OK;
+    }
+
+    HRESULT stop(std::nothrow_t) noexcept {
+        HRESULT result = S_OK;
+        for (member& m : members) {
+            HRESULT status = m.client.stop(std::nothrow);
+            if (FAILED(status) && SUCCEEDED(result)) result = status;
+        }
+        running = false;
+        return result;
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void poll() {
+        throw_com_error(poll(std::nothrow));
+    }
+#endif
+    /**
+     * Reads every member's clock, drains its captured packets through its resampler, and updates its correction.
+     * Returns the first error (e.g. AUDCLNT_E_DEVICE_INVALIDATED); the other members are still polled.
+     */
+    HRESULT poll(std::nothrow_t) noexcept {
+        HRESULT result = S_OK;
+        for (member& m : members) {
+            HRESULT status = poll_member(m);
+            if (FAILED(status) && SUCCEEDED(result)) result = status;
+        }
+        if (!aligned) align();
+        return result;
+    }
+
+    // Frames that can be read from every member (0 until every member's clock has been measured)
+    std::size_t available() const noexcept {
+        if (!aligned) return 0;
+        std::int64_t begin = INT64_MIN;
+        std::int64_t end = INT64_MAX;
+        for (const member& m : members) {
+            begin = (std::max)(begin, m.head_index);
+            end = (std::min)(end, m.head_index + static_cast<std::int64_t>(m.size));
+        }
+        return end > begin ? static_cast<std::size_t>(end - begin) : 0;
+    }
+
+    /**
+     * Copies up to `frames` aligned frames of member i to `out[i]` (interleaved, `channels(i)` per frame).
+     * Returns the number of frames copied.
+     */
+    std::size_t read(float* const* out, std::size_t frames) noexcept {
+        frames = (std::min)(frames, available());
+        if (frames == 0) return 0;
+        std::int64_t begin = INT64_MIN;
+        for (const member& m : members) begin = (std::max)(begin, m.head_index);
+        for (std::size_t i = 0; i < members.size(); ++i) {
+            member& m = members[i];
+            m.pop(static_cast<std::size_t>(begin - m.head_index), nullptr);
+            m.pop(frames, out[i]);
+        }
+        return frames;
+    }
+
+    std::size_t size() const noexcept {
+        return members.size();
+    }
+    unsigned channels(std::size_t i) const noexcept {
+        return members[i].channels;
+    }
+    bool is_aligned() const noexcept {
+        return aligned;
+    }
+
+    capture_member_stats stats(std::size_t i) const noexcept {
+        const member& m = members[i];
+        capture_member_stats s;
+        s.drift_ppm = m.fit.ready() ? (m.fit.rate() / options.sample_rate - 1.0) * 1e6 : 0.0;
+        s.correction_ppm = (m.resampler.get_rate_adjustment() - 1.0) * 1e6;
+        s.min_correction_ppm = m.min_correction_ppm;
+        s.max_correction_ppm = m.max_correction_ppm;
+        s.alignment_error_frames = m.error;
+        s.max_alignment_error_frames = m.max_error;
+        s.rms_alignment_error_frames = std::sqrt(m.mean_square_error);
+        s.clock_jitter_frames = m.fit.residual_rms();
+        s.frames_captured = m.frames_captured;
+        s.frames_dropped = m.frames_dropped;
+        s.gaps = m.gaps;
+        return s;
+    }
+private:
+    // Position readings needed before the clock fit is trusted for alignment
+    static constexpr std::uint64_t min_clock_samples = 64;
+
+    struct member {
+        audio_client client;
+        audio_capture_client capture;
+        audio_clock clock;
+        UINT64 clock_frequency = 1;
+        unsigned channels = 0;
+        dsp::polyphase_resampler resampler;
+        dsp::clock_regression fit;  // Stream frames against performance counter seconds
+        std::vector<float> scratch;
+        std::vector<float> silence;
+
+        bool started = false;
+        UINT64 input_base = 0;  // Stream position of the first frame given to the resampler
+        UINT64 input_end = 0;  // Stream position after the last frame given to the resampler
+
+        // Resampled output, a ring of `capacity` frames. Frame `head_index + j` of the group's output is at `head + j`.
+        std::vector<float> fifo;
+        std::size_t capacity = 0;
+        std::size_t head = 0;
+        std::size_t size = 0;
+        std::int64_t head_index = 0;
+
+        double error = 0;
+        double max_error = 0;
+        double mean_square_error = 0;
+        double min_correction_ppm = 0;
+        double max_correction_ppm = 0;
+        std::uint64_t frames_captured = 0;
+        std::uint64_t frames_dropped = 0;
+        std::uint64_t gaps = 0;
+
+        void push(const float* frames, std::size_t n, bool count_drops) noexcept {
+            if (n > capacity) {
+                frames += (n - capacity) * channels;
+                head_index += static_cast<std::int64_t>(n - capacity);
+                if (count_drops) frames_dropped += n - capacity;
+                n = capacity;
+            }
+            if (size + n > capacity) {
+                std::size_t drop = size + n - capacity;
+                if (count_drops) frames_dropped += drop;
+                pop(drop, nullptr);
+            }
+            std::size_t tail = (head + size) % capacity;
+            std::size_t first = (std::min)(n, capacity - tail);
+            std::memcpy(&fifo[tail * channels], frames, first * channels * sizeof(float));
+            std::memcpy(&fifo[0], frames + first * channels, (n - first) * channels * sizeof(float));
+            size += n;
+        }
+
+        // Drops `n` frames if `out` is nullptr
+        void pop(std::size_t n, float* out) noexcept {
+            n = (std::min)(n, size);
+            if (out) {
+                std::size_t first = (std::min)(n, capacity - head);
+                std::memcpy(out, &fifo[head * channels], first * channels * sizeof(float));
+                std::memcpy(out + first * channels, &fifo[0], (n - first) * channels * sizeof(float));
+            }
+            head = (head + n) % capacity;
+            size -= n;
+            head_index += static_cast<std::int64_t>(n);
+        }
+
+        // Performance counter seconds at which stream position `p` was captured
+        double time_of(double p) const noexcept {
+            return fit.x_at(p);
+        }
+        // Stream position the resampler's next output frame is taken at
+        double next_input_position() const noexcept {
+            return static_cast<double>(input_base) + resampler.next_output_position();
+        }
+    };
+
+    HRESULT poll_member(member& m) noexcept {
+        h_optional<audio_clock::position> p = m.clock.get_position(std::nothrow);
+        if (!p) return p.get_status();
+        // The position stays 0 until the stream has captured something, which says nothing about its rate
+        if (p.get_unchecked().device_position != 0 && p.get_unchecked().qpc_position != 0) {
+            double frames = static_cast<double>(p.get_unchecked().device_position) * options.sample_rate / static_cast<double>(m.clock_frequency);
+            m.fit.add(static_cast<double>(p.get_unchecked().qpc_position) * 1e-7, frames);
+        }
+
+        for (;;) {
+            h_optional<UINT32> next = m.capture.get_next_packet_size(std::nothrow);
+            if (!next) return next.get_status();
+            if (next.get_unchecked() == 0) break;
+            h_optional<audio_capture_client::packet> packet = m.capture.get_buffer(std::nothrow);
+            if (!packet) return packet.get_status();
+            const audio_capture_client::packet& k = packet.get_unchecked();
+            if (k.flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY) detail::count_event("capture_discontinuities");
+            if (!m.started) {
+                m.started = true;
+                m.input_base = m.input_end = k.device_position;
+            }
+            // Fill gaps with silence so stream positions keep matching the resampler's input
+            if (k.device_position > m.input_end && k.device_position - m.input_end < options.sample_rate) {
+                ++m.gaps;
+                detail::count_event("capture_gaps");
+                UINT64 missing = k.device_position - m.input_end;
+                while (missing) {
+                    std::size_t n = static_cast<std::size_t>((std::min)(missing, static_cast<UINT64>(m.silence.size() / m.channels)));
+                    feed(m, m.silence.data(), n);
+                    missing -= n;
+                }
+            }
+            bool silent = (k.flags & AUDCLNT_BUFFERFLAGS_SILENT) != 0;
+            for (std::size_t done = 0; done < k.frames;) {
+                std::size_t n = (std::min)(static_cast<std::size_t>(k.frames) - done, m.silence.size() / m.channels);
+                feed(m, silent ? m.silence.data() : reinterpret_cast<const float*>(k.data) + done * m.channels, n);
+                done += n;
+            }
+            m.frames_captured += k.frames;
+            HRESULT status = m.capture.release_buffer(std::nothrow, k.frames);
+            if (FAILED(status)) return status;
+        }
+        correct(m);
+        return S_OK;
+    }
+
+    void feed(member& m, const float* in, std::size_t frames) noexcept {
+        const std::size_t out_frames = m.scratch.size() / m.channels;
+        while (frames) {
+            dsp::polyphase_resampler::process_result r = m.resampler.process(in, frames, m.scratch.data(), out_frames);
+            m.push(m.scratch.data(), r.produced, aligned);
+            in += r.consumed * m.channels;
+            frames -= r.consumed;
+            m.input_end += r.consumed;
+        }
+    }
+
+    // Sets the time of group output frame 0 once every member's clock has been measured
+    void align() noexcept {
+        for (const member& m : members) {
+            if (!m.started || !m.fit.ready() || m.fit.sample_count() < min_clock_samples) return;
+        }
+        origin_seconds = 0;
+        for (const member& m : members) origin_seconds = (std::max)(origin_seconds, m.time_of(m.next_input_position()));
+        for (member& m : members) {
+            double next_index = (m.time_of(m.next_input_position()) - origin_seconds) * options.sample_rate;
+            m.head_index = static_cast<std::int64_t>(std::llround(next_index)) - static_cast<std::int64_t>(m.size);
+            m.min_correction_ppm = m.max_correction_ppm = (m.resampler.get_rate_adjustment() - 1.0) * 1e6;
+        }
+        aligned = true;
+        for (member& m : members) correct(m);
+    }
+
+    // Sets the resampling ratio from the estimated rate and the alignment error
+    void correct(member& m) noexcept {
+        if (!m.fit.ready()) return;
+        double ratio = m.fit.rate() / options.sample_rate;
+        double adjustment = ratio;
+        if (aligned) {
+            std::int64_t next_index = m.head_index + static_cast<std::int64_t>(m.size);
+            double wanted_seconds = origin_seconds + static_cast<double>(next_index) / options.sample_rate;
+            m.error = (wanted_seconds - m.time_of(m.next_input_position())) * options.sample_rate;
+            m.max_error = (std::max)(m.max_error, std::abs(m.error));
+            m.mean_square_error += (m.error * m.error - m.mean_square_error) * 0.01;
+            // Late (reading input from before the wanted time): consume input faster to catch up
+            adjustment = ratio * (1.0 + m.error / (options.correction_seconds * options.sample_rate));
+        }
+        m.resampler.set_rate_adjustment(adjustment);
+        double ppm = (m.resampler.get_rate_adjustment() - 1.0) * 1e6;
+        m.min_correction_ppm = (std::min)(m.min_correction_ppm, ppm);
+        m.max_correction_ppm = (std::max)(m.max_correction_ppm, ppm);
+    }
+
+    capture_group_options options;
+    std::vector<member> members;
+    bool running = false;
+    bool aligned = false;
+    double origin_seconds = 0;  // Performance counter time of group output frame 0
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_CAPTURE_GROUP_H_
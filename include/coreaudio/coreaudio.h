@@ -6,5 +6,6 @@
 #include "coreaudio/device.h"
 #include "coreaudio/device_collection.h"
 #include "coreaudio/device_enumerator.h"
+#include "coreaudio/notification_client.h"
 
 #endif  // WINDOWS_COREAUDIO_WRAPPER_COREAUDIO_H_
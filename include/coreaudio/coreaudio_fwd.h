@@ -0,0 +1,125 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_COREAUDIO_FWD_H_
+#define WINDOWS_COREAUDIO_WRAPPER_COREAUDIO_FWD_H_
+
+/**
+ * Declarations of the wrapper types, without any Windows or standard headers. Enough for a header that only passes
+ * them by reference or pointer (`void f(const coreaudio::device&);`), so that only the translation units that call
+ * into them need `coreaudio/coreaudio.h` and `windows.h`.
+ *
+ * `com_pointer` is declared without its default argument, so write `com_pointer<IUnknown>` here.
+ */
+
+namespace coreaudio {
+
+template<typename T>
+struct h_optional;
+template<typename T>
+struct h_result;
+template<typename T>
+struct com_pointer;
+template<typename T>
+struct task_memory_pointer;
+template<typename T>
+struct com_ref;
+template<typename Wrapper>
+struct agile_reference;
+template<typename I>
+struct callback_object;
+template<typename T>
+struct resilient_interface;
+
+struct null_call_observer;
+struct metrics_registry;
+struct metrics_call_observer;
+struct metrics_dumper;
+struct broadcast_ring;
+
+struct com_context;
+struct device;
+struct device_collection;
+struct device_enumerator;
+struct notification_client;
+
+struct audio_capture_client;
+struct audio_client;
+struct audio_clock;
+struct audio_clock_adjustment;
+struct device_topology;
+struct endpoint_volume;
+
+struct resilience_policy;
+struct resilient_endpoint_volume;
+struct format_cache;
+
+struct loopback_capture_options;
+struct shared_loopback_capture;
+struct loopback_capture_registry;
+
+enum class capture_container;
+struct capture_writer_options;
+struct capture_writer_stats;
+struct capture_file_writer;
+
+struct capture_group_options;
+struct capture_member_stats;
+struct capture_group;
+
+struct stream_clock;
+
+struct device_snapshot_entry;
+struct device_snapshot_failure;
+struct device_snapshot;
+struct cached_device;
+struct device_cache_image;
+struct device_cache_change;
+struct device_cache;
+struct device_name_index;
+struct topology_node;
+struct topology_graph;
+struct topology_graph_cache;
+
+struct apartment_executor;
+
+enum class profile_switch : signed char;
+struct endpoint_profile;
+struct audio_profile;
+struct endpoint_policy;
+enum class profile_setting;
+struct profile_change;
+struct profile_diff;
+
+struct device_state_event;
+struct default_device_event;
+struct property_event;
+struct endpoint_volume_event;
+struct session_event;
+struct audio_event_batch;
+struct event_bus_stats;
+struct event_bus;
+
+struct watchdog_site;
+struct watchdog;
+
+struct shared_state_publisher;
+struct shared_device_state;
+struct shared_state_reader;
+
+struct volume_change;
+struct volume_monitor;
+enum class volume_taper;
+struct volume_model;
+struct volume_model_cache;
+
+namespace dsp {
+
+struct polyphase_resampler;
+struct clock_regression;
+struct downmix_options;
+struct mix_matrix;
+struct channel_mixer;
+
+}
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_COREAUDIO_FWD_H_
@@ -1,19 +1,25 @@
 #ifndef WINDOWS_COREAUDIO_WRAPPER_DEVICE_H_
 #define WINDOWS_COREAUDIO_WRAPPER_DEVICE_H_
 
+#include "functiondiscoverykeys_devpkey.h"
 #include "mmdeviceapi.h"
+#include "propidl.h"
 #include "winerror.h"
 #include "unknwn.h"
 
 #include <new>
+#include <string>
 #include <type_traits>
 
+#include "coreaudio/device_interfaces/audio_client.h"
+#include "coreaudio/device_interfaces/device_topology.h"
 #include "coreaudio/device_interfaces/endpoint_volume.h"
 #include "coreaudio/util/smart_pointers.h"
 #include "coreaudio/util/h_optional.h"
 #include "coreaudio/util/has_uuid.h"
 #include "coreaudio/util/throw_com_error.h"
 #include "coreaudio/util/interface_wrapper.h"
+#include "coreaudio/util/utf8.h"
 
 
 namespace coreaudio {
@@ -32,42 +38,95 @@ public:
 #ifndef COREAUDIO_NOEXCEPTIONS
     task_memory_pointer<WCHAR> id() const {
         LPWSTR x;
-        throw_com_error(value->GetId(&x));
+        throw_com_error(observe("GetId", [&] { return value->GetId(&x); }));
         return task_memory_pointer<WCHAR>(x);
     }
 #endif
     h_optional<task_memory_pointer<WCHAR>> id(std::nothrow_t) const {
         if (!value) return { E_INVALIDARG, nullptr };
         LPWSTR x = nullptr;
-        HRESULT status = value.get()->GetId(&x);
+        HRESULT status = observe("GetId", [&] { return value.get()->GetId(&x); });
         return { status, task_memory_pointer<WCHAR>(x) };
     }
 
+    /**
+     * The ID as UTF-8, written over `utf8` so that its capacity is reused (only `GetId`'s own string is allocated
+     * once `utf8` is large enough). Throws whatever `std::string` throws.
+     */
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void id(std::string& utf8) const {
+        throw_com_error(id(std::nothrow, utf8));
+    }
+#endif
+    HRESULT id(std::nothrow_t, std::string& utf8) const {
+        utf8.clear();
+        h_optional<task_memory_pointer<WCHAR>> x = id(std::nothrow);
+        if (x) append_utf8(utf8, x.get_unchecked().get());
+        return x.get_status();
+    }
+
+    /**
+     * The string property `key` as UTF-8, written over `utf8` like `id`. S_FALSE (and empty) if the property isn't
+     * set, DISP_E_TYPEMISMATCH if it isn't a string. Throws whatever `std::string` throws.
+     */
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void string_property(const PROPERTYKEY& key, std::string& utf8) const {
+        throw_com_error(string_property(std::nothrow, key, utf8));
+    }
+#endif
+    HRESULT string_property(std::nothrow_t, const PROPERTYKEY& key, std::string& utf8) const {
+        utf8.clear();
+        h_optional<com_pointer<IPropertyStore>> store = open_property_store(std::nothrow, STGM_READ);
+        if (!store) return store.get_status();
+        IPropertyStore* s = store.get_unchecked().get();
+        struct cleared_propvariant {
+            PROPVARIANT v;
+            cleared_propvariant() noexcept { PropVariantInit(&v); }
+            ~cleared_propvariant() { PropVariantClear(&v); }
+        } prop;
+        HRESULT status = detail::observe_call<call_observer>(s, "GetValue", [&] { return s->GetValue(key, &prop.v); });
+        if (FAILED(status)) return status;
+        if (prop.v.vt == VT_EMPTY) return S_FALSE;
+        if (prop.v.vt != VT_LPWSTR) return DISP_E_TYPEMISMATCH;
+        append_utf8(utf8, prop.v.pwszVal);
+        return S_OK;
+    }
+
+    // `PKEY_Device_FriendlyName` as UTF-8, see `string_property`
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void friendly_name(std::string& utf8) const {
+        string_property(PKEY_Device_FriendlyName, utf8);
+    }
+#endif
+    HRESULT friendly_name(std::nothrow_t, std::string& utf8) const {
+        return string_property(std::nothrow, PKEY_Device_FriendlyName, utf8);
+    }
+
 #ifndef COREAUDIO_NOEXCEPTIONS
     DWORD state() const {
         DWORD x;
-        throw_com_error(value->GetState(&x));
+        throw_com_error(observe("GetState", [&] { return value->GetState(&x); }));
         return x;
     }
 #endif
     h_optional<DWORD> state(std::nothrow_t) const noexcept {
         if (!value) return { E_INVALIDARG, 0 };
         DWORD x = 0;
-        HRESULT status = value.get()->GetState(&x);
+        HRESULT status = observe("GetState", [&] { return value.get()->GetState(&x); });
         return { status, x };
     }
 
 #ifndef COREAUDIO_NOEXCEPTIONS
     com_pointer<IPropertyStore> open_property_store(DWORD stgm_access = STGM_READ) const {
         com_pointer<IPropertyStore> result;
-        throw_com_error(value->OpenPropertyStore(stgm_access, &result.get_for_overwrite()));
+        throw_com_error(observe("OpenPropertyStore", [&] { return value->OpenPropertyStore(stgm_access, &result.get_for_overwrite()); }));
         return result;
     }
 #endif
     h_optional<com_pointer<IPropertyStore>> open_property_store(std::nothrow_t, DWORD stgm_access) const noexcept {
         if (!value) return { E_INVALIDARG, nullptr };
         com_pointer<IPropertyStore> result;
-        HRESULT status = value.get()->OpenPropertyStore(stgm_access, &result.get_for_overwrite());
+        HRESULT status = observe("OpenPropertyStore", [&] { return value.get()->OpenPropertyStore(stgm_access, &result.get_for_overwrite()); });
         return { status, static_cast<com_pointer<IPropertyStore>&&>(result) };
     }
 
@@ -77,9 +136,9 @@ public:
         static_assert(detail::maybe_com_interface<T>::value, "device::activate<T>(): T is not a valid COM interface to activate");
 
         com_pointer<T> result;
-        throw_com_error(value->Activate(
+        throw_com_error(observe("Activate", [&] { return value->Activate(
             __uuidof(T), class_ctx, activation_params, reinterpret_cast<void**>(&result.get_for_overwrite())
-        ));
+        ); }));
         return result;
     }
 #endif
@@ -90,9 +149,9 @@ public:
         if (!value) return { E_INVALIDARG, nullptr };
 
         com_pointer<T> result;
-        HRESULT status = value.get()->Activate(
+        HRESULT status = observe("Activate", [&] { return value.get()->Activate(
             __uuidof(T), class_ctx, activation_params, reinterpret_cast<void**>(&result.get_for_overwrite())
-        );
+        ); });
         return { status, static_cast<com_pointer<T>&&>(result) };
     }
 
@@ -106,19 +165,54 @@ public:
         return { result.get_status(), endpoint_volume(result.get_unchecked().release()) };
     }
 
+#ifndef COREAUDIO_NOEXCEPTIONS
+    audio_client activate_audio_client(DWORD class_ctx = CLSCTX_ALL) const {
+        return audio_client(activate<typename audio_client::raw_interface>(nullptr, class_ctx).release());
+    }
+#endif
+    h_optional<audio_client> activate_audio_client(std::nothrow_t, DWORD class_ctx = CLSCTX_ALL) const noexcept {
+        h_optional<com_pointer<typename audio_client::raw_interface>> result = activate<typename audio_client::raw_interface>(std::nothrow, nullptr, class_ctx);
+        return { result.get_status(), audio_client(result.get_unchecked().release()) };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    device_topology activate_device_topology(DWORD class_ctx = CLSCTX_ALL) const {
+        return device_topology(activate<typename device_topology::raw_interface>(nullptr, class_ctx).release());
+    }
+#endif
+    h_optional<device_topology> activate_device_topology(std::nothrow_t, DWORD class_ctx = CLSCTX_ALL) const noexcept {
+        h_optional<com_pointer<typename device_topology::raw_interface>> result = activate<typename device_topology::raw_interface>(std::nothrow, nullptr, class_ctx);
+        return { result.get_status(), device_topology(result.get_unchecked().release()) };
+    }
+
 #ifndef COREAUDIO_NOEXCEPTIONS
     com_pointer<IMMEndpoint> as_endpoint() const {
         com_pointer<IMMEndpoint> result;
-        value->QueryInterface(__uuidof(IMMEndpoint), reinterpret_cast<void**>(&result.get_for_overwrite()));
+        observe("QueryInterface", [&] { return value->QueryInterface(__uuidof(IMMEndpoint), reinterpret_cast<void**>(&result.get_for_overwrite())); });
         return result;
     }
 #endif
     h_optional<com_pointer<IMMEndpoint>> as_endpoint(std::nothrow_t) const noexcept {
         if (!value) return { E_INVALIDARG, nullptr };
         com_pointer<IMMEndpoint> result;
-        HRESULT status = value.get()->QueryInterface(__uuidof(IMMEndpoint), reinterpret_cast<void**>(&result.get_for_overwrite()));
+        HRESULT status = observe("QueryInterface", [&] { return value.get()->QueryInterface(__uuidof(IMMEndpoint), reinterpret_cast<void**>(&result.get_for_overwrite())); });
         return { status, static_cast<com_pointer<IMMEndpoint>&&>(result) };
     }
+
+    // Whether this is a render or a capture endpoint (`IMMEndpoint::GetDataFlow`)
+#ifndef COREAUDIO_NOEXCEPTIONS
+    EDataFlow data_flow() const {
+        return *data_flow(std::nothrow);
+    }
+#endif
+    h_optional<EDataFlow> data_flow(std::nothrow_t) const noexcept {
+        h_optional<com_pointer<IMMEndpoint>> endpoint = as_endpoint(std::nothrow);
+        if (!endpoint) return { endpoint.get_status(), eAll };
+        IMMEndpoint* e = endpoint.get_unchecked().get();
+        EDataFlow result = eAll;
+        HRESULT status = detail::observe_call<call_observer>(e, "GetDataFlow", [&] { return e->GetDataFlow(&result); });
+        return { status, result };
+    }
 };
 
 }
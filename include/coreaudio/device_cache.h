@@ -0,0 +1,577 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_DEVICE_CACHE_H_
+#define WINDOWS_COREAUDIO_WRAPPER_DEVICE_CACHE_H_
+
+#include "windows.h"
+#include "mmdeviceapi.h"
+#include "mmreg.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "coreaudio/com_context.h"
+#include "coreaudio/device_enumerator.h"
+#include "coreaudio/device_snapshot.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/throw_com_error.h"
+#include "coreaudio/util/wave_format.h"
+
+
+namespace coreaudio {
+
+namespace detail {
+
+/* File layout (native endianness, everything naturally aligned):
+ *   device_cache_header
+ *   device_cache_record[entry_count], sorted by ID (ordinal, UTF-16 code units)
+ *   blob: NUL-terminated UTF-16 IDs and friendly names, and device formats, at offsets from `blob_offset`
+ * `checksum` is FNV-1a 64 of everything after the header.
+ */
+struct device_cache_header {
+    UINT32 magic;
+    UINT32 version;
+    UINT32 header_bytes;
+    UINT32 record_bytes;
+    UINT32 entry_count;
+    UINT32 reserved;
+    UINT64 generation;
+    UINT64 blob_offset;
+    UINT64 file_bytes;
+    UINT64 checksum;
+    UINT64 reserved2;
+};
+static_assert(sizeof(device_cache_header) == 64, "device_cache_header layout");
+
+struct device_cache_record {
+    UINT32 id_offset;
+    UINT32 id_chars;  // Not counting the NUL
+    UINT32 name_offset;
+    UINT32 name_chars;
+    UINT32 format_offset;
+    UINT32 format_bytes;  // 0 if unknown
+    UINT32 state;
+    UINT32 data_flow;
+    UINT32 form_factor;
+    float volume;
+    UINT32 muted;
+    UINT32 reserved;
+};
+static_assert(sizeof(device_cache_record) == 48, "device_cache_record layout");
+
+constexpr UINT32 device_cache_magic = 0x43444143;  // "CADC"
+
+inline UINT64 fnv1a_64(const BYTE* data, std::size_t size) noexcept {
+    UINT64 hash = 14695981039346656037ull;
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+inline int compare_ids(const WCHAR* a, std::size_t a_chars, const WCHAR* b, std::size_t b_chars) noexcept {
+    std::size_t n = a_chars < b_chars ? a_chars : b_chars;
+    for (std::size_t i = 0; i < n; ++i) {
+        if (a[i] != b[i]) return static_cast<unsigned>(a[i]) < static_cast<unsigned>(b[i]) ? -1 : 1;
+    }
+    return a_chars == b_chars ? 0 : (a_chars < b_chars ? -1 : 1);
+}
+
+}
+
+// A `device_snapshot_entry` read in place from a `device_cache_image`. Pointers are valid as long as the image is.
+struct cached_device {
+    LPCWSTR id;
+    std::size_t id_length;
+    LPCWSTR friendly_name;
+    std::size_t friendly_name_length;
+    const WAVEFORMATEX* device_format;  // nullptr if unknown
+    std::size_t device_format_bytes;
+    DWORD state;
+    EDataFlow data_flow;
+    UINT32 form_factor;
+    float volume;  // Negative if unknown
+    bool muted;
+};
+
+/**
+ * An immutable device snapshot in the cache file format, either mapped read-only from the file (so loading is
+ * a validation pass over a few KB, without parsing or copying) or built in memory.
+ */
+struct device_cache_image {
+    // Current file format. Files of any other version are rejected as invalid.
+    static constexpr UINT32 format_version = 1;
+    // Status of `map` for files that are truncated, corrupt, of another version or not a cache file
+    static constexpr HRESULT invalid_file = static_cast<HRESULT>(0x8007000DL);  // HRESULT_FROM_WIN32(ERROR_INVALID_DATA)
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    device_cache_image(const device_cache_image&) = delete;
+    device_cache_image& operator=(const device_cache_image&) = delete;
+
+    ~device_cache_image() {
+        if (view) UnmapViewOfFile(view);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    }
+
+    // An image with no devices
+    static std::shared_ptr<const device_cache_image> empty() {
+        return build(std::vector<device_snapshot_entry>(), 0);
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    static std::shared_ptr<const device_cache_image> map(const std::wstring& path) {
+        return static_cast<std::shared_ptr<const device_cache_image>&&>(*map(std::nothrow, path));
+    }
+#endif
+    /**
+     * Maps the cache file at `path` (after moving a `path.new` left by `save` into place). Fails with the
+     * `CreateFileW` error (e.g. ERROR_FILE_NOT_FOUND on the first run) or `invalid_file`.
+     * Throws whatever `std::wstring` and `std::make_shared` throw.
+     */
+    static h_optional<std::shared_ptr<const device_cache_image>> map(std::nothrow_t, const std::wstring& path) {
+        MoveFileExW(pending_path(path).c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+
+        std::shared_ptr<device_cache_image> result(new device_cache_image());
+        result->file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (result->file == INVALID_HANDLE_VALUE) return { HRESULT_FROM_WIN32(GetLastError()), nullptr };
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(result->file, &size)) return { HRESULT_FROM_WIN32(GetLastError()), nullptr };
+        // Real caches are a few KB; don't map anything that can't be one
+        if (size.QuadPart < static_cast<LONGLONG>(sizeof(detail::device_cache_header)) || size.QuadPart > max_file_bytes) return { invalid_file, nullptr };
+        result->mapping = CreateFileMappingW(result->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!result->mapping) return { HRESULT_FROM_WIN32(GetLastError()), nullptr };
+        result->view = MapViewOfFile(result->mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!result->view) return { HRESULT_FROM_WIN32(GetLastError()), nullptr };
+        result->bytes = static_cast<const BYTE*>(result->view);
+        result->byte_count = static_cast<std::size_t>(size.QuadPart);
+        if (!validate(result->bytes, result->byte_count)) return { invalid_file, nullptr };
+        return { S_OK, static_cast<std::shared_ptr<device_cache_image>&&>(result) };
+    }
+
+    // Throws whatever `std::vector` throws
+    static std::shared_ptr<const device_cache_image> build(const std::vector<device_snapshot_entry>& entries, UINT64 generation) {
+        using detail::device_cache_header;
+        using detail::device_cache_record;
+        std::vector<const device_snapshot_entry*> sorted;
+        sorted.reserve(entries.size());
+        for (const device_snapshot_entry& e : entries) sorted.push_back(&e);
+        std::sort(sorted.begin(), sorted.end(), [](const device_snapshot_entry* a, const device_snapshot_entry* b) {
+            return detail::compare_ids(a->id.data(), a->id.size(), b->id.data(), b->id.size()) < 0;
+        });
+
+        std::size_t blob_offset = sizeof(device_cache_header) + sorted.size() * sizeof(device_cache_record);
+        std::size_t blob_bytes = 0;
+        for (const device_snapshot_entry* e : sorted) {
+            blob_bytes += (e->id.size() + 1 + e->friendly_name.size() + 1) * sizeof(WCHAR);
+            blob_bytes = align(blob_bytes) + e->device_format.size();
+        }
+
+        std::shared_ptr<device_cache_image> result(new device_cache_image());
+        result->owned.assign(blob_offset + blob_bytes, 0);
+        BYTE* out = result->owned.data();
+        std::size_t at = 0;
+        for (std::size_t i = 0; i < sorted.size(); ++i) {
+            const device_snapshot_entry& e = *sorted[i];
+            device_cache_record r{};
+            r.id_offset = static_cast<UINT32>(at);
+            r.id_chars = static_cast<UINT32>(e.id.size());
+            std::memcpy(out + blob_offset + at, e.id.c_str(), (e.id.size() + 1) * sizeof(WCHAR));
+            at += (e.id.size() + 1) * sizeof(WCHAR);
+            r.name_offset = static_cast<UINT32>(at);
+            r.name_chars = static_cast<UINT32>(e.friendly_name.size());
+            std::memcpy(out + blob_offset + at, e.friendly_name.c_str(), (e.friendly_name.size() + 1) * sizeof(WCHAR));
+            at = align(at + (e.friendly_name.size() + 1) * sizeof(WCHAR));
+            r.format_offset = static_cast<UINT32>(at);
+            r.format_bytes = static_cast<UINT32>(e.device_format.size());
+            if (!e.device_format.empty()) std::memcpy(out + blob_offset + at, e.device_format.data(), e.device_format.size());
+            at += e.device_format.size();
+            r.state = e.state;
+            r.data_flow = static_cast<UINT32>(e.data_flow);
+            r.form_factor = e.form_factor;
+            r.volume = e.volume;
+            r.muted = e.muted ? 1 : 0;
+            std::memcpy(out + sizeof(device_cache_header) + i * sizeof(device_cache_record), &r, sizeof r);
+        }
+
+        device_cache_header h{};
+        h.magic = detail::device_cache_magic;
+        h.version = format_version;
+        h.header_bytes = sizeof(device_cache_header);
+        h.record_bytes = sizeof(device_cache_record);
+        h.entry_count = static_cast<UINT32>(sorted.size());
+        h.generation = generation;
+        h.blob_offset = blob_offset;
+        h.file_bytes = result->owned.size();
+        h.checksum = detail::fnv1a_64(out + sizeof h, result->owned.size() - sizeof h);
+        std::memcpy(out, &h, sizeof h);
+        result->bytes = out;
+        result->byte_count = result->owned.size();
+        return result;
+    }
+
+    /**
+     * An image holding a copy of `data` (e.g. read from shared memory, see `shared_state_reader`), or nullptr if
+     * `validate` rejects it. Throws whatever `std::vector` throws.
+     */
+    static std::shared_ptr<const device_cache_image> copy(const BYTE* data, std::size_t size) {
+        if (!validate(data, size)) return nullptr;
+        std::shared_ptr<device_cache_image> result(new device_cache_image());
+        result->owned.assign(data, data + size);
+        result->bytes = result->owned.data();
+        result->byte_count = size;
+        return result;
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    // Returns false if `path` was in use and the image was left in `path.new` (see below)
+    bool save(const std::wstring& path) const {
+        HRESULT status = save(std::nothrow, path);
+        throw_com_error(status);
+        return status == S_OK;
+    }
+#endif
+    /**
+     * Writes the image to `path.new`, then moves it over `path`. If that fails because `path` is still in use (e.g.
+     * mapped by another image), returns S_FALSE and leaves `path.new` for the next `map` to move into place.
+     * Throws whatever `std::wstring` throws.
+     */
+    HRESULT save(std::nothrow_t, const std::wstring& path) const {
+        std::wstring pending = pending_path(path);
+        HANDLE f = CreateFileW(pending.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (f == INVALID_HANDLE_VALUE) return HRESULT_FROM_WIN32(GetLastError());
+        HRESULT status = S_OK;
+        DWORD written = 0;
+        if (!WriteFile(f, bytes, static_cast<DWORD>(byte_count), &written, nullptr) || written != byte_count || !FlushFileBuffers(f)) {
+            status = HRESULT_FROM_WIN32(GetLastError());
+            if (SUCCEEDED(status)) status = E_FAIL;
+        }
+        CloseHandle(f);
+        if (FAILED(status)) {
+            DeleteFileW(pending.c_str());
+            return status;
+        }
+        if (!MoveFileExW(pending.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) return S_FALSE;
+        return S_OK;
+    }
+
+    std::size_t size() const noexcept {
+        return header().entry_count;
+    }
+
+    cached_device operator[](std::size_t i) const noexcept {
+        const detail::device_cache_record& r = records()[i];
+        const BYTE* blob = bytes + header().blob_offset;
+        cached_device d;
+        d.id = reinterpret_cast<LPCWSTR>(blob + r.id_offset);
+        d.id_length = r.id_chars;
+        d.friendly_name = reinterpret_cast<LPCWSTR>(blob + r.name_offset);
+        d.friendly_name_length = r.name_chars;
+        d.device_format = r.format_bytes ? reinterpret_cast<const WAVEFORMATEX*>(blob + r.format_offset) : nullptr;
+        d.device_format_bytes = r.format_bytes;
+        d.state = r.state;
+        d.data_flow = static_cast<EDataFlow>(r.data_flow);
+        d.form_factor = r.form_factor;
+        d.volume = r.volume;
+        d.muted = r.muted != 0;
+        return d;
+    }
+
+    // Index of the device with ID `id` (binary search), or `npos`
+    std::size_t find(const WCHAR* id, std::size_t id_length) const noexcept {
+        const detail::device_cache_record* r = records();
+        const BYTE* blob = bytes + header().blob_offset;
+        std::size_t low = 0;
+        std::size_t high = size();
+        while (low < high) {
+            std::size_t mid = low + (high - low) / 2;
+            int c = detail::compare_ids(reinterpret_cast<const WCHAR*>(blob + r[mid].id_offset), r[mid].id_chars, id, id_length);
+            if (c == 0) return mid;
+            if (c < 0) low = mid + 1; else high = mid;
+        }
+        return npos;
+    }
+    std::size_t find(const std::wstring& id) const noexcept {
+        return find(id.data(), id.size());
+    }
+
+    // Throws whatever `std::wstring` and `std::vector` throw
+    device_snapshot_entry entry(std::size_t i) const {
+        cached_device d = (*this)[i];
+        device_snapshot_entry e;
+        e.id.assign(d.id, d.id_length);
+        e.friendly_name.assign(d.friendly_name, d.friendly_name_length);
+        e.state = d.state;
+        e.data_flow = d.data_flow;
+        e.form_factor = d.form_factor;
+        if (d.device_format) {
+            const BYTE* f = reinterpret_cast<const BYTE*>(d.device_format);
+            e.device_format.assign(f, f + d.device_format_bytes);
+        }
+        e.volume = d.volume;
+        e.muted = d.muted;
+        return e;
+    }
+
+    device_snapshot snapshot() const {
+        device_snapshot result;
+        result.entries.reserve(size());
+        for (std::size_t i = 0; i < size(); ++i) result.entries.push_back(entry(i));
+        return result;
+    }
+
+    // Incremented by every reconcile that changed something
+    UINT64 generation() const noexcept {
+        return header().generation;
+    }
+    // Whether this image was read from the file (rather than built in memory)
+    bool is_mapped() const noexcept {
+        return view != nullptr;
+    }
+
+    const BYTE* data() const noexcept {
+        return bytes;
+    }
+    std::size_t byte_size() const noexcept {
+        return byte_count;
+    }
+
+    // Whether `data` is a complete cache file of the current version
+    static bool validate(const BYTE* data, std::size_t size) noexcept {
+        using detail::device_cache_header;
+        using detail::device_cache_record;
+        if (size < sizeof(device_cache_header)) return false;
+        device_cache_header h;
+        std::memcpy(&h, data, sizeof h);
+        if (h.magic != detail::device_cache_magic || h.version != format_version) return false;
+        if (h.header_bytes != sizeof(device_cache_header) || h.record_bytes != sizeof(device_cache_record)) return false;
+        if (h.file_bytes != size || h.entry_count > (size - sizeof h) / sizeof(device_cache_record)) return false;
+        if (h.blob_offset != sizeof h + static_cast<UINT64>(h.entry_count) * sizeof(device_cache_record)) return false;
+        if (h.checksum != detail::fnv1a_64(data + sizeof h, size - sizeof h)) return false;
+
+        const device_cache_record* r = reinterpret_cast<const device_cache_record*>(data + sizeof h);
+        const BYTE* blob = data + h.blob_offset;
+        const UINT64 blob_bytes = size - h.blob_offset;
+        for (UINT32 i = 0; i < h.entry_count; ++i) {
+            if (!valid_string(blob, blob_bytes, r[i].id_offset, r[i].id_chars) || r[i].id_chars == 0) return false;
+            if (!valid_string(blob, blob_bytes, r[i].name_offset, r[i].name_chars)) return false;
+            if (r[i].format_bytes != 0) {
+                if (r[i].format_bytes < sizeof(WAVEFORMATEX) || r[i].format_offset % alignment != 0) return false;
+                if (static_cast<UINT64>(r[i].format_offset) + r[i].format_bytes > blob_bytes) return false;
+                if (wave_format_size(blob + r[i].format_offset, r[i].format_bytes) == 0) return false;
+            }
+            if (i > 0 && detail::compare_ids(reinterpret_cast<const WCHAR*>(blob + r[i - 1].id_offset), r[i - 1].id_chars,
+                                             reinterpret_cast<const WCHAR*>(blob + r[i].id_offset), r[i].id_chars) >= 0) return false;
+        }
+        return true;
+    }
+
+    static std::wstring pending_path(const std::wstring& path) {
+        return path + L".new";
+    }
+private:
+    static constexpr std::size_t alignment = 8;
+    static constexpr LONGLONG max_file_bytes = 16 * 1024 * 1024;
+
+    device_cache_image() noexcept = default;
+
+    static std::size_t align(std::size_t n) noexcept {
+        return (n + alignment - 1) / alignment * alignment;
+    }
+
+    static bool valid_string(const BYTE* blob, UINT64 blob_bytes, UINT32 offset, UINT32 chars) noexcept {
+        if (offset % sizeof(WCHAR) != 0) return false;
+        if (static_cast<UINT64>(offset) + (static_cast<UINT64>(chars) + 1) * sizeof(WCHAR) > blob_bytes) return false;
+        return reinterpret_cast<const WCHAR*>(blob + offset)[chars] == 0;
+    }
+
+    const detail::device_cache_header& header() const noexcept {
+        return *reinterpret_cast<const detail::device_cache_header*>(bytes);
+    }
+    const detail::device_cache_record* records() const noexcept {
+        return reinterpret_cast<const detail::device_cache_record*>(bytes + sizeof(detail::device_cache_header));
+    }
+
+    std::vector<BYTE> owned;
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+    void* view = nullptr;
+    const BYTE* bytes = nullptr;
+    std::size_t byte_count = 0;
+};
+
+// What `device_cache::reconcile` found different about one device
+struct device_cache_change {
+    enum : unsigned {
+        added = 1,
+        removed = 2,
+        state = 4,
+        friendly_name = 8,
+        data_flow = 16,
+        form_factor = 32,
+        device_format = 64,
+        volume = 128  // Volume or mute
+    };
+
+    std::wstring id;
+    unsigned what;
+};
+
+/**
+ * A device snapshot persisted to a small memory-mapped file, so a device list can be drawn at startup before
+ * enumerating anything, then brought up to date in the background.
+ *
+ * `load` maps the file (and reports why not, e.g. on the first run). `reconcile` takes a fresh `device_snapshot`,
+ * compares it with the cached one, and only if some device was added, removed or changed publishes a new image,
+ * rewrites the file and reports which devices changed and how. The endpoint volume can only be read from active
+ * devices, so the last known volume of a device that is no longer active is kept.
+ *
+ * `current` is thread-safe; `load` and `reconcile` are serialized.
+ */
+struct device_cache {
+    explicit device_cache(std::wstring path) : file_path(static_cast<std::wstring&&>(path)), image(device_cache_image::empty()) {}
+
+    device_cache(const device_cache&) = delete;
+    device_cache& operator=(const device_cache&) = delete;
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void load() {
+        throw_com_error(load(std::nothrow));
+    }
+#endif
+    /**
+     * Replaces the current image with the file's. If it can't be mapped (missing, corrupt or of another version),
+     * the current image is kept and the error returned; the next `reconcile` will write a fresh file.
+     * Throws whatever `device_cache_image::map` throws.
+     */
+    HRESULT load(std::nothrow_t) {
+        std::lock_guard<std::mutex> reconciling(reconcile_mutex);
+        h_optional<std::shared_ptr<const device_cache_image>> mapped = device_cache_image::map(std::nothrow, file_path);
+        if (!mapped) return mapped.get_status();
+        publish(static_cast<std::shared_ptr<const device_cache_image>&&>(mapped.get_unchecked()));
+        return S_OK;
+    }
+
+    // The latest image. Stays valid (and unchanged) for as long as it is held.
+    std::shared_ptr<const device_cache_image> current() const {
+        std::lock_guard<std::mutex> lock(image_mutex);
+        return image;
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    // Throws if the file couldn't be written, although the new image is published (see below)
+    std::vector<device_cache_change> reconcile(const device_enumerator& e) {
+        return static_cast<std::vector<device_cache_change>&&>(*reconcile(std::nothrow, e));
+    }
+#endif
+    /**
+     * Compares every endpoint with the cache and patches the devices that differ. Returns the changes (empty if
+     * none, in which case the file isn't touched). If the file couldn't be written, the status is the error, but the
+     * new image is still published. Throws whatever `std::wstring` and `std::vector` throw.
+     *
+     * Endpoints that couldn't be read (see `device_snapshot::failures`) keep their cached record rather than being
+     * reported as removed. If one of them couldn't even give its ID, no cached device is taken as removed this time.
+     */
+    h_optional<std::vector<device_cache_change>> reconcile(std::nothrow_t, const device_enumerator& e) {
+        std::lock_guard<std::mutex> reconciling(reconcile_mutex);
+        std::vector<device_cache_change> changes;
+        h_optional<device_snapshot> taken = device_snapshot::take(e);
+        if (!taken) return { taken.get_status(), static_cast<std::vector<device_cache_change>&&>(changes) };
+        std::vector<device_snapshot_entry>& fresh = taken.get_unchecked().entries;
+
+        std::shared_ptr<const device_cache_image> old = current();
+        std::vector<bool> seen(old->size(), false);
+        std::vector<bool> failed(old->size(), false);
+        bool unidentified_failure = false;
+        for (const device_snapshot_failure& f : taken.get_unchecked().failures) {
+            std::size_t i = f.id.empty() ? device_cache_image::npos : old->find(f.id);
+            if (i != device_cache_image::npos) failed[i] = true;
+            unidentified_failure = unidentified_failure || f.id.empty();
+        }
+        for (device_snapshot_entry& f : fresh) {
+            std::size_t i = old->find(f.id);
+            if (i == device_cache_image::npos) {
+                changes.push_back({ f.id, device_cache_change::added });
+                continue;
+            }
+            seen[i] = true;
+            cached_device c = (*old)[i];
+            if (!f.has_volume() && c.volume >= 0) {
+                f.volume = c.volume;
+                f.muted = c.muted;
+            }
+            unsigned what = difference(c, f);
+            if (what) changes.push_back({ f.id, what });
+        }
+        for (std::size_t i = 0; i < seen.size(); ++i) {
+            if (seen[i]) continue;
+            if (failed[i] || unidentified_failure) {
+                // Couldn't be read this time: keep the cached record as it is
+                fresh.push_back(old->entry(i));
+                continue;
+            }
+            cached_device c = (*old)[i];
+            changes.push_back({ std::wstring(c.id, c.id_length), device_cache_change::removed });
+        }
+        if (changes.empty()) return { S_OK, static_cast<std::vector<device_cache_change>&&>(changes) };
+
+        std::shared_ptr<const device_cache_image> patched = device_cache_image::build(fresh, old->generation() + 1);
+        publish(patched);
+        // Let go of the old mapping first, so the file can be replaced if nobody else holds it
+        old.reset();
+        HRESULT saved = patched->save(std::nothrow, file_path);
+        return { FAILED(saved) ? saved : S_OK, static_cast<std::vector<device_cache_change>&&>(changes) };
+    }
+
+    /**
+     * Runs `reconcile` on a new MTA thread with its own enumerator. The cache must outlive the returned future
+     * (whose destructor waits for the thread). Throws `std::system_error` if the thread can't be started.
+     */
+    std::future<h_optional<std::vector<device_cache_change>>> reconcile_in_background() {
+        return std::async(std::launch::async, [this]() -> h_optional<std::vector<device_cache_change>> {
+            h_optional<com_context> com = com_context::make(COINIT_MULTITHREADED);
+            if (!com) return { com.get_status(), std::vector<device_cache_change>() };
+            h_optional<device_enumerator> e = device_enumerator::make(com.get_unchecked());
+            if (!e) return { e.get_status(), std::vector<device_cache_change>() };
+            return reconcile(std::nothrow, e.get_unchecked());
+        });
+    }
+
+    const std::wstring& path() const noexcept {
+        return file_path;
+    }
+private:
+    static unsigned difference(const cached_device& c, const device_snapshot_entry& f) noexcept {
+        unsigned what = 0;
+        if (c.state != f.state) what |= device_cache_change::state;
+        if (detail::compare_ids(c.friendly_name, c.friendly_name_length, f.friendly_name.data(), f.friendly_name.size()) != 0) what |= device_cache_change::friendly_name;
+        if (c.data_flow != f.data_flow) what |= device_cache_change::data_flow;
+        if (c.form_factor != f.form_factor) what |= device_cache_change::form_factor;
+        if (c.device_format_bytes != f.device_format.size() ||
+            (c.device_format_bytes && std::memcmp(c.device_format, f.device_format.data(), c.device_format_bytes) != 0)) {
+            what |= device_cache_change::device_format;
+        }
+        if (c.volume != f.volume || c.muted != f.muted) what |= device_cache_change::volume;
+        return what;
+    }
+
+    void publish(std::shared_ptr<const device_cache_image> next) {
+        std::lock_guard<std::mutex> lock(image_mutex);
+        image.swap(next);
+    }
+
+    const std::wstring file_path;
+    std::mutex reconcile_mutex;
+    mutable std::mutex image_mutex;
+    std::shared_ptr<const device_cache_image> image;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_DEVICE_CACHE_H_
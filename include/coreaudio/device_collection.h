@@ -21,7 +21,7 @@ public:
 #ifndef COREAUDIO_NOEXCEPTIONS
     explicit device_collection(raw_interface* ptr) : super(ptr) {
         if (ptr) {
-            throw_com_error(ptr->GetCount(&count));
+            throw_com_error(detail::observe_call<call_observer>(ptr, "GetCount", [&] { return ptr->GetCount(&count); }));
         } else {
             count = 0;
         }
@@ -34,7 +34,7 @@ public:
             return { S_OK, device_collection(nullptr) };
         }
         device_collection c(std::nothrow, ptr);
-        HRESULT status = ptr->GetCount(&c.count);
+        HRESULT status = detail::observe_call<call_observer>(ptr, "GetCount", [&] { return ptr->GetCount(&c.count); });
         return { status, static_cast<device_collection&&>(c) };
     }
 
@@ -69,7 +69,7 @@ public:
             return { E_INVALIDARG, device(nullptr) };
         }
         IMMDevice* p = nullptr;
-        HRESULT status = value.get()->Item(n, &p);
+        HRESULT status = observe("Item", [&] { return value.get()->Item(n, &p); });
         return { status, device(p) };
     }
 
@@ -195,7 +195,7 @@ private:
 #ifndef COREAUDIO_NOEXCEPTIONS
 inline device_collection device_enumerator::enum_audio_endpoints(EDataFlow data_flow, DWORD state_mask = DEVICE_STATEMASK_ALL) const  {
     IMMDeviceCollection* ptr;
-    throw_com_error(value->EnumAudioEndpoints(data_flow, state_mask, &ptr));
+    throw_com_error(observe("EnumAudioEndpoints", [&] { return value->EnumAudioEndpoints(data_flow, state_mask, &ptr); }));
     return device_collection(ptr);
 }
 #endif
@@ -205,7 +205,7 @@ inline h_optional<device_collection> device_enumerator::enum_audio_endpoints(std
         return { E_INVALIDARG, device_collection(nullptr) };
     }
     IMMDeviceCollection* ptr;
-    HRESULT status = value.get()->EnumAudioEndpoints(data_flow, state_mask, &ptr);
+    HRESULT status = observe("EnumAudioEndpoints", [&] { return value.get()->EnumAudioEndpoints(data_flow, state_mask, &ptr); });
     if (FAILED(status)) {
         return { status, device_collection(nullptr) };
     }
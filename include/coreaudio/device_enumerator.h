@@ -20,10 +20,12 @@ struct device_collection;
 struct device_enumerator : detail::interface_wrapper<IMMDeviceEnumerator> {
 private:
     static HRESULT create(raw_interface*& to) noexcept {
-        return CoCreateInstance(
-            __uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator),
-            reinterpret_cast<void**>(&to)
-        );
+        return detail::observe_call<call_observer>(static_cast<raw_interface*>(nullptr), "CoCreateInstance", [&] {
+            return CoCreateInstance(
+                __uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator),
+                reinterpret_cast<void**>(&to)
+            );
+        });
     }
     using super = detail::interface_wrapper<IMMDeviceEnumerator>;
 public:
@@ -66,7 +68,7 @@ public:
     // Returns a null device if not found. Throws _com_error on other errors
     device get_default_endpoint(EDataFlow data_flow, ERole role = eConsole) const {
         IMMDevice* d;
-        HRESULT hr = value->GetDefaultAudioEndpoint(data_flow, role, &d);
+        HRESULT hr = observe("GetDefaultAudioEndpoint", [&] { return value->GetDefaultAudioEndpoint(data_flow, role, &d); });
         if (SUCCEEDED(hr)) return device(d);
         if (hr == E_NOTFOUND) return device(nullptr);
         throw _com_error(hr);
@@ -75,7 +77,7 @@ public:
     h_optional<device> get_default_endpoint(std::nothrow_t, EDataFlow data_flow, ERole role = eConsole) const noexcept {
         if (!value) return { E_INVALIDARG, device(nullptr) };
         IMMDevice* d = nullptr;
-        HRESULT hr = value.get()->GetDefaultAudioEndpoint(data_flow, role, &d);
+        HRESULT hr = observe("GetDefaultAudioEndpoint", [&] { return value.get()->GetDefaultAudioEndpoint(data_flow, role, &d); });
         return { hr, device(d) };
     }
 
@@ -83,7 +85,7 @@ public:
     // Returns a null device if not found. Throws _com_error on other errors
     device get_device(LPCWSTR id) const {
         IMMDevice* d;
-        HRESULT hr = value->GetDevice(id, &d);
+        HRESULT hr = observe("GetDevice", [&] { return value->GetDevice(id, &d); });
         if (SUCCEEDED(hr)) return device(d);
         if (hr == E_NOTFOUND) return device(nullptr);
         throw _com_error(hr);
@@ -93,27 +95,27 @@ public:
     h_optional<device> get_device(std::nothrow_t, LPCWSTR id) const noexcept {
         if (!value) return { E_INVALIDARG, device(nullptr) };
         IMMDevice* d = nullptr;
-        HRESULT hr = value.get()->GetDevice(id, &d);
+        HRESULT hr = observe("GetDevice", [&] { return value.get()->GetDevice(id, &d); });
         return { hr, device(d) };
     }
 
     HRESULT register_endpoint_notification_callback(std::nothrow_t, IMMNotificationClient* callback) const noexcept {
         if (!value) return E_INVALIDARG;
-        return value.get()->RegisterEndpointNotificationCallback(callback);
+        return observe("RegisterEndpointNotificationCallback", [&] { return value.get()->RegisterEndpointNotificationCallback(callback); });
     }
 #ifndef COREAUDIO_NOEXCEPTIONS
     void register_endpoint_notification_callback(IMMNotificationClient* callback) const {
-        throw_com_error(value->RegisterEndpointNotificationCallback(callback));
+        throw_com_error(observe("RegisterEndpointNotificationCallback", [&] { return value->RegisterEndpointNotificationCallback(callback); }));
     }
 #endif
 
     HRESULT unregister_endpoint_notification_callback(std::nothrow_t, IMMNotificationClient* callback) const noexcept {
         if (!value) return E_INVALIDARG;
-        return value.get()->UnregisterEndpointNotificationCallback(callback);
+        return observe("UnregisterEndpointNotificationCallback", [&] { return value.get()->UnregisterEndpointNotificationCallback(callback); });
     }
 #ifndef COREAUDIO_NOEXCEPTIONS
     void unregister_endpoint_notification_callback(IMMNotificationClient* callback) const {
-        throw_com_error(value->UnregisterEndpointNotificationCallback(callback));
+        throw_com_error(observe("UnregisterEndpointNotificationCallback", [&] { return value->UnregisterEndpointNotificationCallback(callback); }));
     }
 #endif
 };
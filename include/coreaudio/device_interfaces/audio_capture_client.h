@@ -0,0 +1,75 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_AUDIO_CAPTURE_CLIENT_H_
+#define WINDOWS_COREAUDIO_WRAPPER_AUDIO_CAPTURE_CLIENT_H_
+
+#include "audioclient.h"
+
+#include <new>
+
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/interface_wrapper.h"
+#include "coreaudio/util/throw_com_error.h"
+
+namespace coreaudio {
+
+struct audio_capture_client : detail::interface_wrapper<IAudioCaptureClient> {
+private:
+    using super = detail::interface_wrapper<IAudioCaptureClient>;
+public:
+    constexpr audio_capture_client() noexcept = default;
+
+    explicit audio_capture_client(raw_interface* ptr) noexcept : super(ptr) {}
+
+    audio_capture_client(audio_capture_client&&) noexcept = default;
+    audio_capture_client& operator=(audio_capture_client&&) noexcept = default;
+
+    struct packet {
+        BYTE* data;  // Valid until `release_buffer`. Ignore the contents if `flags & AUDCLNT_BUFFERFLAGS_SILENT`.
+        UINT32 frames;
+        DWORD flags;  // AUDCLNT_BUFFERFLAGS_*
+        UINT64 device_position;  // In frames
+        UINT64 qpc_position;  // In 100 ns units
+    };
+
+    // Status is AUDCLNT_S_BUFFER_EMPTY (with 0 frames) if there is no packet
+#ifndef COREAUDIO_NOEXCEPTIONS
+    packet get_buffer() const {
+        packet result{nullptr, 0, 0, 0, 0};
+        throw_com_error(observe("GetBuffer", [&] { return value->GetBuffer(&result.data, &result.frames, &result.flags, &result.device_position, &result.qpc_position); }));
+        return result;
+    }
+#endif
+    h_optional<packet> get_buffer(std::nothrow_t) const noexcept {
+        packet result{nullptr, 0, 0, 0, 0};
+        if (!value) return { E_INVALIDARG, result };
+        HRESULT status = observe("GetBuffer", [&] { return value.get()->GetBuffer(&result.data, &result.frames, &result.flags, &result.device_position, &result.qpc_position); });
+        return { status, result };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void release_buffer(UINT32 frames_read) const {
+        throw_com_error(observe("ReleaseBuffer", [&] { return value->ReleaseBuffer(frames_read); }));
+    }
+#endif
+    HRESULT release_buffer(std::nothrow_t, UINT32 frames_read) const noexcept {
+        if (!value) return E_INVALIDARG;
+        return observe("ReleaseBuffer", [&] { return value.get()->ReleaseBuffer(frames_read); });
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    UINT32 get_next_packet_size() const {
+        UINT32 result = 0;
+        throw_com_error(observe("GetNextPacketSize", [&] { return value->GetNextPacketSize(&result); }));
+        return result;
+    }
+#endif
+    h_optional<UINT32> get_next_packet_size(std::nothrow_t) const noexcept {
+        if (!value) return { E_INVALIDARG, 0 };
+        UINT32 result = 0;
+        HRESULT status = observe("GetNextPacketSize", [&] { return value.get()->GetNextPacketSize(&result); });
+        return { status, result };
+    }
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_AUDIO_CAPTURE_CLIENT_H_
@@ -0,0 +1,193 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_AUDIO_CLIENT_H_
+#define WINDOWS_COREAUDIO_WRAPPER_AUDIO_CLIENT_H_
+
+#include "audioclient.h"
+
+#include <new>
+
+#include "coreaudio/util/has_uuid.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/interface_wrapper.h"
+#include "coreaudio/util/smart_pointers.h"
+#include "coreaudio/util/throw_com_error.h"
+
+namespace coreaudio {
+
+struct audio_client : detail::interface_wrapper<IAudioClient> {
+private:
+    using super = detail::interface_wrapper<IAudioClient>;
+public:
+    constexpr audio_client() noexcept = default;
+
+    explicit audio_client(raw_interface* ptr) noexcept : super(ptr) {}
+
+    audio_client(audio_client&&) noexcept = default;
+    audio_client& operator=(audio_client&&) noexcept = default;
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void initialize(AUDCLNT_SHAREMODE share_mode, DWORD stream_flags, REFERENCE_TIME buffer_duration, REFERENCE_TIME periodicity, const WAVEFORMATEX* format, const GUID* audio_session_guid = nullptr) const {
+        throw_com_error(observe("Initialize", [&] { return value->Initialize(share_mode, stream_flags, buffer_duration, periodicity, format, audio_session_guid); }));
+    }
+#endif
+    HRESULT initialize(std::nothrow_t, AUDCLNT_SHAREMODE share_mode, DWORD stream_flags, REFERENCE_TIME buffer_duration, REFERENCE_TIME periodicity, const WAVEFORMATEX* format, const GUID* audio_session_guid = nullptr) const noexcept {
+        if (!value) return E_INVALIDARG;
+        return observe("Initialize", [&] { return value.get()->Initialize(share_mode, stream_flags, buffer_duration, periodicity, format, audio_session_guid); });
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    task_memory_pointer<WAVEFORMATEX> get_mix_format() const {
+        WAVEFORMATEX* result = nullptr;
+        throw_com_error(observe("GetMixFormat", [&] { return value->GetMixFormat(&result); }));
+        return task_memory_pointer<WAVEFORMATEX>(result);
+    }
+#endif
+    h_optional<task_memory_pointer<WAVEFORMATEX>> get_mix_format(std::nothrow_t) const noexcept {
+        if (!value) return { E_INVALIDARG, nullptr };
+        WAVEFORMATEX* result = nullptr;
+        HRESULT status = observe("GetMixFormat", [&] { return value.get()->GetMixFormat(&result); });
+        return { status, task_memory_pointer<WAVEFORMATEX>(result) };
+    }
+
+    /**
+     * Status is S_OK if `format` is supported, S_FALSE if it isn't but there is a closest match (returned; only in
+     * shared mode), or AUDCLNT_E_UNSUPPORTED_FORMAT if it isn't and there is no closest match.
+     */
+#ifndef COREAUDIO_NOEXCEPTIONS
+    task_memory_pointer<WAVEFORMATEX> is_format_supported(AUDCLNT_SHAREMODE share_mode, const WAVEFORMATEX* format) const {
+        h_optional<task_memory_pointer<WAVEFORMATEX>> result = is_format_supported(std::nothrow, share_mode, format);
+        return static_cast<task_memory_pointer<WAVEFORMATEX>&&>(*result);
+    }
+#endif
+    h_optional<task_memory_pointer<WAVEFORMATEX>> is_format_supported(std::nothrow_t, AUDCLNT_SHAREMODE share_mode, const WAVEFORMATEX* format) const noexcept {
+        if (!value) return { E_INVALIDARG, nullptr };
+        WAVEFORMATEX* closest = nullptr;
+        HRESULT status = observe("IsFormatSupported", [&] {
+            return value.get()->IsFormatSupported(share_mode, format, share_mode == AUDCLNT_SHAREMODE_SHARED ? &closest : nullptr);
+        });
+        return { status, task_memory_pointer<WAVEFORMATEX>(closest) };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    UINT32 get_buffer_size() const {
+        UINT32 result = 0;
+        throw_com_error(observe("GetBufferSize", [&] { return value->GetBufferSize(&result); }));
+        return result;
+    }
+#endif
+    h_optional<UINT32> get_buffer_size(std::nothrow_t) const noexcept {
+        if (!value) return { E_INVALIDARG, 0 };
+        UINT32 result = 0;
+        HRESULT status = observe("GetBufferSize", [&] { return value.get()->GetBufferSize(&result); });
+        return { status, result };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    UINT32 get_current_padding() const {
+        UINT32 result = 0;
+        throw_com_error(observe("GetCurrentPadding", [&] { return value->GetCurrentPadding(&result); }));
+        return result;
+    }
+#endif
+    h_optional<UINT32> get_current_padding(std::nothrow_t) const noexcept {
+        if (!value) return { E_INVALIDARG, 0 };
+        UINT32 result = 0;
+        HRESULT status = observe("GetCurrentPadding", [&] { return value.get()->GetCurrentPadding(&result); });
+        return { status, result };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    REFERENCE_TIME get_stream_latency() const {
+        REFERENCE_TIME result = 0;
+        throw_com_error(observe("GetStreamLatency", [&] { return value->GetStreamLatency(&result); }));
+        return result;
+    }
+#endif
+    h_optional<REFERENCE_TIME> get_stream_latency(std::nothrow_t) const noexcept {
+        if (!value) return { E_INVALIDARG, 0 };
+        REFERENCE_TIME result = 0;
+        HRESULT status = observe("GetStreamLatency", [&] { return value.get()->GetStreamLatency(&result); });
+        return { status, result };
+    }
+
+    struct device_period {
+        REFERENCE_TIME default_period;
+        REFERENCE_TIME minimum_period;
+    };
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    device_period get_device_period() const {
+        device_period result{0, 0};
+        throw_com_error(observe("GetDevicePeriod", [&] { return value->GetDevicePeriod(&result.default_period, &result.minimum_period); }));
+        return result;
+    }
+#endif
+    h_optional<device_period> get_device_period(std::nothrow_t) const noexcept {
+        if (!value) return { E_INVALIDARG, { 0, 0 } };
+        device_period result{0, 0};
+        HRESULT status = observe("GetDevicePeriod", [&] { return value.get()->GetDevicePeriod(&result.default_period, &result.minimum_period); });
+        return { status, result };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void set_event_handle(HANDLE event_handle) const {
+        throw_com_error(observe("SetEventHandle", [&] { return value->SetEventHandle(event_handle); }));
+    }
+#endif
+    HRESULT set_event_handle(std::nothrow_t, HANDLE event_handle) const noexcept {
+        if (!value) return E_INVALIDARG;
+        return observe("SetEventHandle", [&] { return value.get()->SetEventHandle(event_handle); });
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void start() const {
+        throw_com_error(observe("Start", [&] { return value->Start(); }));
+    }
+#endif
+    HRESULT start(std::nothrow_t) const noexcept {
+        if (!value) return E_INVALIDARG;
+        return observe("Start", [&] { return value.get()->Start(); });
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void stop() const {
+        throw_com_error(observe("Stop", [&] { return value->Stop(); }));
+    }
+#endif
+    HRESULT stop(std::nothrow_t) const noexcept {
+        if (!value) return E_INVALIDARG;
+        return observe("Stop", [&] { return value.get()->Stop(); });
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void reset() const {
+        throw_com_error(observe("Reset", [&] { return value->Reset(); }));
+    }
+#endif
+    HRESULT reset(std::nothrow_t) const noexcept {
+        if (!value) return E_INVALIDARG;
+        return observe("Reset", [&] { return value.get()->Reset(); });
+    }
+
+    // T is one of IAudioCaptureClient, IAudioRenderClient, IAudioClock, IAudioClockAdjustment, ISimpleAudioVolume, ...
+#ifndef COREAUDIO_NOEXCEPTIONS
+    template<typename T>
+    com_pointer<T> get_service() const {
+        static_assert(detail::maybe_com_interface<T>::value, "audio_client::get_service<T>(): T is not a valid COM interface");
+        com_pointer<T> result;
+        throw_com_error(observe("GetService", [&] { return value->GetService(__uuidof(T), reinterpret_cast<void**>(&result.get_for_overwrite())); }));
+        return result;
+    }
+#endif
+    template<typename T>
+    h_optional<com_pointer<T>> get_service(std::nothrow_t) const noexcept {
+        static_assert(detail::maybe_com_interface<T>::value, "audio_client::get_service<T>(): T is not a valid COM interface");
+        if (!value) return { E_INVALIDARG, nullptr };
+        com_pointer<T> result;
+        HRESULT status = observe("GetService", [&] { return value.get()->GetService(__uuidof(T), reinterpret_cast<void**>(&result.get_for_overwrite())); });
+        return { status, static_cast<com_pointer<T>&&>(result) };
+    }
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_AUDIO_CLIENT_H_
@@ -0,0 +1,76 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_AUDIO_CLOCK_H_
+#define WINDOWS_COREAUDIO_WRAPPER_AUDIO_CLOCK_H_
+
+#include "audioclient.h"
+
+#include <new>
+
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/interface_wrapper.h"
+#include "coreaudio/util/throw_com_error.h"
+
+namespace coreaudio {
+
+struct audio_clock : detail::interface_wrapper<IAudioClock> {
+private:
+    using super = detail::interface_wrapper<IAudioClock>;
+public:
+    constexpr audio_clock() noexcept = default;
+
+    explicit audio_clock(raw_interface* ptr) noexcept : super(ptr) {}
+
+    audio_clock(audio_clock&&) noexcept = default;
+    audio_clock& operator=(audio_clock&&) noexcept = default;
+
+    // Units of `position::device_position` per second
+#ifndef COREAUDIO_NOEXCEPTIONS
+    UINT64 get_frequency() const {
+        UINT64 result = 0;
+        throw_com_error(observe("GetFrequency", [&] { return value->GetFrequency(&result); }));
+        return result;
+    }
+#endif
+    h_optional<UINT64> get_frequency(std::nothrow_t) const noexcept {
+        if (!value) return { E_INVALIDARG, 0 };
+        UINT64 result = 0;
+        HRESULT status = observe("GetFrequency", [&] { return value.get()->GetFrequency(&result); });
+        return { status, result };
+    }
+
+    struct position {
+        UINT64 device_position;  // In units of `get_frequency()`
+        UINT64 qpc_position;  // The performance counter when the position was read, in 100 ns units
+    };
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    position get_position() const {
+        position result{0, 0};
+        throw_com_error(observe("GetPosition", [&] { return value->GetPosition(&result.device_position, &result.qpc_position); }));
+        return result;
+    }
+#endif
+    h_optional<position> get_position(std::nothrow_t) const noexcept {
+        position result{0, 0};
+        if (!value) return { E_INVALIDARG, result };
+        HRESULT status = observe("GetPosition", [&] { return value.get()->GetPosition(&result.device_position, &result.qpc_position); });
+        return { status, result };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    DWORD get_characteristics() const {
+        DWORD result = 0;
+        throw_com_error(observe("GetCharacteristics", [&] { return value->GetCharacteristics(&result); }));
+        return result;
+    }
+#endif
+    h_optional<DWORD> get_characteristics(std::nothrow_t) const noexcept {
+        if (!value) return { E_INVALIDARG, 0 };
+        DWORD result = 0;
+        HRESULT status = observe("GetCharacteristics", [&] { return value.get()->GetCharacteristics(&result); });
+        return { status, result };
+    }
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_AUDIO_CLOCK_H_
@@ -0,0 +1,38 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_AUDIO_CLOCK_ADJUSTMENT_H_
+#define WINDOWS_COREAUDIO_WRAPPER_AUDIO_CLOCK_ADJUSTMENT_H_
+
+#include "audioclient.h"
+
+#include <new>
+
+#include "coreaudio/util/interface_wrapper.h"
+#include "coreaudio/util/throw_com_error.h"
+
+namespace coreaudio {
+
+// Only available from an audio client initialized with AUDCLNT_STREAMFLAGS_RATEADJUST
+struct audio_clock_adjustment : detail::interface_wrapper<IAudioClockAdjustment> {
+private:
+    using super = detail::interface_wrapper<IAudioClockAdjustment>;
+public:
+    constexpr audio_clock_adjustment() noexcept = default;
+
+    explicit audio_clock_adjustment(raw_interface* ptr) noexcept : super(ptr) {}
+
+    audio_clock_adjustment(audio_clock_adjustment&&) noexcept = default;
+    audio_clock_adjustment& operator=(audio_clock_adjustment&&) noexcept = default;
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void set_sample_rate(float sample_rate) const {
+        throw_com_error(observe("SetSampleRate", [&] { return value->SetSampleRate(sample_rate); }));
+    }
+#endif
+    HRESULT set_sample_rate(std::nothrow_t, float sample_rate) const noexcept {
+        if (!value) return E_INVALIDARG;
+        return observe("SetSampleRate", [&] { return value.get()->SetSampleRate(sample_rate); });
+    }
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_AUDIO_CLOCK_ADJUSTMENT_H_
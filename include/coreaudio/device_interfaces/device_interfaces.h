@@ -1,6 +1,11 @@
 #ifndef WINDOWS_COREAUDIO_WRAPPER_DEVICE_INTERFACES_H_
 #define WINDOWS_COREAUDIO_WRAPPER_DEVICE_INTERFACES_H_
 
+#include "coreaudio/device_interfaces/audio_capture_client.h"
+#include "coreaudio/device_interfaces/audio_client.h"
+#include "coreaudio/device_interfaces/audio_clock.h"
+#include "coreaudio/device_interfaces/audio_clock_adjustment.h"
+#include "coreaudio/device_interfaces/device_topology.h"
 #include "coreaudio/device_interfaces/endpoint_volume.h"
 
 #endif  // WINDOWS_COREAUDIO_WRAPPER_DEVICE_INTERFACES_H_
@@ -0,0 +1,101 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_DEVICE_TOPOLOGY_H_
+#define WINDOWS_COREAUDIO_WRAPPER_DEVICE_TOPOLOGY_H_
+
+#include "devicetopology.h"
+
+#include <new>
+
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/interface_wrapper.h"
+#include "coreaudio/util/smart_pointers.h"
+#include "coreaudio/util/throw_com_error.h"
+
+namespace coreaudio {
+
+// The parts (connectors and subunits) of one device. See `topology_graph` for the whole graph behind an endpoint.
+struct device_topology : detail::interface_wrapper<IDeviceTopology> {
+private:
+    using super = detail::interface_wrapper<IDeviceTopology>;
+public:
+    constexpr device_topology() noexcept = default;
+
+    explicit device_topology(raw_interface* ptr) noexcept : super(ptr) {}
+
+    device_topology(device_topology&&) noexcept = default;
+    device_topology& operator=(device_topology&&) noexcept = default;
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    UINT get_connector_count() const {
+        UINT result = 0;
+        throw_com_error(observe("GetConnectorCount", [&] { return value->GetConnectorCount(&result); }));
+        return result;
+    }
+#endif
+    h_optional<UINT> get_connector_count(std::nothrow_t) const noexcept {
+        if (!value) return { E_INVALIDARG, 0 };
+        UINT result = 0;
+        HRESULT status = observe("GetConnectorCount", [&] { return value.get()->GetConnectorCount(&result); });
+        return { status, result };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    com_pointer<IConnector> get_connector(UINT i) const {
+        com_pointer<IConnector> result;
+        throw_com_error(observe("GetConnector", [&] { return value->GetConnector(i, &result.get_for_overwrite()); }));
+        return result;
+    }
+#endif
+    h_optional<com_pointer<IConnector>> get_connector(std::nothrow_t, UINT i) const noexcept {
+        if (!value) return { E_INVALIDARG, nullptr };
+        com_pointer<IConnector> result;
+        HRESULT status = observe("GetConnector", [&] { return value.get()->GetConnector(i, &result.get_for_overwrite()); });
+        return { status, static_cast<com_pointer<IConnector>&&>(result) };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    UINT get_subunit_count() const {
+        UINT result = 0;
+        throw_com_error(observe("GetSubunitCount", [&] { return value->GetSubunitCount(&result); }));
+        return result;
+    }
+#endif
+    h_optional<UINT> get_subunit_count(std::nothrow_t) const noexcept {
+        if (!value) return { E_INVALIDARG, 0 };
+        UINT result = 0;
+        HRESULT status = observe("GetSubunitCount", [&] { return value.get()->GetSubunitCount(&result); });
+        return { status, result };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    com_pointer<ISubunit> get_subunit(UINT i) const {
+        com_pointer<ISubunit> result;
+        throw_com_error(observe("GetSubunit", [&] { return value->GetSubunit(i, &result.get_for_overwrite()); }));
+        return result;
+    }
+#endif
+    h_optional<com_pointer<ISubunit>> get_subunit(std::nothrow_t, UINT i) const noexcept {
+        if (!value) return { E_INVALIDARG, nullptr };
+        com_pointer<ISubunit> result;
+        HRESULT status = observe("GetSubunit", [&] { return value.get()->GetSubunit(i, &result.get_for_overwrite()); });
+        return { status, static_cast<com_pointer<ISubunit>&&>(result) };
+    }
+
+    // The ID of the device (not necessarily an endpoint: adapter devices have topologies too)
+#ifndef COREAUDIO_NOEXCEPTIONS
+    task_memory_pointer<WCHAR> get_device_id() const {
+        LPWSTR x;
+        throw_com_error(observe("GetDeviceId", [&] { return value->GetDeviceId(&x); }));
+        return task_memory_pointer<WCHAR>(x);
+    }
+#endif
+    h_optional<task_memory_pointer<WCHAR>> get_device_id(std::nothrow_t) const noexcept {
+        if (!value) return { E_INVALIDARG, nullptr };
+        LPWSTR x = nullptr;
+        HRESULT status = observe("GetDeviceId", [&] { return value.get()->GetDeviceId(&x); });
+        return { status, task_memory_pointer<WCHAR>(x) };
+    }
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_DEVICE_TOPOLOGY_H_
@@ -0,0 +1,260 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_DEVICE_NAME_INDEX_H_
+#define WINDOWS_COREAUDIO_WRAPPER_DEVICE_NAME_INDEX_H_
+
+#include "windows.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cwchar>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "coreaudio/device_snapshot.h"
+
+
+namespace coreaudio {
+
+namespace detail {
+
+// Lowercases `s` in place: ASCII inline, anything else through `CharLowerBuffW` (length-preserving)
+inline void fold_case(WCHAR* s, std::size_t n) noexcept {
+    bool ascii = true;
+    for (std::size_t i = 0; i < n; ++i) {
+        if (s[i] >= L'A' && s[i] <= L'Z') s[i] = static_cast<WCHAR>(s[i] + (L'a' - L'A'));
+        else if (s[i] >= 0x80) ascii = false;
+    }
+    if (!ascii) CharLowerBuffW(s, static_cast<DWORD>(n));
+}
+
+}
+
+/**
+ * Type-to-filter search over endpoint friendly names, answering case-insensitive prefix and substring queries
+ * without touching the devices.
+ *
+ * The lowercased names are kept NUL-separated in one buffer, with a map from each trigram (three consecutive
+ * characters) to the entries whose name contains it. A query of three or more characters only verifies the entries
+ * of its rarest trigram; shorter ones scan the buffer.
+ *
+ * Keep it current from `IMMNotificationClient`: `update` with a fresh `device_snapshot_entry` on
+ * `OnDeviceAdded` and on `OnPropertyValueChanged` for `PKEY_Device_FriendlyName`, `remove` on `OnDeviceRemoved`.
+ * Removed and renamed entries leave garbage behind, which is compacted away once it outweighs the live entries.
+ *
+ * Not thread-safe. Indices returned by the queries are valid until the next `assign`, `update` or `remove`.
+ */
+struct device_name_index {
+    device_name_index() = default;
+
+    // Throws whatever the standard containers throw
+    explicit device_name_index(const device_snapshot& snapshot) {
+        assign(snapshot);
+    }
+
+    // Replaces the contents with the entries of `snapshot`. Throws whatever the standard containers throw.
+    void assign(const device_snapshot& snapshot) {
+        clear();
+        records.reserve(snapshot.entries.size());
+        for (const device_snapshot_entry& e : snapshot.entries) update(e.id, e.friendly_name);
+    }
+
+    void clear() noexcept {
+        records.clear();
+        folded.clear();
+        trigrams.clear();
+        by_id.clear();
+        dead = 0;
+    }
+
+    /**
+     * Adds the device `id` named `name`, or renames it (which moves it after the other entries). Returns false if it
+     * already had that name. Throws whatever the standard containers throw, leaving the index as it was.
+     */
+    bool update(const std::wstring& id, const std::wstring& name) {
+        std::unordered_map<std::wstring, std::uint32_t>::iterator existing = by_id.find(id);
+        std::uint32_t slot = static_cast<std::uint32_t>(records.size());
+        if (existing == by_id.end()) {
+            existing = by_id.emplace(id, slot).first;
+            try {
+                append(id, name);
+            } catch (...) {
+                by_id.erase(existing);
+                throw;
+            }
+        } else {
+            if (records[existing->second].name == name) return false;
+            // The old entry is only dropped once the new one is in
+            append(id, name);
+            kill(existing->second);
+            existing->second = slot;
+        }
+        if (dead > 32 && dead > records.size() - dead) compact();
+        return true;
+    }
+    bool update(const device_snapshot_entry& e) {
+        return update(e.id, e.friendly_name);
+    }
+
+    // Returns false if there was no device `id`
+    bool remove(const std::wstring& id) {
+        std::unordered_map<std::wstring, std::uint32_t>::iterator existing = by_id.find(id);
+        if (existing == by_id.end()) return false;
+        kill(existing->second);
+        by_id.erase(existing);
+        if (dead > 32 && dead > records.size() - dead) compact();
+        return true;
+    }
+
+    /**
+     * Indices of the entries whose name starts with `query` (ignoring case), in the order they were added or last
+     * renamed, written over `out` so that its capacity is reused. Returns how many there are.
+     * Throws whatever `std::vector` throws.
+     */
+    std::size_t find_prefix(LPCWSTR query, std::vector<std::size_t>& out) const {
+        return find(query, true, out);
+    }
+
+    // Like `find_prefix`, for names containing `query` anywhere
+    std::size_t find_substring(LPCWSTR query, std::vector<std::size_t>& out) const {
+        return find(query, false, out);
+    }
+
+    const std::wstring& id(std::size_t i) const noexcept {
+        return records[i].id;
+    }
+    const std::wstring& name(std::size_t i) const noexcept {
+        return records[i].name;
+    }
+    // Index of the entry for device `id`, or `npos`
+    std::size_t find_id(const std::wstring& id) const noexcept {
+        std::unordered_map<std::wstring, std::uint32_t>::const_iterator existing = by_id.find(id);
+        return existing == by_id.end() ? npos : existing->second;
+    }
+    // Number of devices
+    std::size_t size() const noexcept {
+        return by_id.size();
+    }
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+private:
+    struct record {
+        std::wstring id;
+        std::wstring name;
+        std::uint32_t offset;  // Of the folded name in `folded`
+        std::uint32_t length;
+        bool live;
+    };
+
+    static std::uint64_t trigram(const WCHAR* s) noexcept {
+        return (static_cast<std::uint64_t>(s[0] & 0xFFFF) << 32) | (static_cast<std::uint64_t>(s[1] & 0xFFFF) << 16) |
+            static_cast<std::uint64_t>(s[2] & 0xFFFF);
+    }
+
+    // Adds a live entry. If it throws, nothing was added.
+    void append(const std::wstring& id, const std::wstring& name) {
+        std::uint32_t slot = static_cast<std::uint32_t>(records.size());
+        std::uint32_t offset = static_cast<std::uint32_t>(folded.size());
+        records.reserve(records.size() + 1);
+        folded.reserve(folded.size() + name.size() + 1);
+        record r{ id, name, offset, static_cast<std::uint32_t>(name.size()), true };
+        folded.insert(folded.end(), name.begin(), name.end());
+        folded.push_back(0);
+        WCHAR* text = folded.data() + offset;
+        detail::fold_case(text, name.size());
+        std::size_t i = 0;
+        try {
+            for (; i + 3 <= name.size(); ++i) {
+                std::vector<std::uint32_t>& postings = trigrams[trigram(text + i)];
+                // Slots only grow, so the lists stay sorted; a trigram repeated within the name is listed once
+                if (postings.empty() || postings.back() != slot) postings.push_back(slot);
+            }
+        } catch (...) {
+            for (std::size_t j = 0; j < i; ++j) {
+                std::vector<std::uint32_t>& postings = trigrams[trigram(text + j)];
+                if (!postings.empty() && postings.back() == slot) postings.pop_back();
+            }
+            folded.resize(offset);
+            throw;
+        }
+        records.push_back(static_cast<record&&>(r));
+    }
+
+    void kill(std::uint32_t slot) noexcept {
+        records[slot].live = false;
+        ++dead;
+    }
+
+    // Rebuilds everything from the live entries, which renumbers them
+    void compact() {
+        std::vector<record> old;
+        old.swap(records);
+        folded.clear();
+        trigrams.clear();
+        by_id.clear();
+        dead = 0;
+        for (const record& r : old) {
+            if (!r.live) continue;
+            by_id[r.id] = static_cast<std::uint32_t>(records.size());
+            append(r.id, r.name);
+        }
+    }
+
+    bool matches(const record& r, const WCHAR* q, std::size_t length, bool prefix) const noexcept {
+        if (!r.live || r.length < length) return false;
+        const WCHAR* text = folded.data() + r.offset;
+        if (prefix) return std::wmemcmp(text, q, length) == 0;
+        return std::wcsstr(text, q) != nullptr;
+    }
+
+    std::size_t find(LPCWSTR query, bool prefix, std::vector<std::size_t>& out) const {
+        out.clear();
+        std::size_t length = query ? std::wcslen(query) : 0;
+        if (length == 0) {
+            for (std::size_t i = 0; i < records.size(); ++i) {
+                if (records[i].live) out.push_back(i);
+            }
+            return out.size();
+        }
+
+        // Folded on the stack unless it is unusually long
+        WCHAR small[128];
+        std::wstring large;
+        WCHAR* q = small;
+        if (length >= sizeof(small) / sizeof(small[0])) {
+            large.assign(query, length);
+            q = &large[0];
+        } else {
+            std::wmemcpy(small, query, length + 1);
+        }
+        detail::fold_case(q, length);
+
+        if (length < 3) {
+            for (std::size_t i = 0; i < records.size(); ++i) {
+                if (matches(records[i], q, length, prefix)) out.push_back(i);
+            }
+            return out.size();
+        }
+
+        // Every trigram of the query is in every match, so the rarest one's list holds all of them
+        const std::vector<std::uint32_t>* candidates = nullptr;
+        for (std::size_t i = 0; i + 3 <= length; ++i) {
+            std::unordered_map<std::uint64_t, std::vector<std::uint32_t>>::const_iterator postings = trigrams.find(trigram(q + i));
+            if (postings == trigrams.end()) return 0;
+            if (!candidates || postings->second.size() < candidates->size()) candidates = &postings->second;
+        }
+        for (std::uint32_t slot : *candidates) {
+            if (matches(records[slot], q, length, prefix)) out.push_back(slot);
+        }
+        return out.size();
+    }
+
+    std::vector<record> records;
+    std::vector<WCHAR> folded;
+    std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> trigrams;
+    std::unordered_map<std::wstring, std::uint32_t> by_id;
+    std::size_t dead = 0;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_DEVICE_NAME_INDEX_H_
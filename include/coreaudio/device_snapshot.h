@@ -0,0 +1,155 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_DEVICE_SNAPSHOT_H_
+#define WINDOWS_COREAUDIO_WRAPPER_DEVICE_SNAPSHOT_H_
+
+#include "windows.h"
+#include "functiondiscoverykeys_devpkey.h"
+#include "mmdeviceapi.h"
+#include "mmreg.h"
+#include "propidl.h"
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "coreaudio/device.h"
+#include "coreaudio/device_collection.h"
+#include "coreaudio/device_enumerator.h"
+#include "coreaudio/util/call_observer.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/smart_pointers.h"
+#include "coreaudio/util/wave_format.h"
+
+
+namespace coreaudio {
+
+/**
+ * What a device list UI needs to know about an endpoint, read once so it can be drawn (or cached to disk, see
+ * `device_cache`) without going back to the device.
+ */
+struct device_snapshot_entry {
+    std::wstring id;
+    std::wstring friendly_name;  // `PKEY_Device_FriendlyName`, empty if unknown
+    DWORD state = 0;
+    EDataFlow data_flow = eAll;  // eAll if unknown
+    UINT32 form_factor = UnknownFormFactor;  // `PKEY_AudioEndpoint_FormFactor`, an `EndpointFormFactor`
+    std::vector<BYTE> device_format;  // `PKEY_AudioEngine_DeviceFormat` (see `copy_wave_format`), empty if unknown
+    float volume = -1;  // Master volume scalar, negative if unknown (the endpoint volume is only read when active)
+    bool muted = false;
+
+    const WAVEFORMATEX* format() const noexcept {
+        return device_format.size() >= sizeof(WAVEFORMATEX) ? reinterpret_cast<const WAVEFORMATEX*>(device_format.data()) : nullptr;
+    }
+    bool has_volume() const noexcept {
+        return volume >= 0;
+    }
+
+    /**
+     * Reads everything about `d`. Only failing to get the ID or state fails; any property that can't be read is left
+     * at its default. Throws whatever `std::wstring` and `std::vector` throw.
+     */
+    static h_optional<device_snapshot_entry> read(const device& d) {
+        device_snapshot_entry result;
+        h_optional<task_memory_pointer<WCHAR>> id = d.id(std::nothrow);
+        if (!id) return { id.get_status(), static_cast<device_snapshot_entry&&>(result) };
+        result.id = id.get_unchecked().get();
+        h_optional<DWORD> state = d.state(std::nothrow);
+        if (!state) return { state.get_status(), static_cast<device_snapshot_entry&&>(result) };
+        result.state = state.get_unchecked();
+
+        h_optional<EDataFlow> flow = d.data_flow(std::nothrow);
+        if (flow) result.data_flow = flow.get_unchecked();
+
+        h_optional<com_pointer<IPropertyStore>> store = d.open_property_store(std::nothrow, STGM_READ);
+        if (store) {
+            IPropertyStore* s = store.get_unchecked().get();
+            PROPVARIANT v;
+            PropVariantInit(&v);
+            auto get_value = [s, &v](const PROPERTYKEY& key) noexcept {
+                return detail::observe_call<default_call_observer>(s, "GetValue", [&] { return s->GetValue(key, &v); });
+            };
+            if (SUCCEEDED(get_value(PKEY_Device_FriendlyName)) && v.vt == VT_LPWSTR && v.pwszVal) result.friendly_name = v.pwszVal;
+            PropVariantClear(&v);
+            if (SUCCEEDED(get_value(PKEY_AudioEndpoint_FormFactor)) && v.vt == VT_UI4) result.form_factor = v.ulVal;
+            PropVariantClear(&v);
+            // Only a blob that holds all of the format its `cbSize` claims
+            if (SUCCEEDED(get_value(PKEY_AudioEngine_DeviceFormat)) && v.vt == VT_BLOB && wave_format_size(v.blob.pBlobData, v.blob.cbSize) != 0) {
+                copy_wave_format(reinterpret_cast<const WAVEFORMATEX*>(v.blob.pBlobData), result.device_format);
+            }
+            PropVariantClear(&v);
+        }
+
+        if (result.state == DEVICE_STATE_ACTIVE) {
+            h_optional<endpoint_volume> volume = d.activate_endpoint_volume(std::nothrow);
+            if (volume) {
+                h_optional<float> level = volume.get_unchecked().get_master_volume_level_scalar(std::nothrow);
+                h_optional<bool> muted = volume.get_unchecked().is_muted(std::nothrow);
+                if (level && muted) {
+                    result.volume = level.get_unchecked();
+                    result.muted = muted.get_unchecked();
+                }
+            }
+        }
+        return { S_OK, static_cast<device_snapshot_entry&&>(result) };
+    }
+};
+
+inline bool operator==(const device_snapshot_entry& a, const device_snapshot_entry& b) noexcept {
+    return a.id == b.id && a.friendly_name == b.friendly_name && a.state == b.state && a.data_flow == b.data_flow &&
+        a.form_factor == b.form_factor && a.device_format == b.device_format && a.volume == b.volume && a.muted == b.muted;
+}
+inline bool operator!=(const device_snapshot_entry& a, const device_snapshot_entry& b) noexcept {
+    return !(a == b);
+}
+
+// An endpoint that `device_snapshot::take` enumerated but couldn't read
+struct device_snapshot_failure {
+    std::wstring id;  // Empty if the ID itself couldn't be read
+    HRESULT status;
+};
+
+struct device_snapshot {
+    std::vector<device_snapshot_entry> entries;
+    // Endpoints left out of `entries` because they failed to give their ID or state. That may be transient (e.g. while
+    // the audio service restarts), so they shouldn't be taken as removed.
+    std::vector<device_snapshot_failure> failures;
+
+    /**
+     * Reads every endpoint in `state_mask`. Devices that disappear while being read (or otherwise fail to give
+     * their ID or state) go to `failures` instead. Throws whatever `std::wstring` and `std::vector` throw.
+     */
+    static h_optional<device_snapshot> take(const device_enumerator& e, EDataFlow data_flow = eAll, DWORD state_mask = DEVICE_STATEMASK_ALL) {
+        device_snapshot result;
+        h_optional<device_collection> collection = e.enum_audio_endpoints(std::nothrow, data_flow, state_mask);
+        if (!collection) return { collection.get_status(), static_cast<device_snapshot&&>(result) };
+        const device_collection& c = collection.get_unchecked();
+        result.entries.reserve(c.size());
+        for (std::size_t i = 0; i < c.size(); ++i) {
+            h_optional<device> d = c.at(std::nothrow, i);
+            if (!d) {
+                result.failures.push_back({ std::wstring(), d.get_status() });
+                continue;
+            }
+            h_optional<device_snapshot_entry> entry = device_snapshot_entry::read(d.get_unchecked());
+            if (entry) {
+                result.entries.push_back(static_cast<device_snapshot_entry&&>(entry.get_unchecked()));
+            } else {
+                result.failures.push_back({ static_cast<std::wstring&&>(entry.get_unchecked().id), entry.get_status() });
+            }
+        }
+        return { S_OK, static_cast<device_snapshot&&>(result) };
+    }
+
+    // nullptr if there is no entry with ID `id`
+    const device_snapshot_entry* find(LPCWSTR id) const noexcept {
+        for (const device_snapshot_entry& entry : entries) {
+            if (entry.id == id) return &entry;
+        }
+        return nullptr;
+    }
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_DEVICE_SNAPSHOT_H_
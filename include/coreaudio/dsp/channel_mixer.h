@@ -0,0 +1,415 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_CHANNEL_MIXER_H_
+#define WINDOWS_COREAUDIO_WRAPPER_CHANNEL_MIXER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "coreaudio/dsp/simd.h"
+
+
+namespace coreaudio {
+namespace dsp {
+
+// The `SPEAKER_*` bits of `WAVEFORMATEXTENSIBLE::dwChannelMask` (ksmedia.h). Channels are interleaved in bit order.
+namespace speaker {
+enum : std::uint32_t {
+    front_left = 0x1,
+    front_right = 0x2,
+    front_center = 0x4,
+    low_frequency = 0x8,
+    back_left = 0x10,
+    back_right = 0x20,
+    front_left_of_center = 0x40,
+    front_right_of_center = 0x80,
+    back_center = 0x100,
+    side_left = 0x200,
+    side_right = 0x400,
+    top_center = 0x800,
+    top_front_left = 0x1000,
+    top_front_center = 0x2000,
+    top_front_right = 0x4000,
+    top_back_left = 0x8000,
+    top_back_center = 0x10000,
+    top_back_right = 0x20000,
+    all = 0x3FFFF,
+
+    mono = front_center,
+    stereo = front_left | front_right,
+    quad = front_left | front_right | back_left | back_right,
+    surround_5_1 = front_left | front_right | front_center | low_frequency | side_left | side_right,
+    surround_7_1 = surround_5_1 | back_left | back_right,
+    surround_7_1_4 = surround_7_1 | top_front_left | top_front_right | top_back_left | top_back_right,
+};
+}
+
+inline unsigned channel_count(std::uint32_t mask) noexcept {
+    unsigned count = 0;
+    for (; mask; mask &= mask - 1) ++count;
+    return count;
+}
+
+// Index of `speaker_bit` in a frame with channel mask `mask`, or -1 if it isn't in the mask
+inline int channel_index(std::uint32_t mask, std::uint32_t speaker_bit) noexcept {
+    if (!(mask & speaker_bit)) return -1;
+    return static_cast<int>(channel_count(mask & (speaker_bit - 1)));
+}
+
+struct downmix_options {
+    // Gain used when folding a speaker into a neighbouring pair or a center (-3 dB)
+    float fold_gain = 0.70710678f;
+    // LFE is dropped when the output has no LFE channel unless this is nonzero
+    float lfe_gain = 0.0f;
+    // Scale rows whose gains sum to more than 1 so a full-scale input can't clip
+    bool normalize = true;
+};
+
+/**
+ * Gains from each input channel to each output channel, stored row-major (`outputs` rows of `inputs` gains).
+ *
+ * `make` routes every input speaker that isn't in the output to the nearest output speakers (e.g. center to left
+ * and right at -3 dB, side to back to front, top to the ear-level speaker below it). Output speakers that aren't
+ * in the input are left silent (no upmixing beyond mono to stereo). Entries can be overridden afterwards.
+ */
+struct mix_matrix {
+    std::uint32_t input_mask = 0;
+    std::uint32_t output_mask = 0;
+    unsigned inputs = 0;
+    unsigned outputs = 0;
+    std::vector<float> gains;
+
+    // Throws whatever `std::vector` throws (usually `std::bad_alloc`)
+    static mix_matrix make(std::uint32_t input_mask, std::uint32_t output_mask, const downmix_options& options = {}) {
+        mix_matrix m;
+        m.input_mask = input_mask & speaker::all;
+        m.output_mask = output_mask & speaker::all;
+        m.inputs = channel_count(m.input_mask);
+        m.outputs = channel_count(m.output_mask);
+        m.gains.assign(static_cast<std::size_t>(m.inputs) * m.outputs, 0.0f);
+        for (std::uint32_t in = 1; in <= speaker::all; in <<= 1) {
+            if (m.input_mask & in) m.route(channel_index(m.input_mask, in), in, 1.0f, options, 0);
+        }
+        if (options.normalize) m.normalize();
+        return m;
+    }
+
+    float get(unsigned out, unsigned in) const noexcept {
+        return gains[static_cast<std::size_t>(out) * inputs + in];
+    }
+    void set(unsigned out, unsigned in, float gain) noexcept {
+        gains[static_cast<std::size_t>(out) * inputs + in] = gain;
+    }
+    // Overrides the gain between two speakers. Returns false if either isn't in its mask.
+    bool set_speakers(std::uint32_t out_speaker, std::uint32_t in_speaker, float gain) noexcept {
+        int out = channel_index(output_mask, out_speaker);
+        int in = channel_index(input_mask, in_speaker);
+        if (out < 0 || in < 0) return false;
+        set(static_cast<unsigned>(out), static_cast<unsigned>(in), gain);
+        return true;
+    }
+
+    // Scales every row whose gains sum to more than 1 down to 1
+    void normalize() noexcept {
+        for (unsigned o = 0; o < outputs; ++o) {
+            float sum = 0;
+            for (unsigned i = 0; i < inputs; ++i) sum += std::abs(get(o, i));
+            if (sum > 1.0f) {
+                for (unsigned i = 0; i < inputs; ++i) set(o, i, get(o, i) / sum);
+            }
+        }
+    }
+private:
+    struct fallback {
+        std::uint32_t targets;  // One or two speakers, each getting the full gain
+        bool fold;  // Whether the gain is `fold_gain` (else 1)
+    };
+
+    // Where each speaker goes when it isn't in the output, in order of preference
+    static const fallback* fallbacks(std::uint32_t s, std::size_t& count) noexcept {
+        using namespace speaker;
+        static const fallback fl[] = { { front_center, true } };
+        static const fallback fr[] = { { front_center, true } };
+        static const fallback fc[] = { { front_left | front_right, true } };
+        static const fallback bl[] = { { side_left, false }, { front_left, true } };
+        static const fallback br[] = { { side_right, false }, { front_right, true } };
+        static const fallback sl[] = { { back_left, false }, { front_left, true } };
+        static const fallback sr[] = { { back_right, false }, { front_right, true } };
+        static const fallback flc[] = { { front_left, false }, { front_center, true } };
+        static const fallback frc[] = { { front_right, false }, { front_center, true } };
+        static const fallback bc[] = { { back_left | back_right, true }, { side_left | side_right, true }, { front_left | front_right, true } };
+        static const fallback tc[] = { { front_left | front_right, true } };
+        static const fallback tfl[] = { { front_left, true } };
+        static const fallback tfc[] = { { front_center, true } };
+        static const fallback tfr[] = { { front_right, true } };
+        static const fallback tbl[] = { { back_left, true }, { side_left, true } };
+        static const fallback tbc[] = { { back_center, true } };
+        static const fallback tbr[] = { { back_right, true }, { side_right, true } };
+#define COREAUDIO_FALLBACK(bit, table) case bit: count = sizeof(table) / sizeof(table[0]); return table;
+        switch (s) {
+            COREAUDIO_FALLBACK(front_left, fl)
+            COREAUDIO_FALLBACK(front_right, fr)
+            COREAUDIO_FALLBACK(front_center, fc)
+            COREAUDIO_FALLBACK(back_left, bl)
+            COREAUDIO_FALLBACK(back_right, br)
+            COREAUDIO_FALLBACK(side_left, sl)
+            COREAUDIO_FALLBACK(side_right, sr)
+            COREAUDIO_FALLBACK(front_left_of_center, flc)
+            COREAUDIO_FALLBACK(front_right_of_center, frc)
+            COREAUDIO_FALLBACK(back_center, bc)
+            COREAUDIO_FALLBACK(top_center, tc)
+            COREAUDIO_FALLBACK(top_front_left, tfl)
+            COREAUDIO_FALLBACK(top_front_center, tfc)
+            COREAUDIO_FALLBACK(top_front_right, tfr)
+            COREAUDIO_FALLBACK(top_back_left, tbl)
+            COREAUDIO_FALLBACK(top_back_center, tbc)
+            COREAUDIO_FALLBACK(top_back_right, tbr)
+            default: count = 0; return nullptr;
+        }
+#undef COREAUDIO_FALLBACK
+    }
+
+    // Whether `s` reaches any output speaker through the fallbacks
+    bool routable(std::uint32_t s, int depth) const noexcept {
+        if (output_mask & s) return true;
+        if (depth > 4) return false;
+        std::size_t count;
+        const fallback* f = fallbacks(s, count);
+        for (std::size_t k = 0; k < count; ++k) {
+            bool all = true;
+            for (std::uint32_t t = f[k].targets; t; t &= t - 1) all = all && routable(t & (~t + 1), depth + 1);
+            if (all) return true;
+        }
+        return false;
+    }
+
+    void route(int in, std::uint32_t s, float gain, const downmix_options& options, int depth) noexcept {
+        if (output_mask & s) {
+            gains[static_cast<std::size_t>(channel_index(output_mask, s)) * inputs + static_cast<unsigned>(in)] += gain;
+            return;
+        }
+        if (s == speaker::low_frequency) {
+            if (options.lfe_gain == 0.0f) return;
+            if (output_mask & speaker::front_center) {
+                route(in, speaker::front_center, gain * options.lfe_gain, options, depth + 1);
+            } else {
+                route(in, speaker::front_left, gain * options.lfe_gain, options, depth + 1);
+                route(in, speaker::front_right, gain * options.lfe_gain, options, depth + 1);
+            }
+            return;
+        }
+        if (depth > 4) return;
+        std::size_t count;
+        const fallback* f = fallbacks(s, count);
+        for (std::size_t k = 0; k < count; ++k) {
+            bool all = true;
+            for (std::uint32_t t = f[k].targets; t; t &= t - 1) all = all && routable(t & (~t + 1), depth + 1);
+            if (!all) continue;
+            float g = gain * (f[k].fold ? options.fold_gain : 1.0f);
+            for (std::uint32_t t = f[k].targets; t; t &= t - 1) route(in, t & (~t + 1), g, options, depth + 1);
+            return;
+        }
+    }
+};
+
+/**
+ * Applies a `mix_matrix` to blocks of float frames, interleaved or planar. The kernel is chosen in `setup`:
+ * a copy for identical layouts, SIMD kernels for 5.1/7.1 to stereo and for planar buffers, unrolled kernels
+ * for other common channel count pairs, and a general kernel for everything else.
+ *
+ * Never allocates after `setup`. The matrix can be changed with `update_gains` as long as the masks stay the same.
+ */
+struct channel_mixer {
+    enum class kernel { copy, generic, fixed, downmix_to_stereo_simd };
+
+    // Throws whatever `std::vector` throws (usually `std::bad_alloc`)
+    void setup(const mix_matrix& m) {
+        matrix = m;
+        select_kernel();
+    }
+    void update_gains(const std::vector<float>& gains) noexcept {
+        std::copy(gains.begin(), gains.begin() + (std::min)(gains.size(), matrix.gains.size()), matrix.gains.begin());
+        select_kernel();
+    }
+
+    // `in` has `frames * inputs` floats, `out` has `frames * outputs` floats
+    void process_interleaved(const float* in, float* out, std::size_t frames) const noexcept {
+        interleaved(matrix, in, out, frames);
+    }
+
+    // `in[i]` and `out[o]` each have `frames` floats
+    void process_planar(const float* const* in, float* const* out, std::size_t frames) const noexcept {
+        for (unsigned o = 0; o < matrix.outputs; ++o) {
+            float* y = out[o];
+            bool written = false;
+            for (unsigned i = 0; i < matrix.inputs; ++i) {
+                float g = matrix.get(o, i);
+                if (g == 0.0f) continue;
+                if (written) {
+                    axpy(y, in[i], g, frames);
+                } else {
+                    scale(y, in[i], g, frames);
+                    written = true;
+                }
+            }
+            if (!written) std::memset(y, 0, frames * sizeof(float));
+        }
+    }
+
+    kernel selected_kernel() const noexcept {
+        return selected;
+    }
+    const mix_matrix& get_matrix() const noexcept {
+        return matrix;
+    }
+private:
+    using interleaved_kernel = void (*)(const mix_matrix&, const float*, float*, std::size_t);
+
+    void select_kernel() noexcept {
+        selected = kernel::generic;
+        interleaved = &generic_interleaved;
+        bool identity = matrix.input_mask == matrix.output_mask;
+        for (unsigned o = 0; identity && o < matrix.outputs; ++o) {
+            for (unsigned i = 0; i < matrix.inputs; ++i) identity = identity && matrix.get(o, i) == (o == i ? 1.0f : 0.0f);
+        }
+        if (identity) {
+            selected = kernel::copy;
+            interleaved = &copy_interleaved;
+            return;
+        }
+#if defined(COREAUDIO_SIMD_SSE2) || defined(COREAUDIO_SIMD_AVX)
+        if (matrix.outputs == 2 && matrix.inputs == 8) {
+            selected = kernel::downmix_to_stereo_simd;
+            interleaved = &to_stereo_interleaved<8>;
+            return;
+        }
+        if (matrix.outputs == 2 && matrix.inputs == 6) {
+            selected = kernel::downmix_to_stereo_simd;
+            interleaved = &to_stereo_interleaved<6>;
+            return;
+        }
+        if (matrix.outputs == 2 && matrix.inputs == 12) {
+            selected = kernel::downmix_to_stereo_simd;
+            interleaved = &to_stereo_interleaved<12>;
+            return;
+        }
+#endif
+        interleaved_kernel fixed = nullptr;
+        switch (matrix.inputs * 32 + matrix.outputs) {
+            case 1 * 32 + 2: fixed = &fixed_interleaved<1, 2>; break;
+            case 2 * 32 + 1: fixed = &fixed_interleaved<2, 1>; break;
+            case 2 * 32 + 6: fixed = &fixed_interleaved<2, 6>; break;
+            case 2 * 32 + 8: fixed = &fixed_interleaved<2, 8>; break;
+            case 6 * 32 + 2: fixed = &fixed_interleaved<6, 2>; break;
+            case 8 * 32 + 2: fixed = &fixed_interleaved<8, 2>; break;
+            case 8 * 32 + 6: fixed = &fixed_interleaved<8, 6>; break;
+            default: break;
+        }
+        if (fixed) {
+            selected = kernel::fixed;
+            interleaved = fixed;
+        }
+    }
+
+    static void copy_interleaved(const mix_matrix& m, const float* in, float* out, std::size_t frames) noexcept {
+        std::memcpy(out, in, frames * m.inputs * sizeof(float));
+    }
+
+    static void generic_interleaved(const mix_matrix& m, const float* in, float* out, std::size_t frames) noexcept {
+        const float* g = m.gains.data();
+        for (std::size_t f = 0; f < frames; ++f, in += m.inputs, out += m.outputs) {
+            for (unsigned o = 0; o < m.outputs; ++o) {
+                const float* row = g + static_cast<std::size_t>(o) * m.inputs;
+                float sum = 0;
+                for (unsigned i = 0; i < m.inputs; ++i) sum += row[i] * in[i];
+                out[o] = sum;
+            }
+        }
+    }
+
+    // Channel counts known at compile time, so the compiler can unroll and keep the gains in registers
+    template<unsigned I, unsigned O>
+    static void fixed_interleaved(const mix_matrix& m, const float* in, float* out, std::size_t frames) noexcept {
+        float g[O][I];
+        for (unsigned o = 0; o < O; ++o) {
+            for (unsigned i = 0; i < I; ++i) g[o][i] = m.get(o, i);
+        }
+        for (std::size_t f = 0; f < frames; ++f, in += I, out += O) {
+            for (unsigned o = 0; o < O; ++o) {
+                float sum = 0;
+                for (unsigned i = 0; i < I; ++i) sum += g[o][i] * in[i];
+                out[o] = sum;
+            }
+        }
+    }
+
+#if defined(COREAUDIO_SIMD_SSE2) || defined(COREAUDIO_SIMD_AVX)
+    // N (a multiple of 2) channels to stereo, one frame per iteration: both output rows are multiplied with the frame
+    // four channels at a time, then the two row sums are reduced together.
+    template<unsigned N>
+    static void to_stereo_interleaved(const mix_matrix& m, const float* in, float* out, std::size_t frames) noexcept {
+        constexpr unsigned vectors = (N + 3) / 4;
+        alignas(16) float padded[2][vectors * 4] = {};
+        for (unsigned i = 0; i < N; ++i) {
+            padded[0][i] = m.get(0, i);
+            padded[1][i] = m.get(1, i);
+        }
+        __m128 left[vectors];
+        __m128 right[vectors];
+        for (unsigned v = 0; v < vectors; ++v) {
+            left[v] = _mm_load_ps(padded[0] + 4 * v);
+            right[v] = _mm_load_ps(padded[1] + 4 * v);
+        }
+        for (std::size_t f = 0; f < frames; ++f, in += N, out += 2) {
+            __m128 l = _mm_setzero_ps();
+            __m128 r = _mm_setzero_ps();
+            for (unsigned v = 0; v < N / 4; ++v) {
+                __m128 x = _mm_loadu_ps(in + 4 * v);
+                l = _mm_add_ps(l, _mm_mul_ps(x, left[v]));
+                r = _mm_add_ps(r, _mm_mul_ps(x, right[v]));
+            }
+            if (N % 4 != 0) {
+                // The last two channels
+                __m128 x = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(in + N - 2)));
+                l = _mm_add_ps(l, _mm_mul_ps(x, left[vectors - 1]));
+                r = _mm_add_ps(r, _mm_mul_ps(x, right[vectors - 1]));
+            }
+            // [l0 + l2, r0 + r2, l1 + l3, r1 + r3] -> [l, r, ...]
+            __m128 t = _mm_add_ps(_mm_unpacklo_ps(l, r), _mm_unpackhi_ps(l, r));
+            t = _mm_add_ps(t, _mm_movehl_ps(t, t));
+            _mm_storel_pi(reinterpret_cast<__m64*>(out), t);
+        }
+    }
+#endif
+
+    // y = g * x
+    static void scale(float* y, const float* x, float g, std::size_t n) noexcept {
+        std::size_t i = 0;
+#if defined(COREAUDIO_SIMD_SSE2) || defined(COREAUDIO_SIMD_AVX)
+        __m128 gain = _mm_set1_ps(g);
+        for (; i + 4 <= n; i += 4) _mm_storeu_ps(y + i, _mm_mul_ps(gain, _mm_loadu_ps(x + i)));
+#endif
+        for (; i < n; ++i) y[i] = g * x[i];
+    }
+
+    // y += g * x
+    static void axpy(float* y, const float* x, float g, std::size_t n) noexcept {
+        std::size_t i = 0;
+#if defined(COREAUDIO_SIMD_SSE2) || defined(COREAUDIO_SIMD_AVX)
+        __m128 gain = _mm_set1_ps(g);
+        for (; i + 4 <= n; i += 4) _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(gain, _mm_loadu_ps(x + i))));
+#endif
+        for (; i < n; ++i) y[i] += g * x[i];
+    }
+
+    mix_matrix matrix;
+    kernel selected = kernel::generic;
+    interleaved_kernel interleaved = &generic_interleaved;
+};
+
+}
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_CHANNEL_MIXER_H_
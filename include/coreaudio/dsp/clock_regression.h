@@ -0,0 +1,88 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_CLOCK_REGRESSION_H_
+#define WINDOWS_COREAUDIO_WRAPPER_CLOCK_REGRESSION_H_
+
+#include <cmath>
+#include <cstdint>
+
+
+namespace coreaudio {
+namespace dsp {
+
+/**
+ * Exponentially weighted least-squares fit of `y = y0 + rate * (x - x0)` over a stream of (x, y) samples, for
+ * relating two clocks (e.g. device frames against performance counter seconds). Each sample's weight decays by
+ * `1 - 1 / memory` per later sample, so the fit follows slow changes in rate.
+ *
+ * Kept as weighted means and co-moments about the means (West's update), so precision doesn't degrade as the
+ * clocks grow. Every query is O(1).
+ */
+struct clock_regression {
+    explicit clock_regression(double memory = 64) noexcept {
+        set_memory(memory);
+    }
+
+    // Number of samples after which a sample's weight has decayed to 1/e. At least 2.
+    void set_memory(double memory) noexcept {
+        decay = 1.0 - 1.0 / (memory < 2 ? 2 : memory);
+    }
+
+    void reset() noexcept {
+        weight = mean_x = mean_y = cxx = cxy = cyy = 0;
+        samples = 0;
+    }
+
+    void add(double x, double y) noexcept {
+        weight = weight * decay + 1.0;
+        double dx = x - mean_x;
+        double dy = y - mean_y;
+        mean_x += dx / weight;
+        mean_y += dy / weight;
+        cxx = cxx * decay + dx * (x - mean_x);
+        cxy = cxy * decay + dx * (y - mean_y);
+        cyy = cyy * decay + dy * (y - mean_y);
+        ++samples;
+    }
+
+    // Whether there are enough (distinct in x) samples for `rate` to mean anything
+    bool ready() const noexcept {
+        return samples >= 2 && cxx > 0;
+    }
+
+    // dy/dx, or 0 if not `ready()`
+    double rate() const noexcept {
+        return ready() ? cxy / cxx : 0.0;
+    }
+
+    double y_at(double x) const noexcept {
+        return mean_y + rate() * (x - mean_x);
+    }
+    double x_at(double y) const noexcept {
+        double r = rate();
+        return r != 0 ? mean_x + (y - mean_y) / r : mean_x;
+    }
+
+    // Weighted RMS distance of the samples from the fitted line, in units of y
+    double residual_rms() const noexcept {
+        if (!ready() || weight <= 0) return 0;
+        double residual = (cyy - cxy * cxy / cxx) / weight;
+        return residual > 0 ? std::sqrt(residual) : 0.0;
+    }
+
+    std::uint64_t sample_count() const noexcept {
+        return samples;
+    }
+private:
+    double decay = 0;
+    double weight = 0;
+    double mean_x = 0;
+    double mean_y = 0;
+    double cxx = 0;
+    double cxy = 0;
+    double cyy = 0;
+    std::uint64_t samples = 0;
+};
+
+}
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_CLOCK_REGRESSION_H_
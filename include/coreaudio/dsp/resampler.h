@@ -0,0 +1,242 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_RESAMPLER_H_
+#define WINDOWS_COREAUDIO_WRAPPER_RESAMPLER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "coreaudio/dsp/simd.h"
+
+
+namespace coreaudio {
+namespace dsp {
+
+/**
+ * Streaming polyphase FIR sample rate converter for interleaved float frames, for bridging between an application's
+ * rate and a device's mix format rate (instead of `AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM`).
+ *
+ * The filter is a Kaiser-windowed sinc, precomputed as `phases + 1` rows of `taps` coefficients. Each output sample
+ * linearly interpolates between the two nearest rows, so any ratio works (not just ratios of small integers), and
+ * the ratio can be nudged by `set_rate_adjustment` for clock drift compensation without recomputing the tables.
+ *
+ * All memory is allocated in `setup`; `process` never allocates.
+ *
+ * Output frame n is the input signal at input frame `n * input_rate / output_rate` (i.e. there is no time offset),
+ * but producing it needs `lookahead()` more input frames.
+ */
+struct polyphase_resampler {
+    struct process_result {
+        std::size_t consumed;  // Input frames consumed
+        std::size_t produced;  // Output frames written
+    };
+
+    polyphase_resampler() noexcept = default;
+    polyphase_resampler(polyphase_resampler&&) noexcept = default;
+    polyphase_resampler& operator=(polyphase_resampler&&) noexcept = default;
+
+    /**
+     * Allocates and computes the tables. Returns false if any argument is invalid (`phases` must be a power of 2
+     * from 2 to 65536). Throws whatever `std::vector` throws (usually `std::bad_alloc`).
+     *
+     * @param max_block_frames Input frames appended to the internal buffer at once. `process` accepts any number.
+     * @param taps Filter length in input frames. More is a sharper cutoff (less aliasing) and more latency.
+     * @param cutoff Passband edge as a fraction of the lower Nyquist frequency.
+     */
+    bool setup(
+        unsigned channels, double input_rate, double output_rate, std::size_t max_block_frames = 1024,
+        unsigned taps = 64, unsigned phases = 256, double cutoff = 0.91
+    ) {
+        if (channels == 0 || !(input_rate > 0) || !(output_rate > 0) || max_block_frames == 0 ||
+            taps < 4 || taps % 2 != 0 || phases < 2 || (phases & (phases - 1)) != 0 || phases > (1u << 16) ||
+            !(cutoff > 0 && cutoff <= 1)) {
+            return false;
+        }
+        this->channels = channels;
+        this->taps = taps;
+        padded_taps = (taps + detail::simd_width - 1) / detail::simd_width * detail::simd_width;
+        phase_bits = 0;
+        while ((1u << phase_bits) < phases) ++phase_bits;
+        base_step = input_rate / output_rate;
+        set_rate_adjustment(1.0);
+
+        compute_tables(phases, std::min(1.0, output_rate / input_rate) * cutoff * 0.5);
+
+        capacity = padded_taps + max_block_frames;
+        buffer.assign(static_cast<std::size_t>(channels) * capacity, 0.0f);
+        reset();
+        return true;
+    }
+
+    // Forgets all buffered input
+    void reset() noexcept {
+        std::fill(buffer.begin(), buffer.end(), 0.0f);
+        fill = taps / 2 - 1;
+        position = 0;
+        appended = 0;
+    }
+
+    /**
+     * Multiplies the conversion ratio (input frames per output frame) by `factor`, which is clamped to [0.99, 1.01].
+     * `factor > 1` consumes input faster (e.g. when the input clock runs fast relative to the output clock).
+     */
+    void set_rate_adjustment(double factor) noexcept {
+        adjustment = std::min(1.01, std::max(0.99, factor));
+        step = static_cast<std::uint64_t>(std::llround(base_step * adjustment * 4294967296.0));
+    }
+    double get_rate_adjustment() const noexcept {
+        return adjustment;
+    }
+
+    /**
+     * Consumes interleaved input frames and writes interleaved output frames. Stops early only if `out` is full;
+     * call again with the rest of the input (`in + consumed * channels`) after that.
+     */
+    process_result process(const float* in, std::size_t in_frames, float* out, std::size_t out_frames) noexcept {
+        process_result result{0, 0};
+        for (;;) {
+            result.produced += produce(out + result.produced * channels, out_frames - result.produced);
+            compact();
+            if (result.produced == out_frames || result.consumed == in_frames) break;
+            std::size_t n = std::min(in_frames - result.consumed, capacity - fill);
+            append(in + result.consumed * channels, n);
+            result.consumed += n;
+        }
+        return result;
+    }
+
+    // Upper bound of frames `process` produces from `in_frames` more input frames
+    std::size_t max_output_frames(std::size_t in_frames) const noexcept {
+        double buffered = static_cast<double>(fill) - static_cast<double>(position) / 4294967296.0;
+        return static_cast<std::size_t>((buffered + static_cast<double>(in_frames)) * 4294967296.0 / static_cast<double>(step)) + 1;
+    }
+
+    /**
+     * The (fractional) input frame, counted from the first frame given to `process` after `setup` or `reset`, that
+     * the next output frame is taken at. Used to measure and correct alignment against another clock.
+     */
+    double next_output_position() const noexcept {
+        return static_cast<double>(appended) - static_cast<double>(fill) + static_cast<double>(taps / 2 - 1) +
+            static_cast<double>(position) / 4294967296.0;
+    }
+
+    // Input frames needed after the time of an output frame before it can be produced
+    std::size_t lookahead() const noexcept {
+        return padded_taps - taps / 2;
+    }
+
+    unsigned get_channels() const noexcept {
+        return channels;
+    }
+private:
+    static double bessel_i0(double x) noexcept {
+        double sum = 1.0;
+        double term = 1.0;
+        for (int k = 1; k < 64; ++k) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+            if (term < sum * 1e-17) break;
+        }
+        return sum;
+    }
+
+    // `cutoff` is in cycles per input frame
+    void compute_tables(unsigned phases, double cutoff) {
+        const double pi = 3.14159265358979323846;
+        const double beta = 9.0;  // About 90 dB of stopband attenuation
+        const double half = taps / 2.0;
+        const double i0_beta = bessel_i0(beta);
+        coefficients.assign(static_cast<std::size_t>(phases + 1) * padded_taps, 0.0f);
+        deltas.assign(static_cast<std::size_t>(phases) * padded_taps, 0.0f);
+        std::vector<double> row(taps);
+        for (unsigned p = 0; p <= phases; ++p) {
+            // Row p is the filter centered at `taps / 2 - 1 + p / phases`
+            double center = half - 1.0 + static_cast<double>(p) / phases;
+            double sum = 0;
+            for (unsigned k = 0; k < taps; ++k) {
+                double x = static_cast<double>(k) - center;
+                double r = x / half;
+                double window = r * r < 1.0 ? bessel_i0(beta * std::sqrt(1.0 - r * r)) / i0_beta : 0.0;
+                double arg = 2.0 * pi * cutoff * x;
+                double sinc = x == 0.0 ? 1.0 : std::sin(arg) / arg;
+                row[k] = 2.0 * cutoff * sinc * window;
+                sum += row[k];
+            }
+            // Unity gain at DC for every phase
+            float* out = &coefficients[static_cast<std::size_t>(p) * padded_taps];
+            for (unsigned k = 0; k < taps; ++k) out[k] = static_cast<float>(row[k] / sum);
+        }
+        for (unsigned p = 0; p < phases; ++p) {
+            const float* c = &coefficients[static_cast<std::size_t>(p) * padded_taps];
+            float* d = &deltas[static_cast<std::size_t>(p) * padded_taps];
+            for (unsigned k = 0; k < padded_taps; ++k) d[k] = c[padded_taps + k] - c[k];
+        }
+    }
+
+    void append(const float* in, std::size_t n) noexcept {
+        for (unsigned c = 0; c < channels; ++c) {
+            float* to = &buffer[c * capacity + fill];
+            const float* from = in + c;
+            for (std::size_t i = 0; i < n; ++i) to[i] = from[i * channels];
+        }
+        fill += n;
+        appended += n;
+    }
+
+    std::size_t produce(float* out, std::size_t max_frames) noexcept {
+        const unsigned frac_bits = 32 - phase_bits;
+        const std::uint32_t frac_mask = (std::uint32_t(1) << frac_bits) - 1;
+        const float frac_scale = 1.0f / static_cast<float>(std::uint32_t(1) << frac_bits);
+        std::size_t produced = 0;
+        while (produced < max_frames) {
+            std::size_t i = static_cast<std::size_t>(position >> 32);
+            if (i + padded_taps > fill) break;
+            std::uint32_t frac = static_cast<std::uint32_t>(position);
+            std::size_t phase = frac >> frac_bits;
+            float a = static_cast<float>(frac & frac_mask) * frac_scale;
+            const float* c = &coefficients[phase * padded_taps];
+            const float* d = &deltas[phase * padded_taps];
+            for (unsigned ch = 0; ch < channels; ++ch) {
+                *out++ = detail::dot_interpolated(&buffer[ch * capacity + i], c, d, padded_taps, a);
+            }
+            position += step;
+            ++produced;
+        }
+        return produced;
+    }
+
+    // Drops input frames before the current position
+    void compact() noexcept {
+        std::size_t shift = static_cast<std::size_t>(position >> 32);
+        if (shift == 0) return;
+        shift = std::min(shift, fill);
+        for (unsigned c = 0; c < channels; ++c) {
+            float* b = &buffer[c * capacity];
+            std::memmove(b, b + shift, (fill - shift) * sizeof(float));
+        }
+        fill -= shift;
+        position -= static_cast<std::uint64_t>(shift) << 32;
+    }
+
+    unsigned channels = 0;
+    unsigned taps = 0;
+    unsigned padded_taps = 0;
+    unsigned phase_bits = 0;
+    double base_step = 1.0;
+    double adjustment = 1.0;
+    std::uint64_t step = std::uint64_t(1) << 32;  // Input frames per output frame, 32.32 fixed point
+    std::uint64_t position = 0;  // In `buffer`, 32.32 fixed point
+    std::size_t capacity = 0;
+    std::size_t fill = 0;
+    std::uint64_t appended = 0;  // Input frames appended since `reset`
+    std::vector<float> coefficients;
+    std::vector<float> deltas;
+    std::vector<float> buffer;  // Planar, `capacity` frames per channel
+};
+
+}
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_RESAMPLER_H_
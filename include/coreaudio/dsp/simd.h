@@ -0,0 +1,72 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_SIMD_H_
+#define WINDOWS_COREAUDIO_WRAPPER_SIMD_H_
+
+#include <cstddef>
+
+// AVX when compiled with /arch:AVX (or -mavx), otherwise SSE2 on x86/x64, otherwise scalar.
+// Define COREAUDIO_NO_SIMD to force the scalar kernels.
+#if !defined(COREAUDIO_NO_SIMD) && defined(__AVX__)
+#define COREAUDIO_SIMD_AVX 1
+#include <immintrin.h>
+#elif !defined(COREAUDIO_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define COREAUDIO_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+
+namespace coreaudio {
+namespace dsp {
+namespace detail {
+
+// Number of floats processed at once. Kernel lengths are padded to a multiple of this.
+#if defined(COREAUDIO_SIMD_AVX)
+constexpr unsigned simd_width = 8;
+#elif defined(COREAUDIO_SIMD_SSE2)
+constexpr unsigned simd_width = 4;
+#else
+constexpr unsigned simd_width = 4;
+#endif
+
+// Returns dot(x, c + a * d) for n (a multiple of `simd_width`) floats
+inline float dot_interpolated(const float* x, const float* c, const float* d, std::size_t n, float a) noexcept {
+#if defined(COREAUDIO_SIMD_AVX)
+    __m256 sum_c = _mm256_setzero_ps();
+    __m256 sum_d = _mm256_setzero_ps();
+    for (std::size_t i = 0; i < n; i += 8) {
+        __m256 v = _mm256_loadu_ps(x + i);
+        sum_c = _mm256_add_ps(sum_c, _mm256_mul_ps(v, _mm256_loadu_ps(c + i)));
+        sum_d = _mm256_add_ps(sum_d, _mm256_mul_ps(v, _mm256_loadu_ps(d + i)));
+    }
+    __m256 sum = _mm256_add_ps(sum_c, _mm256_mul_ps(sum_d, _mm256_set1_ps(a)));
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+#elif defined(COREAUDIO_SIMD_SSE2)
+    __m128 sum_c = _mm_setzero_ps();
+    __m128 sum_d = _mm_setzero_ps();
+    for (std::size_t i = 0; i < n; i += 4) {
+        __m128 v = _mm_loadu_ps(x + i);
+        sum_c = _mm_add_ps(sum_c, _mm_mul_ps(v, _mm_loadu_ps(c + i)));
+        sum_d = _mm_add_ps(sum_d, _mm_mul_ps(v, _mm_loadu_ps(d + i)));
+    }
+    __m128 s = _mm_add_ps(sum_c, _mm_mul_ps(sum_d, _mm_set1_ps(a)));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+#else
+    float sum_c = 0;
+    float sum_d = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        sum_c += x[i] * c[i];
+        sum_d += x[i] * d[i];
+    }
+    return sum_c + a * sum_d;
+#endif
+}
+
+}
+}
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_SIMD_H_
@@ -0,0 +1,399 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_EVENT_BUS_H_
+#define WINDOWS_COREAUDIO_WRAPPER_EVENT_BUS_H_
+
+#include "windows.h"
+#include "audiopolicy.h"
+#include "endpointvolume.h"
+#include "mmdeviceapi.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "coreaudio/notification_client.h"
+#include "coreaudio/util/call_observer.h"
+#include "coreaudio/util/callback_object.h"
+#include "coreaudio/util/smart_pointers.h"
+
+
+namespace coreaudio {
+
+struct device_state_event {
+    std::wstring id;
+    DWORD state;
+};
+
+struct default_device_event {
+    EDataFlow flow;
+    ERole role;
+    std::wstring id;  // Empty if there is no default anymore
+};
+
+struct property_event {
+    std::wstring id;
+    PROPERTYKEY key;
+};
+
+struct endpoint_volume_event {
+    std::wstring id;
+    float volume;  // Master volume scalar
+    bool muted;
+    std::vector<float> channel_volumes;
+    GUID event_context;
+};
+
+// What changed about an audio session; fields that didn't change keep their defaults
+struct session_event {
+    std::wstring key;  // As given to `event_bus::session_events`
+    float volume = -1;  // Negative if unchanged
+    bool muted = false;
+    int state = -1;  // An `AudioSessionState`, negative if unchanged
+    bool display_name_changed = false;
+    bool disconnected = false;
+    GUID event_context = GUID_NULL;  // Of the last volume change
+};
+
+/**
+ * The notifications an `event_bus` received since the previous batch, merged per entity: the last value wins for
+ * states, defaults, volumes and sessions, and a property is listed once however often it changed. A device added
+ * and removed again within the batch is in neither `added` nor `removed`; one removed and added again is in both
+ * (whatever was held for it is stale), so handle `removed` before `added`.
+ *
+ * Reuse one batch from tick to tick: `event_bus::poll` swaps its buffers with the bus, so neither side allocates
+ * once the buffers have grown.
+ */
+struct audio_event_batch {
+    std::vector<std::wstring> added;
+    std::vector<std::wstring> removed;
+    std::vector<device_state_event> states;
+    std::vector<default_device_event> defaults;
+    std::vector<property_event> properties;
+    std::vector<endpoint_volume_event> volumes;
+    std::vector<session_event> sessions;
+    std::size_t events = 0;  // Notifications merged into this batch
+
+    // Entries after merging
+    std::size_t size() const noexcept {
+        return added.size() + removed.size() + states.size() + defaults.size() + properties.size() + volumes.size() + sessions.size();
+    }
+    bool empty() const noexcept {
+        return events == 0;
+    }
+    // Notifications that didn't need an entry of their own
+    std::size_t folded() const noexcept {
+        return events - size();
+    }
+
+    // Keeps the capacity
+    void clear() noexcept {
+        added.clear();
+        removed.clear();
+        states.clear();
+        defaults.clear();
+        properties.clear();
+        volumes.clear();
+        sessions.clear();
+        events = 0;
+    }
+};
+
+struct event_bus_stats {
+    std::uint64_t events;  // Notifications received
+    std::uint64_t delivered;  // Entries handed out in batches
+    std::uint64_t batches;
+
+    std::uint64_t folded() const noexcept {
+        return events - delivered;
+    }
+};
+
+namespace detail {
+
+// The pending batch, shared by the bus and its callback objects (which COM may still call after the bus is gone)
+struct event_bus_core {
+    struct presence {
+        std::wstring id;
+        bool first_added;
+        bool added;
+    };
+
+    struct property_key_hash {
+        std::size_t operator()(const std::pair<std::wstring, PROPERTYKEY>& k) const noexcept {
+            std::size_t h = std::hash<std::wstring>()(k.first);
+            return h ^ (static_cast<std::size_t>(k.second.fmtid.Data1) * 31 + k.second.pid);
+        }
+    };
+    struct property_key_equal {
+        bool operator()(const std::pair<std::wstring, PROPERTYKEY>& l, const std::pair<std::wstring, PROPERTYKEY>& r) const noexcept {
+            return l.second.pid == r.second.pid && std::memcmp(&l.second.fmtid, &r.second.fmtid, sizeof(GUID)) == 0 && l.first == r.first;
+        }
+    };
+
+    explicit event_bus_core(std::function<void()> on_pending) : on_pending(static_cast<std::function<void()>&&>(on_pending)) {
+        clear_indices();
+    }
+
+    // Counts a notification of `kind`, calls `f(pending)` under the lock, then `on_pending` if that made the batch
+    // non-empty
+    template<typename F>
+    void record(const char* kind, F&& f) noexcept {
+        count_event(kind);
+        bool first;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            first = pending.events == 0;
+            // A notification that can't be recorded (out of memory) is dropped rather than thrown into COM
+            try {
+                f();
+            } catch (const std::bad_alloc&) {
+                count_event("notifications_dropped");
+                return;
+            }
+            ++pending.events;
+            ++events;
+        }
+        if (first && on_pending) on_pending();
+    }
+
+    void presence_changed(LPCWSTR id, bool added) {
+        std::wstring key(id ? id : L"");
+        std::unordered_map<std::wstring, std::size_t>::iterator existing = presence_index.find(key);
+        if (existing != presence_index.end()) {
+            presences[existing->second].added = added;
+            return;
+        }
+        presences.push_back({ key, added, added });
+        presence_index.emplace(static_cast<std::wstring&&>(key), presences.size() - 1);
+    }
+
+    template<typename T>
+    T& entry(std::vector<T>& entries, std::unordered_map<std::wstring, std::size_t>& index, LPCWSTR id) {
+        std::wstring key(id ? id : L"");
+        std::unordered_map<std::wstring, std::size_t>::iterator existing = index.find(key);
+        if (existing != index.end()) return entries[existing->second];
+        entries.emplace_back();
+        index.emplace(static_cast<std::wstring&&>(key), entries.size() - 1);
+        return entries.back();
+    }
+
+    void clear_indices() noexcept {
+        presences.clear();
+        presence_index.clear();
+        state_index.clear();
+        property_index.clear();
+        volume_index.clear();
+        session_index.clear();
+        for (std::size_t (&flow)[ERole_enum_count] : default_index) {
+            for (std::size_t& i : flow) i = static_cast<std::size_t>(-1);
+        }
+    }
+
+    std::mutex mutex;
+    audio_event_batch pending;
+    std::vector<presence> presences;
+    std::unordered_map<std::wstring, std::size_t> presence_index;
+    std::unordered_map<std::wstring, std::size_t> state_index;
+    std::unordered_map<std::pair<std::wstring, PROPERTYKEY>, std::size_t, property_key_hash, property_key_equal> property_index;
+    std::unordered_map<std::wstring, std::size_t> volume_index;
+    std::unordered_map<std::wstring, std::size_t> session_index;
+    std::size_t default_index[EDataFlow_enum_count][ERole_enum_count];
+    std::uint64_t events = 0;
+    std::uint64_t delivered = 0;
+    std::uint64_t batches = 0;
+    const std::function<void()> on_pending;
+};
+
+struct bus_notification_client final : notification_client {
+    explicit bus_notification_client(std::shared_ptr<event_bus_core> core) noexcept : core(static_cast<std::shared_ptr<event_bus_core>&&>(core)) {}
+
+    HRESULT STDMETHODCALLTYPE OnDeviceStateChanged(LPCWSTR id, DWORD state) override {
+        core->record("device_notifications", [&] {
+            core->entry(core->pending.states, core->state_index, id) = { id ? id : L"", state };
+        });
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR id) override {
+        core->record("device_notifications", [&] { core->presence_changed(id, true); });
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR id) override {
+        core->record("device_notifications", [&] { core->presence_changed(id, false); });
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OnDefaultDeviceChanged(EDataFlow flow, ERole role, LPCWSTR id) override {
+        if (flow < 0 || flow >= EDataFlow_enum_count || role < 0 || role >= ERole_enum_count) return S_OK;
+        core->record("device_notifications", [&] {
+            std::vector<default_device_event>& defaults = core->pending.defaults;
+            std::size_t& i = core->default_index[flow][role];
+            if (i == static_cast<std::size_t>(-1)) {
+                defaults.push_back({ flow, role, std::wstring() });
+                i = defaults.size() - 1;
+            }
+            defaults[i].id.assign(id ? id : L"");
+        });
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OnPropertyValueChanged(LPCWSTR id, const PROPERTYKEY key) override {
+        core->record("device_notifications", [&] {
+            std::pair<std::wstring, PROPERTYKEY> k(id ? id : L"", key);
+            if (core->property_index.find(k) != core->property_index.end()) return;
+            core->pending.properties.push_back({ k.first, key });
+            core->property_index.emplace(static_cast<std::pair<std::wstring, PROPERTYKEY>&&>(k), core->pending.properties.size() - 1);
+        });
+        return S_OK;
+    }
+private:
+    const std::shared_ptr<event_bus_core> core;
+};
+
+struct bus_volume_callback final : callback_object<IAudioEndpointVolumeCallback> {
+    bus_volume_callback(std::shared_ptr<event_bus_core> core, std::wstring id) noexcept
+        : core(static_cast<std::shared_ptr<event_bus_core>&&>(core)), id(static_cast<std::wstring&&>(id)) {}
+
+    HRESULT STDMETHODCALLTYPE OnNotify(PAUDIO_VOLUME_NOTIFICATION_DATA data) override {
+        if (!data) return E_POINTER;
+        core->record("endpoint_volume_notifications", [&] {
+            endpoint_volume_event& e = core->entry(core->pending.volumes, core->volume_index, id.c_str());
+            if (e.id.empty()) e.id = id;
+            e.volume = data->fMasterVolume;
+            e.muted = data->bMuted != FALSE;
+            e.channel_volumes.assign(data->afChannelVolumes, data->afChannelVolumes + data->nChannels);
+            e.event_context = data->guidEventContext;
+        });
+        return S_OK;
+    }
+private:
+    const std::shared_ptr<event_bus_core> core;
+    const std::wstring id;
+};
+
+struct bus_session_events final : callback_object<IAudioSessionEvents> {
+    bus_session_events(std::shared_ptr<event_bus_core> core, std::wstring key) noexcept
+        : core(static_cast<std::shared_ptr<event_bus_core>&&>(core)), key(static_cast<std::wstring&&>(key)) {}
+
+    HRESULT STDMETHODCALLTYPE OnDisplayNameChanged(LPCWSTR, LPCGUID) override {
+        update([](session_event& e) { e.display_name_changed = true; });
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OnIconPathChanged(LPCWSTR, LPCGUID) override {
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OnSimpleVolumeChanged(float volume, BOOL muted, LPCGUID event_context) override {
+        update([&](session_event& e) {
+            e.volume = volume;
+            e.muted = muted != FALSE;
+            e.event_context = event_context ? *event_context : GUID_NULL;
+        });
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OnChannelVolumeChanged(DWORD, float*, DWORD, LPCGUID) override {
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OnGroupingParamChanged(LPCGUID, LPCGUID) override {
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OnStateChanged(AudioSessionState state) override {
+        update([&](session_event& e) { e.state = static_cast<int>(state); });
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OnSessionDisconnected(AudioSessionDisconnectReason) override {
+        update([](session_event& e) { e.disconnected = true; });
+        return S_OK;
+    }
+private:
+    template<typename F>
+    void update(F&& f) noexcept {
+        core->record("session_notifications", [&] {
+            session_event& e = core->entry(core->pending.sessions, core->session_index, key.c_str());
+            if (e.key.empty()) e.key = key;
+            f(e);
+        });
+    }
+
+    const std::shared_ptr<event_bus_core> core;
+    const std::wstring key;
+};
+
+}
+
+/**
+ * Collects device notifications, endpoint volume changes and session events from their separate COM callbacks, and
+ * hands them to one consumer as merged batches (see `audio_event_batch`), so a UI redraws once per frame instead of
+ * once per notification.
+ *
+ * Register the callback objects from `device_notifications`, `volume_callback` and `session_events` with their
+ * sources. They only merge into the pending batch under a short lock; `on_pending` is called (on the notifying
+ * thread) when the first notification lands in an empty batch, e.g. to post one message or request one frame.
+ * The consumer then `poll`s once per tick.
+ *
+ * The callback objects keep the pending state alive, so they may outlive the bus. Everything is thread-safe.
+ */
+struct event_bus {
+    // Throws whatever `std::make_shared` and the standard containers throw
+    explicit event_bus(std::function<void()> on_pending = nullptr)
+        : core(std::make_shared<detail::event_bus_core>(static_cast<std::function<void()>&&>(on_pending))) {}
+
+    event_bus(const event_bus&) = delete;
+    event_bus& operator=(const event_bus&) = delete;
+
+    // For `device_enumerator::register_endpoint_notification_callback`. Throws `std::bad_alloc`.
+    com_pointer<IMMNotificationClient> device_notifications() const {
+        return com_pointer<IMMNotificationClient>(new detail::bus_notification_client(core));
+    }
+
+    // For `endpoint_volume::register_control_change_notify` on endpoint `id`. Throws whatever `std::wstring` throws.
+    com_pointer<IAudioEndpointVolumeCallback> volume_callback(std::wstring id) const {
+        return com_pointer<IAudioEndpointVolumeCallback>(new detail::bus_volume_callback(core, static_cast<std::wstring&&>(id)));
+    }
+
+    /**
+     * For `IAudioSessionControl::RegisterAudioSessionNotification`; `key` identifies the session in the batches
+     * (e.g. its session instance identifier). Throws whatever `std::wstring` throws.
+     */
+    com_pointer<IAudioSessionEvents> session_events(std::wstring key) const {
+        return com_pointer<IAudioSessionEvents>(new detail::bus_session_events(core, static_cast<std::wstring&&>(key)));
+    }
+
+    /**
+     * Replaces `batch` with everything received since the previous poll (its old buffers become the bus's). Returns
+     * false, leaving `batch` empty, if nothing was.
+     */
+    bool poll(audio_event_batch& batch) noexcept {
+        batch.clear();
+        std::lock_guard<std::mutex> lock(core->mutex);
+        if (core->pending.events == 0) return false;
+        std::swap(batch, core->pending);
+        // Only the net presence changes; these vectors have just been cleared, so this only allocates while they grow
+        try {
+            for (detail::event_bus_core::presence& p : core->presences) {
+                if (!p.first_added) batch.removed.push_back(p.added ? p.id : static_cast<std::wstring&&>(p.id));
+                if (p.added) batch.added.push_back(static_cast<std::wstring&&>(p.id));
+            }
+        } catch (const std::bad_alloc&) {
+        }
+        core->clear_indices();
+        core->delivered += batch.size();
+        ++core->batches;
+        return true;
+    }
+
+    event_bus_stats stats() const {
+        std::lock_guard<std::mutex> lock(core->mutex);
+        return { core->events, core->delivered, core->batches };
+    }
+private:
+    const std::shared_ptr<detail::event_bus_core> core;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_EVENT_BUS_H_
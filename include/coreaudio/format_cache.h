@@ -0,0 +1,241 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_FORMAT_CACHE_H_
+#define WINDOWS_COREAUDIO_WRAPPER_FORMAT_CACHE_H_
+
+#include "windows.h"
+#include "audioclient.h"
+#include "mmdeviceapi.h"
+#include "mmreg.h"
+#include "propidl.h"
+
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "coreaudio/device.h"
+#include "coreaudio/device_interfaces/audio_client.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/smart_pointers.h"
+#include "coreaudio/util/throw_com_error.h"
+#include "coreaudio/util/wave_format.h"
+
+
+namespace coreaudio {
+
+/**
+ * Caches the mix format, the device format (`PKEY_AudioEngine_DeviceFormat`) and the results of
+ * `IAudioClient::IsFormatSupported` for each (share mode, format) pair probed on a device, so that reopening a
+ * stream doesn't have to make the same cross-process calls again.
+ *
+ * Forward `IMMNotificationClient::OnPropertyValueChanged` and `OnDeviceStateChanged` to `on_property_value_changed`
+ * and `on_device_state_changed` (these are thread-safe) to drop the cache when the device format changes.
+ * Everything else is not thread-safe.
+ *
+ * Returned `const WAVEFORMATEX*` are valid until the cache is next used after being invalidated.
+ */
+struct format_cache {
+    format_cache(format_cache&& other) noexcept :
+        device_id(static_cast<std::wstring&&>(other.device_id)), dev(static_cast<device&&>(other.dev)),
+        client(static_cast<audio_client&&>(other.client)), mix_fmt(static_cast<cached_format&&>(other.mix_fmt)),
+        device_fmt(static_cast<cached_format&&>(other.device_fmt)), probes(static_cast<std::vector<probe>&&>(other.probes)),
+        invalidations(other.invalidations.load(std::memory_order_acquire)), seen_invalidations(other.seen_invalidations) {}
+    format_cache& operator=(format_cache&&) = delete;
+
+    /**
+     * Holds another reference to `d`. Nothing is queried until it is needed.
+     * Throws whatever `std::wstring` throws (usually `std::bad_alloc`) when copying the device ID.
+     */
+    static h_optional<format_cache> make(const device& d) {
+        if (!d) return { E_INVALIDARG, format_cache() };
+        h_optional<task_memory_pointer<WCHAR>> id = d.id(std::nothrow);
+        if (!id) return { id.get_status(), format_cache() };
+        format_cache result;
+        result.device_id = id.get_unchecked().get();
+        d.get_raw()->AddRef();
+        result.dev = device(d.get_raw());
+        return { S_OK, static_cast<format_cache&&>(result) };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    const WAVEFORMATEX* mix_format() {
+        return *mix_format(std::nothrow);
+    }
+#endif
+    // Throws whatever `std::vector` throws when the format is first cached
+    h_optional<const WAVEFORMATEX*> mix_format(std::nothrow_t) {
+        drop_if_invalidated();
+        if (mix_fmt.cached) return { S_OK, mix_fmt.get() };
+        HRESULT status = with_client([&](const audio_client& c) {
+            h_optional<task_memory_pointer<WAVEFORMATEX>> f = c.get_mix_format(std::nothrow);
+            if (f) mix_fmt.set(f.get_unchecked().get());
+            return f.get_status();
+        });
+        return { status, mix_fmt.get() };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    const WAVEFORMATEX* device_format() {
+        return *device_format(std::nothrow);
+    }
+#endif
+    // The format the audio engine uses with the hardware in shared mode (`PKEY_AudioEngine_DeviceFormat`)
+    h_optional<const WAVEFORMATEX*> device_format(std::nothrow_t) {
+        drop_if_invalidated();
+        if (device_fmt.cached) return { S_OK, device_fmt.get() };
+        h_optional<com_pointer<IPropertyStore>> store = dev.open_property_store(std::nothrow, STGM_READ);
+        if (!store) return { store.get_status(), nullptr };
+        PROPVARIANT v;
+        PropVariantInit(&v);
+        HRESULT status = store.get_unchecked().get()->GetValue(PKEY_AudioEngine_DeviceFormat, &v);
+        if (SUCCEEDED(status)) {
+            if (v.vt == VT_BLOB && wave_format_size(v.blob.pBlobData, v.blob.cbSize) != 0) {
+                device_fmt.set(reinterpret_cast<const WAVEFORMATEX*>(v.blob.pBlobData));
+            } else {
+                status = E_NOTFOUND;
+            }
+        }
+        PropVariantClear(&v);
+        return { status, device_fmt.get() };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    const WAVEFORMATEX* is_format_supported(AUDCLNT_SHAREMODE share_mode, const WAVEFORMATEX* format) {
+        return *is_format_supported(std::nothrow, share_mode, format);
+    }
+#endif
+    /**
+     * As `audio_client::is_format_supported`, but only calls it the first time each (share_mode, format) is probed.
+     * The closest match (if status is S_FALSE) is owned by the cache.
+     */
+    h_optional<const WAVEFORMATEX*> is_format_supported(std::nothrow_t, AUDCLNT_SHAREMODE share_mode, const WAVEFORMATEX* format) {
+        if (!format) return { E_POINTER, nullptr };
+        drop_if_invalidated();
+        std::size_t size = wave_format_size(format);
+        for (const probe& p : probes) {
+            if (p.share_mode == share_mode && p.format.size() == size && std::memcmp(p.format.data(), format, size) == 0) {
+                return { p.status, p.closest.get() };
+            }
+        }
+        probe p;
+        p.share_mode = share_mode;
+        p.format.assign(reinterpret_cast<const BYTE*>(format), reinterpret_cast<const BYTE*>(format) + size);
+        p.status = with_client([&](const audio_client& c) {
+            h_optional<task_memory_pointer<WAVEFORMATEX>> closest = c.is_format_supported(std::nothrow, share_mode, format);
+            if (closest.get_unchecked()) p.closest.set(closest.get_unchecked().get());
+            return closest.get_status();
+        });
+        // Only cache answers about the format, not errors like AUDCLNT_E_DEVICE_INVALIDATED
+        if (SUCCEEDED(p.status) || p.status == AUDCLNT_E_UNSUPPORTED_FORMAT) {
+            probes.push_back(static_cast<probe&&>(p));
+            return { probes.back().status, probes.back().closest.get() };
+        }
+        return { p.status, nullptr };
+    }
+
+    /**
+     * Gives away the (uninitialized) audio client used for probing, so opening the stream doesn't need to activate
+     * another one. The next probe activates a new one.
+     */
+    h_optional<audio_client> take_audio_client(std::nothrow_t) noexcept {
+        drop_if_invalidated();
+        if (!client) {
+            h_optional<audio_client> c = dev.activate_audio_client(std::nothrow);
+            return { c.get_status(), static_cast<audio_client&&>(c.get_unchecked()) };
+        }
+        return { S_OK, static_cast<audio_client&&>(client) };
+    }
+
+    // Thread-safe. The cache is dropped the next time it is used.
+    void invalidate() noexcept {
+        invalidations.fetch_add(1, std::memory_order_release);
+    }
+
+    // Thread-safe. Returns true if this invalidated the cache.
+    bool on_property_value_changed(LPCWSTR changed_device_id, const PROPERTYKEY& key) noexcept {
+        if (!changed_device_id || device_id != changed_device_id) return false;
+        if (!(key.fmtid == PKEY_AudioEngine_DeviceFormat.fmtid && key.pid == PKEY_AudioEngine_DeviceFormat.pid)) return false;
+        invalidate();
+        return true;
+    }
+
+    // Thread-safe. Returns true if this invalidated the cache.
+    bool on_device_state_changed(LPCWSTR changed_device_id, DWORD) noexcept {
+        if (!changed_device_id || device_id != changed_device_id) return false;
+        invalidate();
+        return true;
+    }
+
+    const std::wstring& id() const noexcept {
+        return device_id;
+    }
+    const device& get_device() const noexcept {
+        return dev;
+    }
+private:
+    format_cache() noexcept = default;
+
+    struct cached_format {
+        std::vector<BYTE> bytes;
+        bool cached = false;
+
+        void set(const WAVEFORMATEX* f) {
+            copy_wave_format(f, bytes);
+            cached = true;
+        }
+        const WAVEFORMATEX* get() const noexcept {
+            return cached ? reinterpret_cast<const WAVEFORMATEX*>(bytes.data()) : nullptr;
+        }
+        void clear() noexcept {
+            bytes.clear();
+            cached = false;
+        }
+    };
+
+    struct probe {
+        AUDCLNT_SHAREMODE share_mode;
+        std::vector<BYTE> format;
+        HRESULT status;
+        cached_format closest;
+    };
+
+    void drop_if_invalidated() noexcept {
+        unsigned long current = invalidations.load(std::memory_order_acquire);
+        if (current == seen_invalidations) return;
+        seen_invalidations = current;
+        client = audio_client();
+        mix_fmt.clear();
+        device_fmt.clear();
+        probes.clear();
+    }
+
+    // Calls `f(client)`, activating the client first if needed, and once more if it was invalidated
+    template<typename F>
+    HRESULT with_client(F&& f) {
+        HRESULT status = E_FAIL;
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            if (!client) {
+                h_optional<audio_client> c = dev.activate_audio_client(std::nothrow);
+                if (!c) return c.get_status();
+                client = static_cast<audio_client&&>(c.get_unchecked());
+            }
+            status = f(static_cast<const audio_client&>(client));
+            if (status != AUDCLNT_E_DEVICE_INVALIDATED) return status;
+            client = audio_client();
+        }
+        return status;
+    }
+
+    std::wstring device_id;
+    device dev;
+    audio_client client;
+    cached_format mix_fmt;
+    cached_format device_fmt;
+    std::vector<probe> probes;
+    std::atomic<unsigned long> invalidations{0};
+    unsigned long seen_invalidations = 0;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_FORMAT_CACHE_H_
@@ -0,0 +1,280 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_LOOPBACK_CAPTURE_H_
+#define WINDOWS_COREAUDIO_WRAPPER_LOOPBACK_CAPTURE_H_
+
+#include "windows.h"
+#include "audioclient.h"
+#include "mmdeviceapi.h"
+#include "mmreg.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "coreaudio/com_context.h"
+#include "coreaudio/device.h"
+#include "coreaudio/device_interfaces/audio_capture_client.h"
+#include "coreaudio/device_interfaces/audio_client.h"
+#include "coreaudio/util/broadcast_ring.h"
+#include "coreaudio/util/call_observer.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/smart_pointers.h"
+#include "coreaudio/util/wave_format.h"
+
+
+namespace coreaudio {
+
+struct loopback_capture_options {
+    // Passed to `IAudioClient::Initialize`
+    REFERENCE_TIME buffer_duration = 200000;
+    // Audio kept in the ring for slow readers
+    DWORD ring_milliseconds = 2000;
+    // Packets kept in the ring for slow readers
+    std::size_t ring_packets = 512;
+};
+
+/**
+ * One loopback capture stream on a render endpoint, shared by every consumer that wants it. Get it from
+ * `loopback_capture_registry::acquire`; the capture stops when the last `std::shared_ptr` to it is dropped.
+ *
+ * A capture thread copies each packet once, from the capture buffer into a `broadcast_ring`. Each consumer reads it
+ * from there through its own `broadcast_ring::reader` (see `open_reader`) at its own pace. Silent packets are
+ * published as zeros.
+ */
+struct shared_loopback_capture {
+    shared_loopback_capture(const shared_loopback_capture&) = delete;
+    shared_loopback_capture& operator=(const shared_loopback_capture&) = delete;
+
+    ~shared_loopback_capture() {
+        stop_requested.store(true, std::memory_order_release);
+        if (stop_event) SetEvent(stop_event);
+        if (thread.joinable()) thread.join();
+        if (stop_event) CloseHandle(stop_event);
+    }
+
+    // Starts at the next packet captured. The reader keeps the ring (not the capture) alive.
+    broadcast_ring::reader open_reader() const noexcept {
+        return broadcast_ring::reader(ring);
+    }
+
+    // The mix format of the endpoint, which every packet is in
+    const WAVEFORMATEX* format() const noexcept {
+        return reinterpret_cast<const WAVEFORMATEX*>(format_bytes.data());
+    }
+
+    /**
+     * S_OK while capturing. Once the capture thread stops because of an error (e.g. AUDCLNT_E_DEVICE_INVALIDATED),
+     * the error. Acquire the capture again from the registry to restart it.
+     */
+    HRESULT status() const noexcept {
+        return thread_status.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Packets the capture thread couldn't put in the ring because they were larger than it (see
+     * `loopback_capture_options`). Readers don't see them at all, not even as lost packets.
+     */
+    std::uint64_t packets_dropped() const noexcept {
+        return dropped_packets.load(std::memory_order_relaxed);
+    }
+    std::uint64_t frames_dropped() const noexcept {
+        return dropped_frames.load(std::memory_order_relaxed);
+    }
+
+    const std::wstring& id() const noexcept {
+        return device_id;
+    }
+private:
+    friend struct loopback_capture_registry;
+
+    shared_loopback_capture() noexcept = default;
+
+    // Runs on the capture thread. Reports the result of starting the stream through `started`.
+    void run(device&& render_device, const loopback_capture_options& options, std::promise<HRESULT>& started) noexcept {
+        h_optional<com_context> com = com_context::make(COINIT_MULTITHREADED);
+        // Declared after `com`, so that it is released before COM is uninitialized on this thread
+        device endpoint(static_cast<device&&>(render_device));
+        HANDLE packet_event = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+        HRESULT status = packet_event ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+        audio_client client;
+        audio_capture_client capture;
+        if (SUCCEEDED(status)) status = start(endpoint, options, packet_event, client, capture);
+        thread_status.store(status, std::memory_order_release);
+        started.set_value(status);
+        if (SUCCEEDED(status)) {
+            status = capture_until_stopped(packet_event, capture);
+            thread_status.store(status, std::memory_order_release);
+            client.stop(std::nothrow);
+        }
+        if (packet_event) CloseHandle(packet_event);
+    }
+
+    HRESULT start(
+        const device& endpoint, const loopback_capture_options& options, HANDLE packet_event,
+        audio_client& client, audio_capture_client& capture
+    ) noexcept {
+        h_optional<audio_client> c = endpoint.activate_audio_client(std::nothrow);
+        if (!c) return c.get_status();
+        client = static_cast<audio_client&&>(c.get_unchecked());
+
+        h_optional<task_memory_pointer<WAVEFORMATEX>> mix = client.get_mix_format(std::nothrow);
+        if (!mix) return mix.get_status();
+        const WAVEFORMATEX* f = mix.get_unchecked().get();
+        // Event-driven loopback only signals on Windows 10 1703 and later; the wait in `capture_until_stopped` times
+        // out and polls on older versions.
+        HRESULT status = client.initialize(
+            std::nothrow, AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_LOOPBACK | AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+            options.buffer_duration, 0, f
+        );
+        if (FAILED(status)) return status;
+        status = client.set_event_handle(std::nothrow, packet_event);
+        if (FAILED(status)) return status;
+        h_optional<com_pointer<IAudioCaptureClient>> cc = client.get_service<IAudioCaptureClient>(std::nothrow);
+        if (!cc) return cc.get_status();
+        capture = audio_capture_client(cc.get_unchecked().release());
+
+        try {
+            copy_wave_format(f, format_bytes);
+            std::size_t ring_bytes = static_cast<std::size_t>(f->nAvgBytesPerSec) * options.ring_milliseconds / 1000;
+            ring = broadcast_ring::make(ring_bytes, options.ring_packets);
+        } catch (const std::bad_alloc&) {
+            return E_OUTOFMEMORY;
+        }
+        poll_milliseconds = static_cast<DWORD>(options.buffer_duration / 10000 / 2);
+        if (poll_milliseconds == 0) poll_milliseconds = 1;
+        return client.start(std::nothrow);
+    }
+
+    HRESULT capture_until_stopped(HANDLE packet_event, const audio_capture_client& capture) noexcept {
+        const HANDLE events[] = { stop_event, packet_event };
+        const std::size_t block_align = format()->nBlockAlign;
+        while (!stop_requested.load(std::memory_order_acquire)) {
+            WaitForMultipleObjects(2, events, FALSE, poll_milliseconds);
+            for (;;) {
+                h_optional<UINT32> next = capture.get_next_packet_size(std::nothrow);
+                if (!next) return next.get_status();
+                if (next.get_unchecked() == 0) break;
+                h_optional<audio_capture_client::packet> p = capture.get_buffer(std::nothrow);
+                if (!p) return p.get_status();
+                const audio_capture_client::packet& packet = p.get_unchecked();
+                if (packet.flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY)
+                    detail::count_event("capture_discontinuities");
+                std::size_t bytes = packet.frames * block_align;
+                unsigned char* to = ring->begin_write(bytes);
+                if (to) {
+                    if (packet.flags & AUDCLNT_BUFFERFLAGS_SILENT) {
+                        std::memset(to, 0, bytes);
+                    } else {
+                        std::memcpy(to, packet.data, bytes);
+                    }
+                    ring->commit_write(packet.frames, packet.flags, packet.device_position, packet.qpc_position);
+                } else {
+                    dropped_packets.fetch_add(1, std::memory_order_relaxed);
+                    dropped_frames.fetch_add(packet.frames, std::memory_order_relaxed);
+                    detail::count_event("loopback_packets_dropped");
+                }
+                HRESULT status = capture.release_buffer(std::nothrow, packet.frames);
+                if (FAILED(status)) return status;
+            }
+        }
+        return S_OK;
+    }
+
+    std::wstring device_id;
+    std::vector<BYTE> format_bytes;
+    std::shared_ptr<broadcast_ring> ring;
+    DWORD poll_milliseconds = 10;
+    HANDLE stop_event = nullptr;
+    std::atomic<bool> stop_requested{false};
+    std::atomic<HRESULT> thread_status{S_OK};
+    std::atomic<std::uint64_t> dropped_packets{0};
+    std::atomic<std::uint64_t> dropped_frames{0};
+    std::thread thread;
+};
+
+/**
+ * Hands out one `shared_loopback_capture` per render endpoint, so consumers that each want loopback audio from the
+ * same endpoint share one stream (and one copy out of the audio engine) instead of each opening their own.
+ * Thread-safe.
+ */
+struct loopback_capture_registry {
+    /**
+     * Returns the running capture of `render_device`, or starts one. `options` only apply when starting one.
+     * Waits (without blocking other endpoints) until the capture has started or failed to.
+     * Throws whatever `std::wstring`, `std::vector` and `std::thread` throw.
+     */
+    h_optional<std::shared_ptr<shared_loopback_capture>> acquire(const device& render_device, const loopback_capture_options& options = {}) {
+        h_optional<task_memory_pointer<WCHAR>> id = render_device.id(std::nothrow);
+        if (!id) return { id.get_status(), nullptr };
+        std::wstring device_id = id.get_unchecked().get();
+
+        std::shared_ptr<shared_loopback_capture> capture;
+        std::shared_future<HRESULT> started;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (std::size_t i = 0; i < captures.size();) {
+                std::shared_ptr<shared_loopback_capture> existing = captures[i].capture.lock();
+                if (!existing || FAILED(existing->status())) {
+                    captures.erase(captures.begin() + static_cast<std::ptrdiff_t>(i));
+                    continue;
+                }
+                if (captures[i].device_id == device_id) {
+                    capture = static_cast<std::shared_ptr<shared_loopback_capture>&&>(existing);
+                    started = captures[i].started;
+                    break;
+                }
+                ++i;
+            }
+            if (!capture) {
+                capture.reset(new shared_loopback_capture());
+                capture->device_id = device_id;
+                capture->stop_event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+                if (!capture->stop_event) return { HRESULT_FROM_WIN32(GetLastError()), nullptr };
+                render_device.get_raw()->AddRef();
+                device endpoint(render_device.get_raw());
+                std::promise<HRESULT> result;
+                started = result.get_future().share();
+                shared_loopback_capture* raw = capture.get();
+                capture->thread = std::thread([raw, options](device&& e, std::promise<HRESULT>&& p) {
+                    raw->run(static_cast<device&&>(e), options, p);
+                }, static_cast<device&&>(endpoint), static_cast<std::promise<HRESULT>&&>(result));
+                captures.push_back({ static_cast<std::wstring&&>(device_id), capture, started });
+            }
+        }
+        // Outside the lock: starting the stream takes a while, and captures of other endpoints needn't wait for it
+        HRESULT status = started.get();
+        if (FAILED(status)) return { status, nullptr };
+        return { S_OK, static_cast<std::shared_ptr<shared_loopback_capture>&&>(capture) };
+    }
+
+    // Number of endpoints currently being captured
+    std::size_t active_count() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::size_t count = 0;
+        for (const entry& c : captures) {
+            std::shared_ptr<shared_loopback_capture> capture = c.capture.lock();
+            count += capture && SUCCEEDED(capture->status()) ? 1 : 0;
+        }
+        return count;
+    }
+private:
+    struct entry {
+        std::wstring device_id;
+        std::weak_ptr<shared_loopback_capture> capture;
+        std::shared_future<HRESULT> started;  // Ready once the capture thread has started the stream or failed to
+    };
+
+    mutable std::mutex mutex;
+    std::vector<entry> captures;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_LOOPBACK_CAPTURE_H_
@@ -0,0 +1,30 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_NOTIFICATION_CLIENT_H_
+#define WINDOWS_COREAUDIO_WRAPPER_NOTIFICATION_CLIENT_H_
+
+#include "mmdeviceapi.h"
+
+#include "coreaudio/util/callback_object.h"
+
+
+namespace coreaudio {
+
+/**
+ * Implements `IMMNotificationClient` (with `IUnknown` from `callback_object`) with notifications that do nothing.
+ * Derive from this and override the notifications you need.
+ *
+ * Allocate with `new`, like any `callback_object`.
+ *
+ * Notifications can be called from any thread (and from multiple threads at the same time), so overrides must be
+ * thread-safe and should return quickly.
+ */
+struct notification_client : callback_object<IMMNotificationClient> {
+    HRESULT STDMETHODCALLTYPE OnDeviceStateChanged(LPCWSTR, DWORD) override { return S_OK; }
+    HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR) override { return S_OK; }
+    HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR) override { return S_OK; }
+    HRESULT STDMETHODCALLTYPE OnDefaultDeviceChanged(EDataFlow, ERole, LPCWSTR) override { return S_OK; }
+    HRESULT STDMETHODCALLTYPE OnPropertyValueChanged(LPCWSTR, const PROPERTYKEY) override { return S_OK; }
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_NOTIFICATION_CLIENT_H_
@@ -0,0 +1,365 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_RESILIENT_INTERFACE_H_
+#define WINDOWS_COREAUDIO_WRAPPER_RESILIENT_INTERFACE_H_
+
+#include "windows.h"
+#include "audioclient.h"
+#include "endpointvolume.h"
+#include "propidl.h"
+
+#include <new>
+#include <string>
+#include <vector>
+
+#include "coreaudio/device.h"
+#include "coreaudio/device_enumerator.h"
+#include "coreaudio/device_interfaces/endpoint_volume.h"
+#include "coreaudio/util/call_observer.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/smart_pointers.h"
+#include "coreaudio/util/throw_com_error.h"
+
+
+namespace coreaudio {
+
+/**
+ * True for the errors an activated interface returns after its endpoint is disabled, removed and re-added, or after
+ * the audio service restarts. The interface will never work again, but the same device ID can be activated again.
+ */
+inline bool is_invalidation_error(HRESULT hr) noexcept {
+    return hr == AUDCLNT_E_DEVICE_INVALIDATED || hr == AUDCLNT_E_SERVICE_NOT_RUNNING ||
+        hr == RPC_E_DISCONNECTED || hr == HRESULT_FROM_WIN32(RPC_S_SERVER_UNAVAILABLE);
+}
+
+struct resilience_policy {
+    // Maximum number of times a single call is made (so `max_attempts - 1` re-activations per call)
+    unsigned max_attempts = 3;
+    // After a failed re-activation, calls fail immediately (without trying to re-activate) for this long
+    ULONGLONG retry_interval_ms = 250;
+};
+
+/**
+ * An interface activated with `device::activate<T>` that remembers the device ID and activation parameters, and
+ * lazily re-resolves the device (with `device_enumerator::get_device`) and re-activates the interface when a call
+ * fails with an invalidation error (See `is_invalidation_error`).
+ *
+ * The `device_enumerator` must outlive this. Not thread-safe.
+ *
+ * @tparam T The COM interface type
+ */
+template<typename T>
+struct resilient_interface {
+    using raw_interface = T;
+
+    resilient_interface(resilient_interface&& other) noexcept :
+        enumerator(other.enumerator), device_id(static_cast<std::wstring&&>(other.device_id)),
+        activation_params(other.activation_params), class_ctx(other.class_ctx), policy(other.policy),
+        value(static_cast<com_pointer<T>&&>(other.value)), reactivations(other.reactivations),
+        last_failed_recovery(other.last_failed_recovery), last_failed_status(other.last_failed_status) {
+        PropVariantInit(&other.activation_params);
+    }
+    resilient_interface& operator=(resilient_interface&&) = delete;
+
+    ~resilient_interface() {
+        PropVariantClear(&activation_params);
+    }
+
+    /**
+     * Activates `T` on `d` and remembers how to do it again.
+     * Throws whatever `std::wstring` throws (usually `std::bad_alloc`) when copying the device ID.
+     */
+    static h_optional<resilient_interface> make(
+        const device_enumerator& e, const device& d, const PROPVARIANT* activation_params = nullptr,
+        DWORD class_ctx = CLSCTX_ALL, resilience_policy policy = {}
+    ) {
+        resilient_interface result(e, class_ctx, policy);
+        h_optional<task_memory_pointer<WCHAR>> id = d.id(std::nothrow);
+        if (!id) return { id.get_status(), static_cast<resilient_interface&&>(result) };
+        result.device_id = id.get_unchecked().get();
+        if (activation_params) {
+            HRESULT status = PropVariantCopy(&result.activation_params, activation_params);
+            if (FAILED(status)) return { status, static_cast<resilient_interface&&>(result) };
+        }
+        h_optional<com_pointer<T>> activated = d.template activate<T>(std::nothrow, result.params(), class_ctx);
+        result.value = static_cast<com_pointer<T>&&>(activated.get_unchecked());
+        return { activated.get_status(), static_cast<resilient_interface&&>(result) };
+    }
+
+    /**
+     * Calls `f(T*)`, which should return the `HRESULT` of the method `name` of the interface, through the call
+     * observer. If it returns an invalidation error, re-activates and tries again, up to `policy.max_attempts` calls
+     * in total (each one observed).
+     */
+    template<typename F>
+    HRESULT call(const char* name, F&& f) noexcept(noexcept(f(static_cast<T*>(nullptr)))) {
+        HRESULT status = E_POINTER;
+        for (unsigned attempt = 0; attempt < policy.max_attempts; ++attempt) {
+            if (!value) {
+                status = reactivate();
+                if (FAILED(status)) return status;
+            }
+            T* p = value.get();
+            status = detail::observe_call<default_call_observer>(p, name, [&] { return f(p); });
+            if (!is_invalidation_error(status)) return status;
+            value.reset();
+        }
+        return status;
+    }
+
+    /**
+     * Resolves the device ID and activates the interface again. Fails immediately with the previous error if the
+     * last attempt failed less than `policy.retry_interval_ms` ago.
+     */
+    HRESULT reactivate() noexcept {
+        ULONGLONG now = GetTickCount64();
+        if (FAILED(last_failed_status) && now - last_failed_recovery < policy.retry_interval_ms) {
+            return last_failed_status;
+        }
+        HRESULT status = try_reactivate();
+        if (FAILED(status)) {
+            last_failed_recovery = now;
+            last_failed_status = status;
+        } else {
+            last_failed_status = S_OK;
+            ++reactivations;
+        }
+        return status;
+    }
+
+    // Drops the current interface, so the next call re-activates
+    void invalidate() noexcept {
+        value.reset();
+    }
+
+    explicit operator bool() const noexcept {
+        return value.operator bool();
+    }
+    T* get_raw() const noexcept {
+        return value.get();
+    }
+    const std::wstring& id() const noexcept {
+        return device_id;
+    }
+    // Number of successful re-activations. Changes whenever `get_raw()` points to a new interface.
+    unsigned long generation() const noexcept {
+        return reactivations;
+    }
+private:
+    resilient_interface(const device_enumerator& e, DWORD class_ctx, resilience_policy policy) noexcept :
+        enumerator(&e), class_ctx(class_ctx), policy(policy) {
+        PropVariantInit(&activation_params);
+    }
+
+    PROPVARIANT* params() noexcept {
+        return activation_params.vt == VT_EMPTY ? nullptr : &activation_params;
+    }
+
+    HRESULT try_reactivate() noexcept {
+        h_optional<device> d = enumerator->get_device(std::nothrow, device_id.c_str());
+        if (!d) return d.get_status();
+        if (!d.get_unchecked()) return E_NOTFOUND;
+        h_optional<com_pointer<T>> activated = d.get_unchecked().template activate<T>(std::nothrow, params(), class_ctx);
+        if (activated) value = static_cast<com_pointer<T>&&>(activated.get_unchecked());
+        return activated.get_status();
+    }
+
+    const device_enumerator* enumerator;
+    std::wstring device_id;
+    PROPVARIANT activation_params;
+    DWORD class_ctx;
+    resilience_policy policy;
+    com_pointer<T> value;
+    unsigned long reactivations = 0;
+    ULONGLONG last_failed_recovery = 0;
+    HRESULT last_failed_status = S_OK;
+};
+
+/**
+ * Like `endpoint_volume`, but re-activates itself after the endpoint is invalidated (See `resilient_interface`), and
+ * re-registers any control change callbacks on the new interface.
+ *
+ * While the endpoint can't be re-activated, volume and mute reads return the last successfully read or written
+ * value with the status `S_FALSE` (So they still count as succeeded). Writes fail with the underlying error.
+ */
+struct resilient_endpoint_volume {
+    using raw_interface = IAudioEndpointVolume;
+
+    resilient_endpoint_volume(resilient_endpoint_volume&&) noexcept = default;
+    resilient_endpoint_volume& operator=(resilient_endpoint_volume&&) = delete;
+
+    ~resilient_endpoint_volume() {
+        for (IAudioEndpointVolumeCallback* callback : callbacks) {
+            if (volume) unregister_callback(volume.get_raw(), callback);
+            callback->Release();
+        }
+    }
+
+    static h_optional<resilient_endpoint_volume> make(const device_enumerator& e, const device& d, DWORD class_ctx = CLSCTX_ALL, resilience_policy policy = {}) {
+        h_optional<resilient_interface<raw_interface>> v = resilient_interface<raw_interface>::make(e, d, nullptr, class_ctx, policy);
+        return { v.get_status(), resilient_endpoint_volume(static_cast<resilient_interface<raw_interface>&&>(v.get_unchecked())) };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    float get_master_volume_level_scalar() {
+        return *get_master_volume_level_scalar(std::nothrow);
+    }
+#endif
+    h_optional<float> get_master_volume_level_scalar(std::nothrow_t) noexcept {
+        return read(scalar, "GetMasterVolumeLevelScalar", [](raw_interface* p, float* x) { return p->GetMasterVolumeLevelScalar(x); });
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    float get_master_volume_level_dB() {
+        return *get_master_volume_level_dB(std::nothrow);
+    }
+#endif
+    h_optional<float> get_master_volume_level_dB(std::nothrow_t) noexcept {
+        return read(level_dB, "GetMasterVolumeLevel", [](raw_interface* p, float* x) { return p->GetMasterVolumeLevel(x); });
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    bool is_muted() {
+        return *is_muted(std::nothrow);
+    }
+#endif
+    h_optional<bool> is_muted(std::nothrow_t) noexcept {
+        h_optional<BOOL> result = read(muted, "GetMute", [](raw_interface* p, BOOL* x) { return p->GetMute(x); });
+        return { result.get_status(), result.get_unchecked() != 0 };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void set_master_volume_level_scalar(float level, const GUID& event_context = GUID_NULL) {
+        throw_com_error(set_master_volume_level_scalar(std::nothrow, level, event_context));
+    }
+#endif
+    HRESULT set_master_volume_level_scalar(std::nothrow_t, float level, const GUID& event_context = GUID_NULL) noexcept {
+        HRESULT status = call("SetMasterVolumeLevelScalar", [&](raw_interface* p) { return p->SetMasterVolumeLevelScalar(level, &event_context); });
+        if (SUCCEEDED(status)) {
+            scalar.set(level);
+            level_dB.known = false;
+        }
+        return status;
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void set_master_volume_level_dB(float level, const GUID& event_context = GUID_NULL) {
+        throw_com_error(set_master_volume_level_dB(std::nothrow, level, event_context));
+    }
+#endif
+    HRESULT set_master_volume_level_dB(std::nothrow_t, float level, const GUID& event_context = GUID_NULL) noexcept {
+        HRESULT status = call("SetMasterVolumeLevel", [&](raw_interface* p) { return p->SetMasterVolumeLevel(level, &event_context); });
+        if (SUCCEEDED(status)) {
+            level_dB.set(level);
+            scalar.known = false;
+        }
+        return status;
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void set_mute(bool mute, const GUID& event_context = GUID_NULL) {
+        throw_com_error(set_mute(std::nothrow, mute, event_context));
+    }
+#endif
+    HRESULT set_mute(std::nothrow_t, bool mute, const GUID& event_context = GUID_NULL) noexcept {
+        HRESULT status = call("SetMute", [&](raw_interface* p) { return p->SetMute(mute ? TRUE : FALSE, &event_context); });
+        if (SUCCEEDED(status)) muted.set(mute ? TRUE : FALSE);
+        return status;
+    }
+
+    /**
+     * Registers `callback` now and on every re-activated interface until it is unregistered. Holds a reference.
+     * Throws whatever `std::vector::push_back` throws.
+     */
+    HRESULT register_control_change_notify(std::nothrow_t, IAudioEndpointVolumeCallback* callback) {
+        if (!callback) return E_POINTER;
+        callbacks.reserve(callbacks.size() + 1);
+        HRESULT status = call("RegisterControlChangeNotify", [&](raw_interface* p) { return p->RegisterControlChangeNotify(callback); });
+        if (SUCCEEDED(status)) {
+            callback->AddRef();
+            callbacks.push_back(callback);
+        }
+        return status;
+    }
+
+    HRESULT unregister_control_change_notify(std::nothrow_t, IAudioEndpointVolumeCallback* callback) noexcept {
+        for (auto it = callbacks.begin(); it != callbacks.end(); ++it) {
+            if (*it != callback) continue;
+            callbacks.erase(it);
+            HRESULT status = volume ? unregister_callback(volume.get_raw(), callback) : S_OK;
+            callback->Release();
+            return status;
+        }
+        return E_INVALIDARG;
+    }
+
+    /**
+     * Calls `f(IAudioEndpointVolume*)` for the method `name` with re-activation (See `resilient_interface::call`), for
+     * the methods not wrapped here. Re-registers callbacks first if the interface was re-activated.
+     */
+    template<typename F>
+    HRESULT call(const char* name, F&& f) noexcept(noexcept(f(static_cast<raw_interface*>(nullptr)))) {
+        unsigned long generation = volume.generation();
+        HRESULT status = volume.call(name, [&](raw_interface* p) {
+            if (volume.generation() != generation) {
+                generation = volume.generation();
+                for (IAudioEndpointVolumeCallback* callback : callbacks) {
+                    detail::observe_call<default_call_observer>(p, "RegisterControlChangeNotify", [&] {
+                        return p->RegisterControlChangeNotify(callback);
+                    });
+                }
+            }
+            return f(p);
+        });
+        return status;
+    }
+
+    resilient_interface<raw_interface>& get_resilient_interface() noexcept {
+        return volume;
+    }
+    const std::wstring& id() const noexcept {
+        return volume.id();
+    }
+private:
+    explicit resilient_endpoint_volume(resilient_interface<raw_interface>&& volume) noexcept : volume(static_cast<resilient_interface<raw_interface>&&>(volume)) {}
+
+    template<typename U>
+    struct last_known {
+        U value{};
+        bool known = false;
+
+        void set(U x) noexcept {
+            value = x;
+            known = true;
+        }
+    };
+
+    static HRESULT unregister_callback(raw_interface* p, IAudioEndpointVolumeCallback* callback) noexcept {
+        return detail::observe_call<default_call_observer>(p, "UnregisterControlChangeNotify", [&] {
+            return p->UnregisterControlChangeNotify(callback);
+        });
+    }
+
+    template<typename U, typename Getter>
+    h_optional<U> read(last_known<U>& cache, const char* name, Getter getter) noexcept {
+        U x{};
+        HRESULT status = call(name, [&](raw_interface* p) { return getter(p, &x); });
+        if (SUCCEEDED(status)) {
+            cache.set(x);
+            return { status, x };
+        }
+        // `!volume` means it was invalidated and couldn't be re-activated
+        if (cache.known && (!volume || is_invalidation_error(status))) {
+            return { S_FALSE, cache.value };
+        }
+        return { status, x };
+    }
+
+    resilient_interface<raw_interface> volume;
+    std::vector<IAudioEndpointVolumeCallback*> callbacks;
+    last_known<float> scalar;
+    last_known<float> level_dB;
+    last_known<BOOL> muted;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_RESILIENT_INTERFACE_H_
@@ -0,0 +1,411 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_SHARED_STATE_H_
+#define WINDOWS_COREAUDIO_WRAPPER_SHARED_STATE_H_
+
+#include "windows.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "coreaudio/device_cache.h"
+#include "coreaudio/device_snapshot.h"
+#include "coreaudio/event_bus.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/throw_com_error.h"
+
+
+namespace coreaudio {
+
+namespace detail {
+
+/* Segment layout (native endianness, so publisher and readers must be of the same architecture):
+ *   shared_state_header
+ *   std::atomic<UINT64>[volume_capacity]: live volume words, indexed like the devices of the current image
+ *   two slots of slot_capacity bytes, each holding a device cache image (see `device_cache_image`)
+ * The current image is in slot `image_generation % 2`, so the publisher always writes the other one. Each slot is
+ * guarded by a seqlock, which readers only ever see move if they take longer than two publications to copy it.
+ */
+struct shared_state_slot {
+    std::atomic<UINT64> sequence;  // Odd while the slot is written
+    std::atomic<UINT64> image_generation;
+    std::atomic<UINT64> bytes;
+    UINT64 reserved;
+};
+
+struct shared_state_header {
+    std::atomic<UINT32> magic;  // Written last by the first publisher
+    UINT32 version;
+    UINT32 header_bytes;
+    UINT32 volume_capacity;
+    UINT64 slot_capacity;
+    UINT64 reserved;
+    std::atomic<UINT64> generation;  // Incremented by every publication
+    std::atomic<UINT64> image_generation;  // Of the current image; 0 until the first one
+    UINT64 reserved2[2];
+    shared_state_slot slots[2];
+};
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && sizeof(std::atomic<UINT64>) == 8, "shared_state needs address-free 64-bit atomics");
+static_assert(sizeof(shared_state_header) == 128, "shared_state_header layout");
+
+constexpr UINT32 shared_state_magic = 0x53534143;  // "CASS"
+
+/* A live volume word: the volume scalar's bits (0-31), muted (32), and the low 31 bits of the generation of the
+ * image it is indexed by (33-63), so that words left from an earlier image are ignored.
+ */
+inline UINT64 pack_volume(float volume, bool muted, UINT64 image_generation) noexcept {
+    UINT32 bits;
+    std::memcpy(&bits, &volume, sizeof bits);
+    return bits | static_cast<UINT64>(muted ? 1 : 0) << 32 | (image_generation & 0x7FFFFFFF) << 33;
+}
+
+inline bool unpack_volume(UINT64 word, UINT64 image_generation, float& volume, bool& muted) noexcept {
+    if (word >> 33 != (image_generation & 0x7FFFFFFF)) return false;
+    UINT32 bits = static_cast<UINT32>(word);
+    std::memcpy(&volume, &bits, sizeof volume);
+    muted = (word >> 32 & 1) != 0;
+    return true;
+}
+
+inline std::size_t shared_state_bytes(std::size_t volume_capacity, std::size_t slot_capacity) noexcept {
+    return sizeof(shared_state_header) + volume_capacity * sizeof(UINT64) + 2 * slot_capacity;
+}
+
+}
+
+/**
+ * Publishes a device snapshot and live endpoint volume/mute into a named shared-memory segment, so that other
+ * processes (see `shared_state_reader`) get them without enumerating devices or registering callbacks themselves.
+ *
+ * One process publishes; usually it feeds an `event_bus`, and for each batch:
+ *
+ *     if (!batch.added.empty() || !batch.removed.empty() || !batch.states.empty() || !batch.properties.empty()) {
+ *         h_optional<device_snapshot> s = device_snapshot::take(e);
+ *         if (s) publisher->publish(std::nothrow, s.get_unchecked());
+ *     }
+ *     publisher->publish_volumes(batch);
+ *
+ * Publishing never waits for readers. Not thread-safe: publish from one thread.
+ */
+struct shared_state_publisher {
+    static constexpr std::size_t default_slot_capacity = 256 * 1024;
+    static constexpr std::size_t default_volume_capacity = 256;
+
+    shared_state_publisher(const shared_state_publisher&) = delete;
+    shared_state_publisher& operator=(const shared_state_publisher&) = delete;
+
+    ~shared_state_publisher() {
+        if (view) UnmapViewOfFile(view);
+        if (mapping) CloseHandle(mapping);
+        if (publisher_mutex) CloseHandle(publisher_mutex);
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    static std::unique_ptr<shared_state_publisher> create(LPCWSTR name, std::size_t slot_capacity = default_slot_capacity,
+                                                          std::size_t volume_capacity = default_volume_capacity) {
+        return static_cast<std::unique_ptr<shared_state_publisher>&&>(*create(std::nothrow, name, slot_capacity, volume_capacity));
+    }
+#endif
+    /**
+     * Creates the segment `name` (e.g. `L"Local\\my_app_audio_state"`) in the paging file, or takes over the one a
+     * previous publisher left to readers still holding it, continuing its generations. Fails with the
+     * `CreateMutexW`/`CreateFileMappingW`/`MapViewOfFile` error, or HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS) if
+     * another publisher of `name` is alive or an existing segment has another layout.
+     *
+     * A publisher holds the named mutex `name` + `L".publisher"` open for as long as it lives (the system closes it
+     * when the process exits), so only one process at a time publishes into the segment.
+     *
+     * @param slot_capacity Largest device image (see `device_cache_image::byte_size`) that can be published
+     * @param volume_capacity Devices (in image order) whose volume can be updated live
+     */
+    static h_optional<std::unique_ptr<shared_state_publisher>> create(std::nothrow_t, LPCWSTR name, std::size_t slot_capacity = default_slot_capacity,
+                                                                      std::size_t volume_capacity = default_volume_capacity) noexcept {
+        slot_capacity = (slot_capacity + 7) / 8 * 8;
+        if (volume_capacity > 0xFFFFFFFF) return { E_INVALIDARG, nullptr };
+        std::unique_ptr<shared_state_publisher> result(new (std::nothrow) shared_state_publisher());
+        if (!result) return { E_OUTOFMEMORY, nullptr };
+        try {
+            result->publisher_mutex = CreateMutexW(nullptr, FALSE, (std::wstring(name) + L".publisher").c_str());
+        } catch (const std::bad_alloc&) {
+            return { E_OUTOFMEMORY, nullptr };
+        }
+        if (!result->publisher_mutex) return { HRESULT_FROM_WIN32(GetLastError()), nullptr };
+        if (GetLastError() == ERROR_ALREADY_EXISTS) return { HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS), nullptr };
+        const UINT64 bytes = detail::shared_state_bytes(volume_capacity, slot_capacity);
+        result->mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(bytes >> 32), static_cast<DWORD>(bytes), name);
+        if (!result->mapping) return { HRESULT_FROM_WIN32(GetLastError()), nullptr };
+        const bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+        result->view = MapViewOfFile(result->mapping, FILE_MAP_WRITE, 0, 0, static_cast<SIZE_T>(bytes));
+        if (!result->view) return { HRESULT_FROM_WIN32(GetLastError()), nullptr };
+
+        detail::shared_state_header* h = result->header();
+        if (existed) {
+            if (h->magic.load(std::memory_order_acquire) != detail::shared_state_magic || h->version != format_version ||
+                h->header_bytes != sizeof(detail::shared_state_header) || h->volume_capacity != volume_capacity ||
+                h->slot_capacity != slot_capacity) return { HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS), nullptr };
+        } else {
+            // A new paging file section is zeroed
+            h->version = format_version;
+            h->header_bytes = sizeof(detail::shared_state_header);
+            h->volume_capacity = static_cast<UINT32>(volume_capacity);
+            h->slot_capacity = slot_capacity;
+            h->magic.store(detail::shared_state_magic, std::memory_order_release);
+        }
+        return { S_OK, static_cast<std::unique_ptr<shared_state_publisher>&&>(result) };
+    }
+
+    // See the other overload. Also fails with E_OUTOFMEMORY if the image can't be built.
+    HRESULT publish(std::nothrow_t, const device_snapshot& snapshot) noexcept {
+        std::shared_ptr<const device_cache_image> image;
+        try {
+            image = device_cache_image::build(snapshot.entries, header()->image_generation.load(std::memory_order_relaxed) + 1);
+        } catch (const std::bad_alloc&) {
+            return E_OUTOFMEMORY;
+        }
+        return publish(std::nothrow, static_cast<std::shared_ptr<const device_cache_image>&&>(image));
+    }
+
+    /**
+     * Makes `image` the current device image, with the volumes it holds until `publish_volume` changes them.
+     * Fails with HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER) if it is larger than the slot capacity.
+     */
+    HRESULT publish(std::nothrow_t, std::shared_ptr<const device_cache_image> image) noexcept {
+        if (!image) return E_INVALIDARG;
+        detail::shared_state_header* h = header();
+        if (image->byte_size() > h->slot_capacity) return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+        const UINT64 n = h->image_generation.load(std::memory_order_relaxed) + 1;
+        detail::shared_state_slot& slot = h->slots[n % 2];
+        // Odd even if a previous publisher died halfway through a write
+        const UINT64 sequence = slot.sequence.load(std::memory_order_relaxed) | 1;
+        slot.sequence.store(sequence, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(slot_data(n % 2), image->data(), image->byte_size());
+        slot.bytes.store(image->byte_size(), std::memory_order_relaxed);
+        slot.image_generation.store(n, std::memory_order_relaxed);
+        slot.sequence.store(sequence + 1, std::memory_order_release);
+        h->image_generation.store(n, std::memory_order_release);
+        h->generation.fetch_add(1, std::memory_order_release);
+        published = static_cast<std::shared_ptr<const device_cache_image>&&>(image);
+        return S_OK;
+    }
+
+    /**
+     * Updates the live volume of device `id`. S_FALSE if it isn't in the current image, or is beyond the volume
+     * capacity.
+     */
+    HRESULT publish_volume(std::nothrow_t, const std::wstring& id, float volume, bool muted) noexcept {
+        if (!store_volume(id, volume, muted)) return S_FALSE;
+        header()->generation.fetch_add(1, std::memory_order_release);
+        return S_OK;
+    }
+
+    // Publishes the endpoint volume events of `batch` at once. Returns how many were for devices of the current image.
+    std::size_t publish_volumes(const audio_event_batch& batch) noexcept {
+        std::size_t stored = 0;
+        for (const endpoint_volume_event& e : batch.volumes) {
+            if (store_volume(e.id, e.volume, e.muted)) ++stored;
+        }
+        if (stored) header()->generation.fetch_add(1, std::memory_order_release);
+        return stored;
+    }
+
+    // What readers poll, see `shared_state_reader::generation`
+    UINT64 generation() const noexcept {
+        return header()->generation.load(std::memory_order_relaxed);
+    }
+
+    // The last image published by this publisher, or nullptr
+    const std::shared_ptr<const device_cache_image>& current() const noexcept {
+        return published;
+    }
+
+    static constexpr UINT32 format_version = 1;
+private:
+    shared_state_publisher() noexcept = default;
+
+    bool store_volume(const std::wstring& id, float volume, bool muted) noexcept {
+        if (!published) return false;
+        detail::shared_state_header* h = header();
+        std::size_t i = published->find(id);
+        if (i == device_cache_image::npos || i >= h->volume_capacity) return false;
+        volume_words()[i].store(detail::pack_volume(volume, muted, h->image_generation.load(std::memory_order_relaxed)), std::memory_order_release);
+        return true;
+    }
+
+    detail::shared_state_header* header() const noexcept {
+        return static_cast<detail::shared_state_header*>(view);
+    }
+    std::atomic<UINT64>* volume_words() const noexcept {
+        return reinterpret_cast<std::atomic<UINT64>*>(static_cast<BYTE*>(view) + sizeof(detail::shared_state_header));
+    }
+    BYTE* slot_data(UINT64 slot) const noexcept {
+        return static_cast<BYTE*>(view) + sizeof(detail::shared_state_header) + header()->volume_capacity * sizeof(UINT64) +
+            static_cast<std::size_t>(slot * header()->slot_capacity);
+    }
+
+    HANDLE publisher_mutex = nullptr;  // Only its existence matters, see `create`
+    HANDLE mapping = nullptr;
+    void* view = nullptr;
+    std::shared_ptr<const device_cache_image> published;
+};
+
+// The state of a `shared_state_publisher`, as copied by `shared_state_reader::read`
+struct shared_device_state {
+    std::shared_ptr<const device_cache_image> devices;  // IDs, names, states and formats; nullptr until the first publication
+    std::vector<float> volumes;  // Live master volume scalars, indexed like `devices`; negative if unknown
+    std::vector<std::uint8_t> muted;  // 1 if muted
+    UINT64 generation = 0;  // See `shared_state_reader::generation`
+    UINT64 image_generation = 0;  // Changes only with `devices`
+};
+
+/**
+ * Maps the segment of a `shared_state_publisher` read-only, and reads its state without any COM call.
+ *
+ * Poll `generation()` (one atomic load); when it changed, `read` copies what changed: the device image only if a
+ * new one was published, else just the volumes, without allocating.
+ */
+struct shared_state_reader {
+    // `read` gives up after this many torn copies in a row (each one means the publisher published twice meanwhile)
+    static constexpr int max_attempts = 64;
+
+    shared_state_reader(const shared_state_reader&) = delete;
+    shared_state_reader& operator=(const shared_state_reader&) = delete;
+
+    ~shared_state_reader() {
+        if (view) UnmapViewOfFile(view);
+        if (mapping) CloseHandle(mapping);
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    static std::unique_ptr<shared_state_reader> open(LPCWSTR name) {
+        return static_cast<std::unique_ptr<shared_state_reader>&&>(*open(std::nothrow, name));
+    }
+#endif
+    /**
+     * Fails with the `OpenFileMappingW` error (ERROR_FILE_NOT_FOUND if there is no publisher yet) or
+     * `device_cache_image::invalid_file` if the segment isn't one of a compatible publisher.
+     */
+    static h_optional<std::unique_ptr<shared_state_reader>> open(std::nothrow_t, LPCWSTR name) noexcept {
+        std::unique_ptr<shared_state_reader> result(new (std::nothrow) shared_state_reader());
+        if (!result) return { E_OUTOFMEMORY, nullptr };
+        result->mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, name);
+        if (!result->mapping) return { HRESULT_FROM_WIN32(GetLastError()), nullptr };
+        result->view = MapViewOfFile(result->mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!result->view) return { HRESULT_FROM_WIN32(GetLastError()), nullptr };
+        MEMORY_BASIC_INFORMATION region;
+        if (VirtualQuery(result->view, &region, sizeof region) == 0) return { HRESULT_FROM_WIN32(GetLastError()), nullptr };
+        const detail::shared_state_header* h = result->header();
+        if (region.RegionSize < sizeof(detail::shared_state_header) ||
+            h->magic.load(std::memory_order_acquire) != detail::shared_state_magic || h->version != shared_state_publisher::format_version ||
+            h->header_bytes != sizeof(detail::shared_state_header) || h->slot_capacity % 8 != 0 ||
+            h->slot_capacity > region.RegionSize || region.RegionSize < detail::shared_state_bytes(h->volume_capacity, static_cast<std::size_t>(h->slot_capacity))) {
+            return { device_cache_image::invalid_file, nullptr };
+        }
+        result->volume_capacity = h->volume_capacity;
+        result->slot_capacity = static_cast<std::size_t>(h->slot_capacity);
+        return { S_OK, static_cast<std::unique_ptr<shared_state_reader>&&>(result) };
+    }
+
+    // Changes with everything the publisher publishes
+    UINT64 generation() const noexcept {
+        return header()->generation.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Brings `state` up to date. S_FALSE if it already was. Fails with `device_cache_image::invalid_file` if the
+     * published image doesn't validate, HRESULT_FROM_WIN32(ERROR_BUSY) after `max_attempts` torn copies, or
+     * E_OUTOFMEMORY.
+     */
+    HRESULT read(std::nothrow_t, shared_device_state& state) noexcept {
+        const detail::shared_state_header* h = header();
+        const UINT64 generation = h->generation.load(std::memory_order_acquire);
+        if (state.devices && generation == state.generation) return S_FALSE;
+
+        const UINT64 current = h->image_generation.load(std::memory_order_acquire);
+        if (current == 0) {
+            state.generation = generation;
+            return S_FALSE;
+        }
+        try {
+            if (!state.devices || current != state.image_generation) {
+                HRESULT status = read_image(state, current);
+                if (FAILED(status)) return status;
+                state.volumes.resize(state.devices->size());
+                state.muted.resize(state.devices->size());
+            }
+        } catch (const std::bad_alloc&) {
+            return E_OUTOFMEMORY;
+        }
+
+        const std::atomic<UINT64>* words = volume_words();
+        for (std::size_t i = 0; i < state.volumes.size(); ++i) {
+            float volume;
+            bool muted;
+            if (i >= volume_capacity || !detail::unpack_volume(words[i].load(std::memory_order_acquire), state.image_generation, volume, muted)) {
+                cached_device d = (*state.devices)[i];
+                volume = d.volume;
+                muted = d.muted;
+            }
+            state.volumes[i] = volume;
+            state.muted[i] = muted ? 1 : 0;
+        }
+        state.generation = generation;
+        return S_OK;
+    }
+private:
+    shared_state_reader() noexcept = default;
+
+    // Throws whatever `std::vector` throws
+    HRESULT read_image(shared_device_state& state, UINT64 current) {
+        const detail::shared_state_header* h = header();
+        for (int attempt = 0; attempt < max_attempts; ++attempt) {
+            if (attempt > 0) {
+                SwitchToThread();
+                current = h->image_generation.load(std::memory_order_acquire);
+            }
+            const detail::shared_state_slot& slot = h->slots[current % 2];
+            const UINT64 sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence & 1) continue;
+            const UINT64 image_generation = slot.image_generation.load(std::memory_order_relaxed);
+            const UINT64 bytes = slot.bytes.load(std::memory_order_relaxed);
+            if (bytes > slot_capacity) continue;
+            scratch.resize(static_cast<std::size_t>(bytes));
+            std::memcpy(scratch.data(), slot_data(current % 2), scratch.size());
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != sequence) continue;
+
+            // May be newer than `current` if the slot was written again meanwhile; it is still a whole image
+            std::shared_ptr<const device_cache_image> image = device_cache_image::copy(scratch.data(), scratch.size());
+            if (!image) return device_cache_image::invalid_file;
+            state.devices = static_cast<std::shared_ptr<const device_cache_image>&&>(image);
+            state.image_generation = image_generation;
+            return S_OK;
+        }
+        return HRESULT_FROM_WIN32(ERROR_BUSY);
+    }
+
+    const detail::shared_state_header* header() const noexcept {
+        return static_cast<const detail::shared_state_header*>(view);
+    }
+    const std::atomic<UINT64>* volume_words() const noexcept {
+        return reinterpret_cast<const std::atomic<UINT64>*>(static_cast<const BYTE*>(view) + sizeof(detail::shared_state_header));
+    }
+    const BYTE* slot_data(UINT64 slot) const noexcept {
+        return static_cast<const BYTE*>(view) + sizeof(detail::shared_state_header) + volume_capacity * sizeof(UINT64) +
+            static_cast<std::size_t>(slot) * slot_capacity;
+    }
+
+    HANDLE mapping = nullptr;
+    void* view = nullptr;
+    std::size_t volume_capacity = 0;
+    std::size_t slot_capacity = 0;
+    std::vector<BYTE> scratch;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_SHARED_STATE_H_
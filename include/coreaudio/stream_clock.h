@@ -0,0 +1,235 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_STREAM_CLOCK_H_
+#define WINDOWS_COREAUDIO_WRAPPER_STREAM_CLOCK_H_
+
+#include "windows.h"
+#include "audioclient.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <new>
+
+#include "coreaudio/device_interfaces/audio_client.h"
+#include "coreaudio/device_interfaces/audio_clock.h"
+#include "coreaudio/device_interfaces/audio_clock_adjustment.h"
+#include "coreaudio/dsp/clock_regression.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/qpc_time.h"
+#include "coreaudio/util/throw_com_error.h"
+
+
+namespace coreaudio {
+
+/**
+ * A smoothed model of a stream's clock, for A/V sync: when a given frame is (or was) heard or captured, and how far
+ * ahead of the speakers the render position is.
+ *
+ * `sample` reads `IAudioClock::GetPosition` (one COM call) and adds the reading to a filtered linear fit of stream
+ * frames against performance counter time (see `dsp::clock_regression`). Readings far off the fit are rejected;
+ * a run of them (e.g. after a glitch or `IAudioClient::Reset`) restarts the fit. Call it from one thread, e.g. once
+ * per device period from the audio thread.
+ *
+ * Every other query answers from the last published fit in constant time, without a COM call, and is safe to make
+ * from any thread concurrently with `sample`.
+ *
+ * Times are performance counter values in 100 ns units (like `audio_clock::position::qpc_position`); positions are
+ * frames at `frames_per_second`.
+ */
+struct stream_clock {
+    stream_clock(stream_clock&& other) noexcept :
+        clock(static_cast<audio_clock&&>(other.clock)), adjustment(static_cast<audio_clock_adjustment&&>(other.adjustment)),
+        frames_per_unit(other.frames_per_unit), nominal_rate(other.nominal_rate), fit(other.fit),
+        rejected_in_a_row(other.rejected_in_a_row), rejected(other.rejected.load(std::memory_order_relaxed)) {
+        publish(other.published_seconds.load(std::memory_order_relaxed));
+    }
+    stream_clock& operator=(stream_clock&&) = delete;
+
+    /**
+     * Gets `IAudioClock` (and `IAudioClockAdjustment` if the client was initialized with
+     * AUDCLNT_STREAMFLAGS_RATEADJUST) from an initialized client.
+     *
+     * @param frames_per_second The sample rate of the stream's format
+     * @param memory Readings after which a reading's weight in the fit has decayed to 1/e
+     */
+    static h_optional<stream_clock> make(const audio_client& client, DWORD frames_per_second, double memory = 128) noexcept {
+        stream_clock result(frames_per_second, memory);
+        h_optional<com_pointer<IAudioClock>> c = client.get_service<IAudioClock>(std::nothrow);
+        if (!c) return { c.get_status(), static_cast<stream_clock&&>(result) };
+        result.clock = audio_clock(c.get_unchecked().release());
+        h_optional<UINT64> frequency = result.clock.get_frequency(std::nothrow);
+        if (!frequency) return { frequency.get_status(), static_cast<stream_clock&&>(result) };
+        if (frequency.get_unchecked() == 0) return { E_UNEXPECTED, static_cast<stream_clock&&>(result) };
+        result.frames_per_unit = static_cast<double>(frames_per_second) / static_cast<double>(frequency.get_unchecked());
+        h_optional<com_pointer<IAudioClockAdjustment>> a = client.get_service<IAudioClockAdjustment>(std::nothrow);
+        if (a) result.adjustment = audio_clock_adjustment(a.get_unchecked().release());
+        return { S_OK, static_cast<stream_clock&&>(result) };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    bool sample() {
+        h_optional<bool> result = sample(std::nothrow);
+        return *result;
+    }
+#endif
+    /**
+     * Reads the stream position once and updates the fit. Returns false (with S_FALSE) if the reading was rejected
+     * as an outlier or the stream hasn't started.
+     */
+    h_optional<bool> sample(std::nothrow_t) noexcept {
+        h_optional<audio_clock::position> p = clock.get_position(std::nothrow);
+        if (!p) return { p.get_status(), false };
+        const audio_clock::position& position = p.get_unchecked();
+        if (position.device_position == 0 || position.qpc_position == 0) return { S_FALSE, false };
+        double x = static_cast<double>(position.qpc_position) * 1e-7;
+        double y = static_cast<double>(position.device_position) * frames_per_unit;
+        if (fit.ready() && fit.sample_count() >= warmup_samples) {
+            // At least a millisecond of slack so a very clean clock doesn't reject everything
+            double limit = (std::max)(outlier_sigmas * fit.residual_rms(), nominal_rate * 1e-3);
+            if (std::abs(y - fit.y_at(x)) > limit) {
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                if (++rejected_in_a_row < restart_after_rejections) return { S_FALSE, false };
+                fit.reset();
+            }
+        }
+        rejected_in_a_row = 0;
+        fit.add(x, y);
+        publish(x);
+        return { S_OK, true };
+    }
+
+    // Forgets every reading, e.g. after `IAudioClient::Stop` and `Reset`
+    void reset() noexcept {
+        fit.reset();
+        rejected_in_a_row = 0;
+        publish(0);
+    }
+
+    // Whether the queries below have a fit to answer from
+    bool ready() const noexcept {
+        return load().rate > 0;
+    }
+
+    // When stream frame `frame` is (or was) at the speakers for render, or at the microphone for capture
+    LONGLONG presentation_time(double frame) const noexcept {
+        model m = load();
+        if (!(m.rate > 0)) return 0;
+        return seconds_to_qpc(m.seconds + (frame - m.frames) / m.rate);
+    }
+
+    // Stream position at performance counter time `qpc_time`
+    double position_at(LONGLONG qpc_time) const noexcept {
+        model m = load();
+        return m.frames + (static_cast<double>(qpc_time) * 1e-7 - m.seconds) * m.rate;
+    }
+
+    /**
+     * For render: how long until the last frame written so far (the `frames_written`th) is heard, as of
+     * `qpc_time` (default: now). That is the end-to-end latency a frame written now will see.
+     */
+    LONGLONG latency(std::uint64_t frames_written, LONGLONG qpc_time = now()) const noexcept {
+        model m = load();
+        if (!(m.rate > 0)) return 0;
+        return seconds_to_qpc((static_cast<double>(frames_written) - position_at(qpc_time)) / m.rate);
+    }
+
+    // Measured frames per second of performance counter time
+    double rate() const noexcept {
+        return load().rate;
+    }
+    // Measured rate relative to the nominal rate
+    double drift_ppm() const noexcept {
+        model m = load();
+        return m.rate > 0 ? (m.rate / nominal_rate - 1.0) * 1e6 : 0.0;
+    }
+    // RMS distance of accepted readings from the fit, in frames
+    double jitter_frames() const noexcept {
+        return load().jitter;
+    }
+    std::uint64_t rejected_samples() const noexcept {
+        return rejected.load(std::memory_order_relaxed);
+    }
+
+    // Empty unless the client was initialized with AUDCLNT_STREAMFLAGS_RATEADJUST
+    const audio_clock_adjustment& get_clock_adjustment() const noexcept {
+        return adjustment;
+    }
+    const audio_clock& get_audio_clock() const noexcept {
+        return clock;
+    }
+
+    // The performance counter now, in 100 ns units
+    static LONGLONG now() noexcept {
+        return qpc_now();
+    }
+private:
+    static constexpr std::uint64_t warmup_samples = 16;
+    static constexpr double outlier_sigmas = 4.0;
+    static constexpr unsigned restart_after_rejections = 8;
+
+    struct model {
+        double seconds;  // A point on the fitted line
+        double frames;
+        double rate;  // 0 if there is no fit
+        double jitter;
+    };
+
+    stream_clock(DWORD frames_per_second, double memory) noexcept : nominal_rate(frames_per_second), fit(memory) {
+        publish(0);
+    }
+
+    static LONGLONG seconds_to_qpc(double seconds) noexcept {
+        return static_cast<LONGLONG>(std::llround(seconds * 1e7));
+    }
+
+    // Anchors the published line at `seconds` (the latest reading) so queries near now don't lose precision.
+    // Seqlock: `version` is odd while the model is being written.
+    void publish(double seconds) noexcept {
+        model m;
+        m.rate = fit.ready() ? fit.rate() : 0.0;
+        m.seconds = seconds;
+        m.frames = m.rate > 0 ? fit.y_at(seconds) : 0.0;
+        m.jitter = fit.residual_rms();
+        std::uint32_t v = version.load(std::memory_order_relaxed);
+        version.store(v + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        published_seconds.store(m.seconds, std::memory_order_relaxed);
+        published_frames.store(m.frames, std::memory_order_relaxed);
+        published_rate.store(m.rate, std::memory_order_relaxed);
+        published_jitter.store(m.jitter, std::memory_order_relaxed);
+        version.store(v + 2, std::memory_order_release);
+    }
+
+    model load() const noexcept {
+        model m;
+        for (;;) {
+            std::uint32_t before = version.load(std::memory_order_acquire);
+            m.seconds = published_seconds.load(std::memory_order_relaxed);
+            m.frames = published_frames.load(std::memory_order_relaxed);
+            m.rate = published_rate.load(std::memory_order_relaxed);
+            m.jitter = published_jitter.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (before % 2 == 0 && version.load(std::memory_order_relaxed) == before) return m;
+        }
+    }
+
+    audio_clock clock;
+    audio_clock_adjustment adjustment;
+    double frames_per_unit = 1;
+    double nominal_rate;
+
+    // Sampling thread only
+    dsp::clock_regression fit;
+    unsigned rejected_in_a_row = 0;
+    std::atomic<std::uint64_t> rejected{0};
+
+    std::atomic<std::uint32_t> version{0};
+    std::atomic<double> published_seconds{0};
+    std::atomic<double> published_frames{0};
+    std::atomic<double> published_rate{0};
+    std::atomic<double> published_jitter{0};
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_STREAM_CLOCK_H_
@@ -0,0 +1,552 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_TOPOLOGY_GRAPH_H_
+#define WINDOWS_COREAUDIO_WRAPPER_TOPOLOGY_GRAPH_H_
+
+#include "windows.h"
+#include "devicetopology.h"
+#include "propidl.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "coreaudio/device.h"
+#include "coreaudio/device_interfaces/device_topology.h"
+#include "coreaudio/util/call_observer.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/smart_pointers.h"
+
+
+namespace coreaudio {
+
+// A part (`IPart`) of a `topology_graph`
+struct topology_node {
+    PartType type;  // Connector or Subunit
+    UINT local_id;  // `IPart::GetLocalId`, unique within the node's device
+    GUID subtype;  // `IPart::GetSubType`: a KSNODETYPE_* for subunits, the pin category for connectors
+    std::uint32_t device;  // See `topology_graph::device_id`
+    std::uint32_t name;  // Offsets in the graph's strings, see `topology_graph::name` and `global_id`
+    std::uint32_t global_id;
+
+    // Connectors only
+    ConnectorType connector_type;
+    DataFlow data_flow;
+    bool connected;
+    std::uint32_t first_jack;  // See `topology_graph::jacks`
+    std::uint32_t jack_count;
+};
+
+/**
+ * The device topology behind an endpoint, crawled once: every part reachable from the endpoint's connectors,
+ * through its own topology and across connections into the adapter's, with the jack descriptions of the connectors
+ * that have them (`IKsJackDescription`).
+ *
+ * Nodes sit in one array (strings in one pool), and edges in compressed adjacency arrays both ways, so traversals
+ * make no COM calls and don't allocate. Edges follow the signal: within a device as `IPart::EnumPartsOutgoing`
+ * reports them, across a connection out of the connector whose data flow is `Out`.
+ *
+ * Immutable once crawled, so it can be read from any thread. See `topology_graph_cache` to rebuild it only when the
+ * endpoint changes.
+ */
+struct topology_graph {
+    enum class direction { downstream, upstream };
+
+    template<typename T>
+    struct range {
+        const T* first;
+        const T* last;
+
+        const T* begin() const noexcept { return first; }
+        const T* end() const noexcept { return last; }
+        std::size_t size() const noexcept { return static_cast<std::size_t>(last - first); }
+        bool empty() const noexcept { return first == last; }
+        const T& operator[](std::size_t i) const noexcept { return first[i]; }
+    };
+
+    /**
+     * Crawls from the connectors and subunits of `endpoint_topology`. Fails only if that topology can't be read;
+     * parts behind other failed calls are left out and counted in `failed_calls`.
+     * Throws whatever the standard containers throw.
+     */
+    static h_optional<topology_graph> crawl(const device_topology& endpoint_topology) {
+        topology_graph result;
+        if (!endpoint_topology.get_raw()) return { E_INVALIDARG, static_cast<topology_graph&&>(result) };
+        crawler c(result);
+
+        h_optional<task_memory_pointer<WCHAR>> id = endpoint_topology.get_device_id(std::nothrow);
+        if (!id) return { id.get_status(), static_cast<topology_graph&&>(result) };
+        std::uint32_t endpoint_device = c.intern_device(id.get_unchecked().get());
+
+        h_optional<UINT> connectors = endpoint_topology.get_connector_count(std::nothrow);
+        if (!connectors) return { connectors.get_status(), static_cast<topology_graph&&>(result) };
+        for (UINT i = 0; i < connectors.get_unchecked(); ++i) {
+            h_optional<com_pointer<IConnector>> connector = endpoint_topology.get_connector(std::nothrow, i);
+            if (!connector) {
+                ++result.failures;
+                continue;
+            }
+            c.add(c.as_part(connector.get_unchecked().get()).get(), endpoint_device);
+        }
+        result.endpoint_connectors = static_cast<std::uint32_t>(result.nodes.size());
+
+        h_optional<UINT> subunits = endpoint_topology.get_subunit_count(std::nothrow);
+        for (UINT i = 0; subunits && i < subunits.get_unchecked(); ++i) {
+            h_optional<com_pointer<ISubunit>> subunit = endpoint_topology.get_subunit(std::nothrow, i);
+            if (!subunit) {
+                ++result.failures;
+                continue;
+            }
+            c.add(c.as_part(subunit.get_unchecked().get()).get(), endpoint_device);
+        }
+
+        c.run();
+        result.build_adjacency(c.edges);
+        return { S_OK, static_cast<topology_graph&&>(result) };
+    }
+
+    // Activates the topology of `endpoint` and crawls it
+    static h_optional<topology_graph> crawl(const device& endpoint) {
+        h_optional<device_topology> topology = endpoint.activate_device_topology(std::nothrow);
+        if (!topology) return { topology.get_status(), topology_graph() };
+        return crawl(topology.get_unchecked());
+    }
+
+    std::size_t size() const noexcept {
+        return nodes.size();
+    }
+    const topology_node& node(std::size_t i) const noexcept {
+        return nodes[i];
+    }
+    LPCWSTR name(std::size_t i) const noexcept {
+        return strings.data() + nodes[i].name;
+    }
+    LPCWSTR global_id(std::size_t i) const noexcept {
+        return strings.data() + nodes[i].global_id;
+    }
+
+    // Devices whose topologies the graph spans; device 0 is the endpoint, the others are usually adapters
+    std::size_t device_count() const noexcept {
+        return devices.size();
+    }
+    LPCWSTR device_id(std::size_t device) const noexcept {
+        return strings.data() + devices[device];
+    }
+
+    // The endpoint's own connectors are nodes [0, endpoint_connector_count())
+    std::size_t endpoint_connector_count() const noexcept {
+        return endpoint_connectors;
+    }
+
+    range<std::uint32_t> outgoing(std::size_t i) const noexcept {
+        return { out_edges.data() + out_begin[i], out_edges.data() + out_begin[i + 1] };
+    }
+    range<std::uint32_t> incoming(std::size_t i) const noexcept {
+        return { in_edges.data() + in_begin[i], in_edges.data() + in_begin[i + 1] };
+    }
+    range<KSJACK_DESCRIPTION> jacks(std::size_t i) const noexcept {
+        const KSJACK_DESCRIPTION* first = jack_list.data() + nodes[i].first_jack;
+        return { first, first + nodes[i].jack_count };
+    }
+
+    // Index of the part with global ID `id`, or `npos`
+    std::size_t find_global_id(LPCWSTR id) const noexcept {
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            if (std::wcscmp(global_id(i), id) == 0) return i;
+        }
+        return npos;
+    }
+
+    /**
+     * The nearest node (in edges followed, `from` itself first) in `d` from `from` for which `p(*this, i)` is true,
+     * or `npos`.
+     */
+    template<typename Predicate>
+    std::size_t find(std::size_t from, direction d, Predicate&& p) const {
+        std::size_t found = npos;
+        breadth_first(from, d, [&](std::uint32_t i) {
+            if (!p(*this, static_cast<std::size_t>(i))) return true;
+            found = i;
+            return false;
+        });
+        return found;
+    }
+
+    // Every node reachable from `from` in `d`, nearest first, written over `out`. Throws whatever `std::vector` throws.
+    std::size_t walk(std::size_t from, direction d, std::vector<std::uint32_t>& out) const {
+        out.clear();
+        breadth_first(from, d, [&](std::uint32_t i) {
+            out.push_back(i);
+            return true;
+        });
+        return out.size();
+    }
+
+    /**
+     * The connector with jack descriptions nearest to the endpoint: downstream of its connectors (render endpoints),
+     * else upstream (capture endpoints). `npos` if the driver describes no jacks.
+     */
+    std::size_t jack_connector() const {
+        for (direction d : { direction::downstream, direction::upstream }) {
+            for (std::size_t i = 0; i < endpoint_connectors; ++i) {
+                std::size_t found = find(i, d, [](const topology_graph& g, std::size_t n) {
+                    return g.node(n).type == Connector && g.node(n).jack_count != 0;
+                });
+                if (found != npos) return found;
+            }
+        }
+        return npos;
+    }
+
+    // COM calls that failed during the crawl (other than enumerations that found nothing)
+    std::size_t failed_calls() const noexcept {
+        return failures;
+    }
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+private:
+    struct crawler {
+        struct pending {
+            com_pointer<IPart> part;
+            std::uint32_t node;
+        };
+
+        explicit crawler(topology_graph& g) noexcept : g(g) {}
+
+        std::uint32_t intern(LPCWSTR s) {
+            std::uint32_t offset = static_cast<std::uint32_t>(g.strings.size());
+            if (s) g.strings.insert(g.strings.end(), s, s + std::wcslen(s));
+            g.strings.push_back(0);
+            return offset;
+        }
+
+        std::uint32_t intern_device(LPCWSTR id) {
+            std::wstring key(id ? id : L"");
+            std::unordered_map<std::wstring, std::uint32_t>::iterator existing = device_index.find(key);
+            if (existing != device_index.end()) return existing->second;
+            std::uint32_t device = static_cast<std::uint32_t>(g.devices.size());
+            g.devices.push_back(intern(key.c_str()));
+            device_index.emplace(static_cast<std::wstring&&>(key), device);
+            return device;
+        }
+
+        template<typename I>
+        com_pointer<IPart> as_part(I* p) {
+            com_pointer<IPart> result;
+            if (!p) return result;
+            HRESULT status = detail::observe_call<default_call_observer>(p, "QueryInterface", [&] {
+                return p->QueryInterface(__uuidof(IPart), reinterpret_cast<void**>(&result.get_for_overwrite()));
+            });
+            if (FAILED(status)) ++g.failures;
+            return result;
+        }
+
+        // The node of `part` (added to the graph and queued if new), or `npos`
+        std::size_t add(IPart* part, std::uint32_t device) {
+            if (!part) return npos;
+            LPWSTR raw_id = nullptr;
+            HRESULT status = detail::observe_call<default_call_observer>(part, "GetGlobalId", [&] { return part->GetGlobalId(&raw_id); });
+            task_memory_pointer<WCHAR> id(raw_id);
+            if (FAILED(status) || !raw_id) {
+                ++g.failures;
+                return npos;
+            }
+            std::wstring key(raw_id);
+            std::unordered_map<std::wstring, std::uint32_t>::iterator existing = node_index.find(key);
+            if (existing != node_index.end()) return existing->second;
+
+            topology_node n;
+            std::memset(&n, 0, sizeof(n));
+            n.device = device;
+            n.global_id = intern(raw_id);
+            LPWSTR raw_name = nullptr;
+            if (FAILED(detail::observe_call<default_call_observer>(part, "GetName", [&] { return part->GetName(&raw_name); }))) ++g.failures;
+            task_memory_pointer<WCHAR> name(raw_name);
+            n.name = intern(raw_name);
+            if (FAILED(detail::observe_call<default_call_observer>(part, "GetLocalId", [&] { return part->GetLocalId(&n.local_id); }))) ++g.failures;
+            if (FAILED(detail::observe_call<default_call_observer>(part, "GetPartType", [&] { return part->GetPartType(&n.type); }))) ++g.failures;
+            if (FAILED(detail::observe_call<default_call_observer>(part, "GetSubType", [&] { return part->GetSubType(&n.subtype); }))) ++g.failures;
+            n.first_jack = static_cast<std::uint32_t>(g.jack_list.size());
+            if (n.type == Connector) read_connector(part, n);
+
+            std::uint32_t index = static_cast<std::uint32_t>(g.nodes.size());
+            g.nodes.push_back(n);
+            node_index.emplace(static_cast<std::wstring&&>(key), index);
+            part->AddRef();
+            queue.push_back({ com_pointer<IPart>(part), index });
+            return index;
+        }
+
+        void read_connector(IPart* part, topology_node& n) {
+            com_pointer<IConnector> connector;
+            HRESULT status = detail::observe_call<default_call_observer>(part, "QueryInterface", [&] {
+                return part->QueryInterface(__uuidof(IConnector), reinterpret_cast<void**>(&connector.get_for_overwrite()));
+            });
+            if (FAILED(status)) {
+                ++g.failures;
+                return;
+            }
+            IConnector* c = connector.get();
+            BOOL connected = FALSE;
+            if (FAILED(detail::observe_call<default_call_observer>(c, "GetType", [&] { return c->GetType(&n.connector_type); }))) ++g.failures;
+            if (FAILED(detail::observe_call<default_call_observer>(c, "GetDataFlow", [&] { return c->GetDataFlow(&n.data_flow); }))) ++g.failures;
+            if (FAILED(detail::observe_call<default_call_observer>(c, "IsConnected", [&] { return c->IsConnected(&connected); }))) ++g.failures;
+            n.connected = connected != FALSE;
+
+            // Only some connectors (typically the adapter's bridge pins) describe their jacks
+            com_pointer<IKsJackDescription> jacks;
+            status = detail::observe_call<default_call_observer>(part, "Activate", [&] {
+                return part->Activate(CLSCTX_INPROC_SERVER, __uuidof(IKsJackDescription), reinterpret_cast<void**>(&jacks.get_for_overwrite()));
+            });
+            if (FAILED(status)) return;
+            IKsJackDescription* j = jacks.get();
+            UINT count = 0;
+            if (FAILED(detail::observe_call<default_call_observer>(j, "GetJackCount", [&] { return j->GetJackCount(&count); }))) {
+                ++g.failures;
+                return;
+            }
+            for (UINT i = 0; i < count; ++i) {
+                KSJACK_DESCRIPTION description;
+                std::memset(&description, 0, sizeof(description));
+                if (FAILED(detail::observe_call<default_call_observer>(j, "GetJackDescription", [&] { return j->GetJackDescription(i, &description); }))) {
+                    ++g.failures;
+                    continue;
+                }
+                g.jack_list.push_back(description);
+                ++n.jack_count;
+            }
+        }
+
+        // Adds the parts of `list` as neighbors of `node`
+        void add_list(IPart* part, bool outgoing, std::uint32_t node, std::uint32_t device) {
+            com_pointer<IPartsList> list;
+            HRESULT status = detail::observe_call<default_call_observer>(part, outgoing ? "EnumPartsOutgoing" : "EnumPartsIncoming", [&] {
+                return outgoing ? part->EnumPartsOutgoing(&list.get_for_overwrite()) : part->EnumPartsIncoming(&list.get_for_overwrite());
+            });
+            if (status == E_NOTFOUND) return;  // No parts that way
+            if (FAILED(status)) {
+                ++g.failures;
+                return;
+            }
+            IPartsList* l = list.get();
+            UINT count = 0;
+            if (FAILED(detail::observe_call<default_call_observer>(l, "GetCount", [&] { return l->GetCount(&count); }))) {
+                ++g.failures;
+                return;
+            }
+            for (UINT i = 0; i < count; ++i) {
+                com_pointer<IPart> neighbor;
+                if (FAILED(detail::observe_call<default_call_observer>(l, "GetPart", [&] { return l->GetPart(i, &neighbor.get_for_overwrite()); }))) {
+                    ++g.failures;
+                    continue;
+                }
+                std::size_t other = add(neighbor.get(), device);
+                if (other == npos) continue;
+                if (outgoing) edges.emplace_back(node, static_cast<std::uint32_t>(other));
+                else edges.emplace_back(static_cast<std::uint32_t>(other), node);
+            }
+        }
+
+        // Follows the connection of connector `node` into the device on the other side
+        void add_connection(IPart* part, std::uint32_t node) {
+            com_pointer<IConnector> connector;
+            HRESULT queried = detail::observe_call<default_call_observer>(part, "QueryInterface", [&] {
+                return part->QueryInterface(__uuidof(IConnector), reinterpret_cast<void**>(&connector.get_for_overwrite()));
+            });
+            if (FAILED(queried)) return;
+            IConnector* c = connector.get();
+            com_pointer<IConnector> to;
+            HRESULT status = detail::observe_call<default_call_observer>(c, "GetConnectedTo", [&] { return c->GetConnectedTo(&to.get_for_overwrite()); });
+            if (FAILED(status)) {
+                ++g.failures;
+                return;
+            }
+            com_pointer<IPart> other = as_part(to.get());
+            IPart* o = other.get();
+            if (!o) return;
+
+            com_pointer<IDeviceTopology> other_topology;
+            status = detail::observe_call<default_call_observer>(o, "GetTopologyObject", [&] { return o->GetTopologyObject(&other_topology.get_for_overwrite()); });
+            if (FAILED(status)) {
+                ++g.failures;
+                return;
+            }
+            IDeviceTopology* t = other_topology.get();
+            LPWSTR raw_id = nullptr;
+            status = detail::observe_call<default_call_observer>(t, "GetDeviceId", [&] { return t->GetDeviceId(&raw_id); });
+            task_memory_pointer<WCHAR> id(raw_id);
+            if (FAILED(status)) {
+                ++g.failures;
+                return;
+            }
+
+            std::size_t index = add(o, intern_device(raw_id));
+            if (index == npos) return;
+            std::uint32_t to_node = static_cast<std::uint32_t>(index);
+            if (g.nodes[node].data_flow == Out) edges.emplace_back(node, to_node);
+            else edges.emplace_back(to_node, node);
+        }
+
+        void run() {
+            // `queue` grows while it is walked
+            for (std::size_t i = 0; i < queue.size(); ++i) {
+                com_pointer<IPart> part = static_cast<com_pointer<IPart>&&>(queue[i].part);
+                std::uint32_t node = queue[i].node;
+                std::uint32_t device = g.nodes[node].device;
+                add_list(part.get(), true, node, device);
+                add_list(part.get(), false, node, device);
+                if (g.nodes[node].type == Connector && g.nodes[node].connected) add_connection(part.get(), node);
+            }
+        }
+
+        topology_graph& g;
+        std::vector<pending> queue;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> edges;
+        std::unordered_map<std::wstring, std::uint32_t> node_index;
+        std::unordered_map<std::wstring, std::uint32_t> device_index;
+    };
+
+    void build_adjacency(std::vector<std::pair<std::uint32_t, std::uint32_t>>& edges) {
+        // Each edge is usually seen from both ends
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        std::size_t n = nodes.size();
+        out_begin.assign(n + 1, 0);
+        in_begin.assign(n + 1, 0);
+        for (const std::pair<std::uint32_t, std::uint32_t>& e : edges) {
+            ++out_begin[e.first + 1];
+            ++in_begin[e.second + 1];
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            out_begin[i + 1] += out_begin[i];
+            in_begin[i + 1] += in_begin[i];
+        }
+        out_edges.resize(edges.size());
+        in_edges.resize(edges.size());
+        std::vector<std::uint32_t> out_at(out_begin.begin(), out_begin.end() - 1);
+        std::vector<std::uint32_t> in_at(in_begin.begin(), in_begin.end() - 1);
+        for (const std::pair<std::uint32_t, std::uint32_t>& e : edges) {
+            out_edges[out_at[e.first]++] = e.second;
+            in_edges[in_at[e.second]++] = e.first;
+        }
+    }
+
+    // Calls `visit(i)` for each node reachable from `from`, nearest first, until it returns false
+    template<typename Visit>
+    void breadth_first(std::size_t from, direction d, Visit&& visit) const {
+        std::size_t n = nodes.size();
+        if (from >= n) return;
+        // Marks on the stack for any realistic graph
+        std::uint64_t small[16] = {};
+        std::vector<std::uint64_t> large;
+        std::uint64_t* seen = small;
+        std::uint32_t small_queue[1024];
+        std::vector<std::uint32_t> large_queue;
+        std::uint32_t* queue = small_queue;
+        if (n > 1024) {
+            large.assign((n + 63) / 64, 0);
+            seen = large.data();
+            large_queue.resize(n);
+            queue = large_queue.data();
+        }
+
+        const std::vector<std::uint32_t>& begin = d == direction::downstream ? out_begin : in_begin;
+        const std::vector<std::uint32_t>& targets = d == direction::downstream ? out_edges : in_edges;
+        std::size_t head = 0;
+        std::size_t tail = 0;
+        queue[tail++] = static_cast<std::uint32_t>(from);
+        seen[from / 64] |= std::uint64_t(1) << (from % 64);
+        while (head < tail) {
+            std::uint32_t i = queue[head++];
+            if (!visit(i)) return;
+            for (std::uint32_t e = begin[i]; e < begin[i + 1]; ++e) {
+                std::uint32_t next = targets[e];
+                std::uint64_t bit = std::uint64_t(1) << (next % 64);
+                if (seen[next / 64] & bit) continue;
+                seen[next / 64] |= bit;
+                queue[tail++] = next;
+            }
+        }
+    }
+
+    std::vector<topology_node> nodes;
+    std::vector<WCHAR> strings;
+    std::vector<std::uint32_t> devices;  // Offsets of the device IDs in `strings`
+    std::vector<KSJACK_DESCRIPTION> jack_list;
+    std::vector<std::uint32_t> out_begin;
+    std::vector<std::uint32_t> out_edges;
+    std::vector<std::uint32_t> in_begin;
+    std::vector<std::uint32_t> in_edges;
+    std::uint32_t endpoint_connectors = 0;
+    std::size_t failures = 0;
+};
+
+/**
+ * The `topology_graph` of one endpoint, crawled again only after the endpoint changed.
+ *
+ * Forward `IMMNotificationClient::OnDeviceStateChanged` and `OnPropertyValueChanged` to the handlers below (these are
+ * thread-safe): a state change (like a jack being unplugged) or a property change of the endpoint invalidates the
+ * graph. Everything else is not thread-safe.
+ */
+struct topology_graph_cache {
+    // Throws whatever `std::wstring` throws
+    explicit topology_graph_cache(std::wstring device_id) : device_id(static_cast<std::wstring&&>(device_id)) {}
+
+    topology_graph_cache(const topology_graph_cache&) = delete;
+    topology_graph_cache& operator=(const topology_graph_cache&) = delete;
+
+    /**
+     * The graph of `endpoint` (this cache's device), crawled if this is the first call or the cache was invalidated
+     * since. Valid until the next call. Throws whatever the standard containers throw.
+     */
+    h_optional<const topology_graph*> get(std::nothrow_t, const device& endpoint) {
+        unsigned long current = invalidations.load(std::memory_order_acquire);
+        if (built && current == seen_invalidations) return { S_OK, &graph };
+        h_optional<topology_graph> fresh = topology_graph::crawl(endpoint);
+        if (!fresh) return { fresh.get_status(), nullptr };
+        graph = static_cast<topology_graph&&>(fresh.get_unchecked());
+        built = true;
+        seen_invalidations = current;
+        return { S_OK, &graph };
+    }
+
+    // Thread-safe. The graph is crawled again the next time it is used.
+    void invalidate() noexcept {
+        invalidations.fetch_add(1, std::memory_order_release);
+    }
+
+    // Thread-safe. Returns true if this invalidated the cache.
+    bool on_device_state_changed(LPCWSTR changed_device_id, DWORD) noexcept {
+        if (!changed_device_id || device_id != changed_device_id) return false;
+        invalidate();
+        return true;
+    }
+
+    // Thread-safe. Returns true if this invalidated the cache.
+    bool on_property_value_changed(LPCWSTR changed_device_id, const PROPERTYKEY&) noexcept {
+        if (!changed_device_id || device_id != changed_device_id) return false;
+        invalidate();
+        return true;
+    }
+
+    const std::wstring& id() const noexcept {
+        return device_id;
+    }
+private:
+    const std::wstring device_id;
+    topology_graph graph;
+    bool built = false;
+    std::atomic<unsigned long> invalidations{0};
+    unsigned long seen_invalidations = 0;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_TOPOLOGY_GRAPH_H_
@@ -0,0 +1,137 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_AGILE_REFERENCE_H_
+#define WINDOWS_COREAUDIO_WRAPPER_AGILE_REFERENCE_H_
+
+#include "combaseapi.h"
+#include "objidl.h"
+#include "unknwn.h"
+
+#include <new>
+
+#include "coreaudio/util/call_observer.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/smart_pointers.h"
+
+
+namespace coreaudio {
+
+namespace detail {
+
+// Wraps `p` (taking its reference): through `Wrapper::make` if the wrapper reads something when it is made (like
+// `device_collection`'s count), else through its constructor
+template<typename Wrapper>
+auto adopt_interface(typename Wrapper::raw_interface* p, int) noexcept -> decltype(Wrapper::make(p)) {
+    return Wrapper::make(p);
+}
+template<typename Wrapper>
+h_optional<Wrapper> adopt_interface(typename Wrapper::raw_interface* p, long) noexcept {
+    return { S_OK, Wrapper(p) };
+}
+
+}
+
+/**
+ * Holds the interface of a wrapper (like `device` or `endpoint_volume`) so that it can be used from another
+ * apartment: `resolve` gives a new wrapper that is valid on the calling thread.
+ *
+ * If the object is agile (`IAgileObject`), the same pointer is handed out. Otherwise it is registered in the global
+ * interface table, and `resolve` gets from it whatever is valid in the calling apartment: the original pointer in the
+ * apartment it came from, a proxy elsewhere (so that apartment must keep pumping messages, if it is an STA, for calls
+ * through the proxy to complete). An interface obtained in the MTA is marshaled too, since it may be a proxy that
+ * an STA can't call directly.
+ *
+ * Make it and destroy it on threads with COM initialized.
+ */
+template<typename Wrapper>
+struct agile_reference {
+    using raw_interface = typename Wrapper::raw_interface;
+
+    constexpr agile_reference() noexcept = default;
+    agile_reference(agile_reference&& other) noexcept :
+        direct(static_cast<com_pointer<raw_interface>&&>(other.direct)),
+        table(static_cast<com_pointer<IGlobalInterfaceTable>&&>(other.table)), cookie(other.cookie) {
+        other.cookie = 0;
+    }
+    agile_reference& operator=(agile_reference&& other) noexcept {
+        if (this != &other) {
+            revoke();
+            direct = static_cast<com_pointer<raw_interface>&&>(other.direct);
+            table = static_cast<com_pointer<IGlobalInterfaceTable>&&>(other.table);
+            cookie = other.cookie;
+            other.cookie = 0;
+        }
+        return *this;
+    }
+
+    ~agile_reference() {
+        revoke();
+    }
+
+    // A null `w` makes a reference that resolves to a null wrapper
+    static h_optional<agile_reference> make(const Wrapper& w) noexcept {
+        agile_reference result;
+        raw_interface* raw = w.get_raw();
+        if (!raw) return { S_OK, static_cast<agile_reference&&>(result) };
+        if (!needs_marshaling(raw)) {
+            raw->AddRef();
+            result.direct.reset(raw);
+            return { S_OK, static_cast<agile_reference&&>(result) };
+        }
+        HRESULT status = detail::observe_call<default_call_observer>(static_cast<IGlobalInterfaceTable*>(nullptr), "CoCreateInstance", [&] {
+            return CoCreateInstance(__uuidof(StdGlobalInterfaceTable), nullptr, CLSCTX_INPROC_SERVER, __uuidof(IGlobalInterfaceTable),
+                                    reinterpret_cast<void**>(&result.table.get_for_overwrite()));
+        });
+        if (FAILED(status)) return { status, static_cast<agile_reference&&>(result) };
+        IGlobalInterfaceTable* git = result.table.get();
+        status = detail::observe_call<default_call_observer>(git, "RegisterInterfaceInGlobal", [&] {
+            return git->RegisterInterfaceInGlobal(raw, __uuidof(raw_interface), &result.cookie);
+        });
+        if (FAILED(status)) result.cookie = 0;
+        return { status, static_cast<agile_reference&&>(result) };
+    }
+
+    // A wrapper usable on the calling thread. Can be called any number of times, from any apartment.
+    h_optional<Wrapper> resolve(std::nothrow_t) const noexcept {
+        if (direct) {
+            direct.get()->AddRef();
+            return detail::adopt_interface<Wrapper>(direct.get(), 0);
+        }
+        if (!cookie) return { S_OK, Wrapper() };
+        IGlobalInterfaceTable* git = table.get();
+        raw_interface* raw = nullptr;
+        HRESULT status = detail::observe_call<default_call_observer>(git, "GetInterfaceFromGlobal", [&] {
+            return git->GetInterfaceFromGlobal(cookie, __uuidof(raw_interface), reinterpret_cast<void**>(&raw));
+        });
+        if (FAILED(status)) return { status, Wrapper() };
+        return detail::adopt_interface<Wrapper>(raw, 0);
+    }
+
+    // Whether `resolve` gives a proxy rather than the original pointer
+    bool is_marshaled() const noexcept {
+        return cookie != 0;
+    }
+private:
+    static bool needs_marshaling(raw_interface* raw) noexcept {
+        IAgileObject* agile = nullptr;
+        if (SUCCEEDED(raw->QueryInterface(__uuidof(IAgileObject), reinterpret_cast<void**>(&agile))) && agile) {
+            agile->Release();
+            return false;
+        }
+        return true;
+    }
+
+    void revoke() noexcept {
+        if (cookie) {
+            IGlobalInterfaceTable* git = table.get();
+            detail::observe_call<default_call_observer>(git, "RevokeInterfaceFromGlobal", [&] { return git->RevokeInterfaceFromGlobal(cookie); });
+            cookie = 0;
+        }
+    }
+
+    com_pointer<raw_interface> direct;
+    com_pointer<IGlobalInterfaceTable> table;
+    DWORD cookie = 0;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_AGILE_REFERENCE_H_
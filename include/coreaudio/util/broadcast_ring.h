@@ -0,0 +1,204 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_BROADCAST_RING_H_
+#define WINDOWS_COREAUDIO_WRAPPER_BROADCAST_RING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "coreaudio/util/call_observer.h"
+
+
+namespace coreaudio {
+
+/**
+ * Single-writer, multi-reader ring of variable-size packets. The writer never waits for readers: a reader that falls
+ * more than the ring behind skips ahead to the oldest packet still in the ring and counts the skipped packets.
+ *
+ * Readers get pointers into the ring (no copy). Because the writer may overwrite a packet while it is being read
+ * (only if the reader is slow enough to be lapped), `reader::release` tells whether the packet stayed intact; if it
+ * returns false, discard whatever was computed from it. This is the reader side of a seqlock.
+ *
+ * Shared by `std::shared_ptr` between the writer and any number of `reader`s, so it lives as long as any of them.
+ */
+struct broadcast_ring {
+    struct packet {
+        const unsigned char* data;
+        std::size_t bytes;
+        std::uint32_t frames;
+        std::uint32_t flags;
+        std::uint64_t device_position;
+        std::uint64_t qpc_position;
+        std::uint64_t sequence;  // 0 for the first packet written
+    };
+
+    /**
+     * Throws whatever `std::vector` throws (usually `std::bad_alloc`).
+     *
+     * @param data_bytes Total size of the packet data. A packet can't be larger than this.
+     * @param max_packets Maximum number of packets in the ring at once
+     */
+    static std::shared_ptr<broadcast_ring> make(std::size_t data_bytes, std::size_t max_packets) {
+        return std::shared_ptr<broadcast_ring>(new broadcast_ring(data_bytes, max_packets == 0 ? 1 : max_packets));
+    }
+
+    broadcast_ring(const broadcast_ring&) = delete;
+    broadcast_ring& operator=(const broadcast_ring&) = delete;
+
+    /**
+     * Writer only. Returns where to write a packet of `bytes` bytes, then call `commit_write`.
+     * Returns nullptr if `bytes` is larger than the ring.
+     */
+    unsigned char* begin_write(std::size_t bytes) noexcept {
+        if (bytes > data.size()) return nullptr;
+        std::uint64_t sequence = written.load(std::memory_order_relaxed);
+        // Packets are contiguous, so a packet that doesn't fit before the end starts at 0
+        std::size_t offset = write_offset + bytes > data.size() ? 0 : write_offset;
+        std::uint64_t first = oldest.load(std::memory_order_relaxed);
+        // The slot of `sequence` is the one of `sequence - slots.size()`
+        if (sequence - first >= slots.size()) first = sequence - slots.size() + 1;
+        // `oldest` means every packet from it on is intact, so drop everything up to the newest packet the new
+        // one overlaps. After a wrap that can be a newer packet at the front while older ones at the end survive.
+        for (std::uint64_t k = first; k < sequence; ++k) {
+            const slot& s = slots[k % slots.size()];
+            std::size_t begin = static_cast<std::size_t>(s.offset.load(std::memory_order_relaxed));
+            std::size_t end = begin + static_cast<std::size_t>(s.bytes.load(std::memory_order_relaxed));
+            if (begin < offset + bytes && offset < end) first = k + 1;
+        }
+        // Readers that see any of the new data also see that the packets it replaces are gone
+        oldest.store(first, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        pending_offset = offset;
+        pending_bytes = bytes;
+        return data.data() + offset;
+    }
+
+    // Writer only. Publishes the packet started by `begin_write`.
+    void commit_write(std::uint32_t frames, std::uint32_t flags, std::uint64_t device_position, std::uint64_t qpc_position) noexcept {
+        std::uint64_t sequence = written.load(std::memory_order_relaxed);
+        slot& s = slots[sequence % slots.size()];
+        s.offset.store(pending_offset, std::memory_order_relaxed);
+        s.bytes.store(pending_bytes, std::memory_order_relaxed);
+        s.frames_and_flags.store(static_cast<std::uint64_t>(frames) << 32 | flags, std::memory_order_relaxed);
+        s.device_position.store(device_position, std::memory_order_relaxed);
+        s.qpc_position.store(qpc_position, std::memory_order_relaxed);
+        write_offset = pending_offset + pending_bytes;
+        written.store(sequence + 1, std::memory_order_release);
+    }
+
+    // Number of packets written so far
+    std::uint64_t packets_written() const noexcept {
+        return written.load(std::memory_order_acquire);
+    }
+
+    /**
+     * One consumer's position in the ring. Starts at the next packet to be written. Not thread-safe (use one reader
+     * per consumer thread), but readers are independent of each other.
+     */
+    struct reader {
+        reader() noexcept = default;
+        explicit reader(std::shared_ptr<broadcast_ring> ring) noexcept :
+            ring(static_cast<std::shared_ptr<broadcast_ring>&&>(ring)),
+            next(this->ring ? this->ring->packets_written() : 0) {}
+
+        /**
+         * Gets the next packet without copying it. Returns false if there is none yet.
+         * Call `release` when done with it before acquiring another.
+         */
+        bool acquire(packet& out) noexcept {
+            if (!ring) return false;
+            for (;;) {
+                if (next == ring->written.load(std::memory_order_acquire)) return false;
+                skip_to_oldest();
+                const slot& s = ring->slots[next % ring->slots.size()];
+                std::uint64_t frames_and_flags = s.frames_and_flags.load(std::memory_order_relaxed);
+                out.data = ring->data.data() + s.offset.load(std::memory_order_relaxed);
+                out.bytes = static_cast<std::size_t>(s.bytes.load(std::memory_order_relaxed));
+                out.frames = static_cast<std::uint32_t>(frames_and_flags >> 32);
+                out.flags = static_cast<std::uint32_t>(frames_and_flags);
+                out.device_position = s.device_position.load(std::memory_order_relaxed);
+                out.qpc_position = s.qpc_position.load(std::memory_order_relaxed);
+                out.sequence = next;
+                // The slot itself may have been reused while reading it
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (ring->oldest.load(std::memory_order_relaxed) <= next) return true;
+            }
+        }
+
+        /**
+         * Finishes with a packet from `acquire`. Returns false (and counts an overrun) if the writer overwrote it in
+         * the meantime, in which case whatever was read from it is garbage.
+         */
+        bool release(const packet& p) noexcept {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            next = p.sequence + 1;
+            if (ring->oldest.load(std::memory_order_relaxed) > p.sequence) {
+                ++overruns;
+                ++lost;
+                detail::count_event("ring_packets_lost");
+                return false;
+            }
+            return true;
+        }
+
+        // Skips everything written so far
+        void seek_to_end() noexcept {
+            if (ring) next = ring->packets_written();
+        }
+
+        // Packets written but not yet read
+        std::uint64_t lag() const noexcept {
+            return ring ? ring->packets_written() - next : 0;
+        }
+        // Number of times the writer lapped this reader
+        std::uint64_t overrun_count() const noexcept {
+            return overruns;
+        }
+        // Packets skipped or torn because of overruns
+        std::uint64_t lost_packets() const noexcept {
+            return lost;
+        }
+        const std::shared_ptr<broadcast_ring>& get_ring() const noexcept {
+            return ring;
+        }
+    private:
+        void skip_to_oldest() noexcept {
+            std::uint64_t first = ring->oldest.load(std::memory_order_relaxed);
+            if (next < first) {
+                ++overruns;
+                lost += first - next;
+                detail::count_event("ring_packets_lost", first - next);
+                next = first;
+            }
+        }
+
+        std::shared_ptr<broadcast_ring> ring;
+        std::uint64_t next = 0;
+        std::uint64_t overruns = 0;
+        std::uint64_t lost = 0;
+    };
+private:
+    broadcast_ring(std::size_t data_bytes, std::size_t max_packets) : data(data_bytes), slots(max_packets) {}
+
+    struct slot {
+        std::atomic<std::uint64_t> offset{0};
+        std::atomic<std::uint64_t> bytes{0};
+        std::atomic<std::uint64_t> frames_and_flags{0};
+        std::atomic<std::uint64_t> device_position{0};
+        std::atomic<std::uint64_t> qpc_position{0};
+    };
+
+    std::vector<unsigned char> data;
+    std::vector<slot> slots;
+    std::atomic<std::uint64_t> written{0};  // Sequence of the next packet
+    std::atomic<std::uint64_t> oldest{0};  // Sequence of the oldest packet that is still intact
+    // Writer only
+    std::size_t write_offset = 0;
+    std::size_t pending_offset = 0;
+    std::size_t pending_bytes = 0;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_BROADCAST_RING_H_
@@ -0,0 +1,87 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_CALL_OBSERVER_H_
+#define WINDOWS_COREAUDIO_WRAPPER_CALL_OBSERVER_H_
+
+#include "winerror.h"
+
+#include <cstdint>
+
+
+namespace coreaudio {
+
+/**
+ * The default call observer. Every hook is empty and inline, so an observed call compiles to just the COM call.
+ *
+ * A call observer is any type with these static member functions, where `Interface` is the raw COM interface being
+ * called (`p` may be null for calls like `CoCreateInstance` that create the interface) and `name` is a string literal
+ * naming the COM method (like "GetId"):
+ *
+ * static token before_call(Interface* p, const char* name) noexcept;
+ * static void after_call(const token&, Interface* p, const char* name, HRESULT status) noexcept;
+ *
+ * `token` can be any type (e.g. a timestamp to measure latency with). `after_call` is not called if the call throws
+ * (The throwing wrapper functions throw `_com_error(E_INVALIDARG)` before calling through a null interface).
+ *
+ * It may also have the following, which the library calls (through `detail::count_event`) for events other than
+ * calls: notifications received, capture discontinuities, packets lost or dropped, ... `name` is a string literal.
+ *
+ * static void count_event(const char* name, std::uint64_t n) noexcept;
+ *
+ * To install an observer for `device`, `device_enumerator`, `device_collection` and `endpoint_volume`, define
+ * `COREAUDIO_CALL_OBSERVER` as its (fully qualified) type name before including any coreaudio header. It must be
+ * defined the same way in every translation unit. `metrics_call_observer` (coreaudio/util/metrics.h) is one.
+ */
+struct null_call_observer {
+    struct token {};
+
+    template<typename Interface>
+    static constexpr token before_call(Interface*, const char*) noexcept { return {}; }
+    template<typename Interface>
+    static constexpr void after_call(const token&, Interface*, const char*, HRESULT) noexcept {}
+};
+
+namespace detail {
+
+template<typename Observer, typename Interface, typename F>
+inline HRESULT observe_call(Interface* p, const char* name, F&& f) noexcept(noexcept(f())) {
+    auto token = Observer::before_call(p, name);
+    HRESULT status = f();
+    Observer::after_call(token, p, name, status);
+    return status;
+}
+
+}
+}
+
+#ifndef COREAUDIO_CALL_OBSERVER
+#define COREAUDIO_CALL_OBSERVER ::coreaudio::null_call_observer
+#endif
+
+namespace coreaudio {
+
+using default_call_observer = COREAUDIO_CALL_OBSERVER;
+
+namespace detail {
+
+template<typename Observer, typename = void>
+struct observer_event_counter {
+    static void add(const char*, std::uint64_t) noexcept {}
+};
+
+template<typename Observer>
+struct observer_event_counter<Observer, decltype(Observer::count_event("", std::uint64_t()))> {
+    static void add(const char* name, std::uint64_t n) noexcept {
+        Observer::count_event(name, n);
+    }
+};
+
+// Counts `n` events `name` with `Observer::count_event`, or does nothing if the observer doesn't count events
+template<typename Observer = default_call_observer>
+inline void count_event(const char* name, std::uint64_t n = 1) noexcept {
+    observer_event_counter<Observer>::add(name, n);
+}
+
+}
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_CALL_OBSERVER_H_
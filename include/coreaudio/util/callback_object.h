@@ -0,0 +1,51 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_CALLBACK_OBJECT_H_
+#define WINDOWS_COREAUDIO_WRAPPER_CALLBACK_OBJECT_H_
+
+#include "unknwn.h"
+
+#include <atomic>
+
+
+namespace coreaudio {
+
+/**
+ * Implements `IUnknown` (`QueryInterface` for `IUnknown` and `I`, and thread-safe reference counting) for a COM
+ * object implementing the single interface `I`, such as a notification callback. Derive from this and implement
+ * the methods of `I`.
+ *
+ * Allocate with `new`. Starts with a reference count of 1, owned by the creator (so it can be adopted with
+ * `com_pointer<I>(new T(...))`), and deletes itself when the count reaches 0.
+ */
+template<typename I>
+struct callback_object : I {
+    callback_object() noexcept = default;
+    callback_object(const callback_object&) = delete;
+    callback_object& operator=(const callback_object&) = delete;
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppv) override {
+        if (!ppv) return E_POINTER;
+        if (riid == __uuidof(IUnknown) || riid == __uuidof(I)) {
+            *ppv = static_cast<I*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppv = nullptr;
+        return E_NOINTERFACE;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() override {
+        return ++ref_count;
+    }
+    ULONG STDMETHODCALLTYPE Release() override {
+        ULONG count = --ref_count;
+        if (count == 0) delete this;
+        return count;
+    }
+protected:
+    virtual ~callback_object() = default;
+private:
+    std::atomic<ULONG> ref_count{1};
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_CALLBACK_OBJECT_H_
@@ -0,0 +1,241 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_COM_REF_H_
+#define WINDOWS_COREAUDIO_WRAPPER_COM_REF_H_
+
+#include "windows.h"
+#include "combaseapi.h"
+#include "unknwn.h"
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "coreaudio/util/call_observer.h"
+#include "coreaudio/util/h_result.h"
+#include "coreaudio/util/smart_pointers.h"
+#include "coreaudio/util/throw_com_error.h"
+
+namespace coreaudio {
+
+/**
+ * A copyable (`AddRef`ing) reference to a COM object, that remembers the other interfaces it was asked for.
+ *
+ * `as<U>()` runs `QueryInterface` the first time and `activated<U>()` runs `Activate` (for objects that have it, like
+ * `IMMDevice`) the first time; after that they return the same pointer without any COM call. The first
+ * `cache_slots` interfaces are kept inline, later ones in a vector. The pointers they return are borrowed: valid as
+ * long as this reference (or a copy of it, which shares them) lives.
+ *
+ * Copies share the cached interfaces (one `AddRef` each), so a subsystem that copies a resolved reference doesn't
+ * resolve it again. Not thread-safe: give each thread its own copy.
+ *
+ * @tparam T The COM interface type
+ */
+template<typename T = IUnknown>
+struct com_ref {
+    static_assert(!std::is_const<T>::value && !std::is_volatile<T>::value, "com_ref: T must not be const or volatile");
+    static_assert(std::is_convertible<T*, IUnknown*>::value, "com_ref: T must publically and unambiguously inherit from IUnknown");
+
+    static constexpr std::size_t cache_slots = 4;
+
+    com_ref() noexcept = default;
+    com_ref(std::nullptr_t) noexcept {}
+    // Adopts `p`'s reference, like `com_pointer<T>(p)`
+    explicit com_ref(T* p) noexcept : p(p) {}
+    explicit com_ref(com_pointer<T>&& other) noexcept : p(other.release()) {}
+
+    // Takes a new reference to `p`
+    static com_ref share(T* p) noexcept {
+        if (p) p->AddRef();
+        return com_ref(p);
+    }
+    // Takes a new reference to the interface of a wrapper (`device`, `endpoint_volume`, ...)
+    template<typename Wrapper>
+    static com_ref share(const Wrapper& w) noexcept {
+        static_assert(std::is_same<typename Wrapper::raw_interface, T>::value, "com_ref::share: the wrapper must hold a T");
+        return share(w.get_raw());
+    }
+
+    // Throws whatever `std::vector` throws if `other` has more than `cache_slots` cached interfaces
+    com_ref(const com_ref& other) : p(other.p), used(other.used), overflow(other.overflow) {
+        if (p) p->AddRef();
+        for (std::size_t i = 0; i < used; ++i) {
+            slots[i] = other.slots[i];
+            slots[i].p->AddRef();
+        }
+        for (entry& e : overflow) e.p->AddRef();
+    }
+    com_ref(com_ref&& other) noexcept : p(other.p), used(other.used), overflow(static_cast<std::vector<entry>&&>(other.overflow)) {
+        for (std::size_t i = 0; i < used; ++i) slots[i] = other.slots[i];
+        other.p = nullptr;
+        other.used = 0;
+        other.overflow.clear();
+    }
+
+    com_ref& operator=(const com_ref& other) {
+        com_ref copy(other);
+        swap(copy);
+        return *this;
+    }
+    com_ref& operator=(com_ref&& other) noexcept {
+        com_ref moved(static_cast<com_ref&&>(other));
+        swap(moved);
+        return *this;
+    }
+
+    ~com_ref() noexcept {
+        reset();
+    }
+
+    void reset() noexcept {
+        for (std::size_t i = 0; i < used; ++i) slots[i].p->Release();
+        used = 0;
+        for (entry& e : overflow) e.p->Release();
+        overflow.clear();
+        if (p) p->Release();
+        p = nullptr;
+    }
+
+    void swap(com_ref& other) noexcept {
+        // Slots are small PODs, so swap them all
+        entry tmp[cache_slots];
+        std::memcpy(tmp, slots, sizeof(slots));
+        std::memcpy(slots, other.slots, sizeof(slots));
+        std::memcpy(other.slots, tmp, sizeof(slots));
+        std::size_t u = used;
+        used = other.used;
+        other.used = u;
+        T* q = p;
+        p = other.p;
+        other.p = q;
+        overflow.swap(other.overflow);
+    }
+
+    constexpr T* get() const noexcept {
+        return p;
+    }
+    constexpr explicit operator bool() const noexcept {
+        return p != nullptr;
+    }
+    // A new reference to the interface, for adopting into a wrapper: `device(r.add_ref())`
+    T* add_ref() const noexcept {
+        if (p) p->AddRef();
+        return p;
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    T* operator->() const {
+        if (!p) throw _com_error(E_INVALIDARG);
+        return p;
+    }
+
+    template<typename U>
+    U* as() const {
+        h_result<U*> r = as<U>(std::nothrow);
+        throw_com_error(r.get_status());
+        return r.get_unchecked();
+    }
+#endif
+    /**
+     * The object's `U` interface (borrowed, see above), from `QueryInterface` the first time.
+     * E_INVALIDARG if there is no object.
+     */
+    template<typename U>
+    h_result<U*> as(std::nothrow_t) const noexcept {
+        if (std::is_same<T, U>::value) return { p ? S_OK : E_INVALIDARG, reinterpret_cast<U*>(p) };
+        if (!p) return { E_INVALIDARG, nullptr };
+        const GUID iid = __uuidof(U);
+        if (IUnknown* cached = find(iid, false)) return { S_OK, static_cast<U*>(cached) };
+        U* result = nullptr;
+        HRESULT status = detail::observe_call<default_call_observer>(p, "QueryInterface", [&] {
+            return p->QueryInterface(iid, reinterpret_cast<void**>(&result));
+        });
+        if (FAILED(status)) return { status, nullptr };
+        status = remember(iid, false, result);
+        return { status, SUCCEEDED(status) ? result : nullptr };
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    template<typename U>
+    U* activated(DWORD class_ctx = CLSCTX_ALL) const {
+        h_result<U*> r = activated<U>(std::nothrow, class_ctx);
+        throw_com_error(r.get_status());
+        return r.get_unchecked();
+    }
+#endif
+    /**
+     * The `U` interface from `T::Activate` (e.g. `IAudioEndpointVolume` of an `IMMDevice`), activated the first time
+     * with `class_ctx` and no activation parameters, then borrowed like `as`. E_INVALIDARG if there is no object.
+     */
+    template<typename U>
+    h_result<U*> activated(std::nothrow_t, DWORD class_ctx = CLSCTX_ALL) const noexcept {
+        if (!p) return { E_INVALIDARG, nullptr };
+        const GUID iid = __uuidof(U);
+        if (IUnknown* cached = find(iid, true)) return { S_OK, static_cast<U*>(cached) };
+        U* result = nullptr;
+        HRESULT status = detail::observe_call<default_call_observer>(p, "Activate", [&] {
+            return p->Activate(iid, class_ctx, nullptr, reinterpret_cast<void**>(&result));
+        });
+        if (FAILED(status)) return { status, nullptr };
+        status = remember(iid, true, result);
+        return { status, SUCCEEDED(status) ? result : nullptr };
+    }
+
+    // Releases the cached interfaces (e.g. an activated interface that was invalidated), keeping the object
+    void forget() noexcept {
+        for (std::size_t i = 0; i < used; ++i) slots[i].p->Release();
+        used = 0;
+        for (entry& e : overflow) e.p->Release();
+        overflow.clear();
+    }
+
+    // Interfaces cached by `as` and `activated`
+    std::size_t cached() const noexcept {
+        return used + overflow.size();
+    }
+
+    friend bool operator==(const com_ref& l, const com_ref& r) noexcept { return l.p == r.p; }
+    friend bool operator!=(const com_ref& l, const com_ref& r) noexcept { return l.p != r.p; }
+private:
+    struct entry {
+        GUID iid;
+        IUnknown* p;  // Owns a reference
+        bool activated;  // From `Activate` rather than `QueryInterface`
+    };
+
+    IUnknown* find(const GUID& iid, bool activated) const noexcept {
+        for (std::size_t i = 0; i < used; ++i) {
+            if (slots[i].activated == activated && std::memcmp(&slots[i].iid, &iid, sizeof(GUID)) == 0) return slots[i].p;
+        }
+        for (const entry& e : overflow) {
+            if (e.activated == activated && std::memcmp(&e.iid, &iid, sizeof(GUID)) == 0) return e.p;
+        }
+        return nullptr;
+    }
+
+    // Takes `q`'s reference (releasing it on failure)
+    template<typename U>
+    HRESULT remember(const GUID& iid, bool activated, U* q) const noexcept {
+        IUnknown* unknown = q;
+        if (used < cache_slots) {
+            slots[used++] = { iid, unknown, activated };
+            return S_OK;
+        }
+        try {
+            overflow.push_back({ iid, unknown, activated });
+        } catch (const std::bad_alloc&) {
+            unknown->Release();
+            return E_OUTOFMEMORY;
+        }
+        return S_OK;
+    }
+
+    T* p = nullptr;
+    mutable std::size_t used = 0;
+    mutable entry slots[cache_slots];
+    mutable std::vector<entry> overflow;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_COM_REF_H_
@@ -17,6 +17,8 @@ namespace coreaudio {
  *
  * Throws a `_com_error(status)` if you try to access while not holding a value.
  *
+ * Can't be assigned; see `h_result<T>` to store or chain results.
+ *
  * @tparam T The possibly-held type.
  */
 template<typename T>
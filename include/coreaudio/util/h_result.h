@@ -0,0 +1,183 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_H_RESULT_H_
+#define WINDOWS_COREAUDIO_WRAPPER_H_RESULT_H_
+
+#include "winerror.h"
+
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/throw_com_error.h"
+
+#ifndef COREAUDIO_NODISCARD
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define COREAUDIO_NODISCARD [[nodiscard]]
+#else
+#define COREAUDIO_NODISCARD
+#endif
+#endif
+
+namespace coreaudio {
+
+template<typename T>
+struct h_result;
+
+namespace detail {
+
+// The `h_result` a continuation passed to `and_then`/`or_else` produces
+template<typename R>
+struct continuation_result {
+    static_assert(sizeof(R) == 0, "h_result: the continuation must return h_result<U> or h_optional<U>");
+};
+template<typename U>
+struct continuation_result<h_result<U>> {
+    using type = h_result<U>;
+};
+template<typename U>
+struct continuation_result<h_optional<U>> {
+    using type = h_result<U>;
+};
+
+}
+
+/**
+ * An `h_optional<T>` that can be assigned (and is trivially copyable if `T` is), for results that are passed along
+ * or stored rather than checked once. Converts implicitly from `h_optional<T>` (see also `as_result`).
+ *
+ * Chains like `std::expected`, checking the status once per step:
+ *
+ *     h_result<float> volume = as_result(e.get_default_endpoint(std::nothrow, eRender))
+ *         .and_then([](const device& d) { return d.activate_endpoint_volume(std::nothrow); })
+ *         .and_then([](const endpoint_volume& v) { return v.get_master_volume_level_scalar(std::nothrow); });
+ *
+ * A failed step holds a default-constructed value, so the `U` of `and_then` and `transform` must be
+ * default-constructible.
+ *
+ * Throws a `_com_error(status)` if you try to access while not holding a value.
+ */
+template<typename T>
+struct COREAUDIO_NODISCARD h_result {
+    using value_type = T;
+
+    h_result(HRESULT status, const T& value) : status(status), value(value) {}
+    h_result(HRESULT status, T&& value) : status(status), value(static_cast<T&&>(value)) {}
+    template<typename U> h_result(U, const T&) = delete;  // Prevent non-HRESULT first arg
+    template<typename U> h_result(U, T&&) = delete;
+
+    // Holds `status` and a default-constructed `T`
+    explicit h_result(HRESULT status) : status(status), value() {}
+
+    h_result(const h_optional<T>& other) : status(other.get_status()), value(other.get_unchecked()) {}
+    h_result(h_optional<T>&& other) : status(other.get_status()), value(static_cast<T&&>(other.get_unchecked())) {}
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    const T& operator*() const& {
+        throw_com_error(status);
+        return value;
+    }
+    T& operator*() & {
+        throw_com_error(status);
+        return value;
+    }
+    T&& operator*() && {
+        throw_com_error(status);
+        return static_cast<T&&>(value);
+    }
+
+    const T* operator->() const { return ::std::addressof(**this); }
+    T* operator->() { return ::std::addressof(**this); }
+#endif
+
+    const T& get_unchecked() const& noexcept {
+        return value;
+    }
+    T& get_unchecked() & noexcept {
+        return value;
+    }
+    T&& get_unchecked() && noexcept {
+        return static_cast<T&&>(value);
+    }
+    HRESULT get_status() const noexcept {
+        return status;
+    }
+    bool has_value() const noexcept {
+        return SUCCEEDED(status);
+    }
+    explicit operator bool() const noexcept {
+        return has_value();
+    }
+
+    template<typename U>
+    T value_or(U&& fallback) const& {
+        return has_value() ? value : static_cast<T>(static_cast<U&&>(fallback));
+    }
+    template<typename U>
+    T value_or(U&& fallback) && {
+        return has_value() ? static_cast<T&&>(value) : static_cast<T>(static_cast<U&&>(fallback));
+    }
+
+    /**
+     * `f(value)` (returning an `h_result<U>` or `h_optional<U>`) if this holds a value, else this failure as an
+     * `h_result<U>`.
+     */
+    template<typename F>
+    auto and_then(F&& f) const& -> typename detail::continuation_result<decltype(f(std::declval<const T&>()))>::type {
+        using result = typename detail::continuation_result<decltype(f(std::declval<const T&>()))>::type;
+        if (FAILED(status)) return result(status);
+        return result(f(value));
+    }
+    template<typename F>
+    auto and_then(F&& f) && -> typename detail::continuation_result<decltype(f(std::declval<T&&>()))>::type {
+        using result = typename detail::continuation_result<decltype(f(std::declval<T&&>()))>::type;
+        if (FAILED(status)) return result(status);
+        return result(f(static_cast<T&&>(value)));
+    }
+
+    // `f(value)` (returning a `U`) with this status if this holds a value, else this failure as an `h_result<U>`
+    template<typename F>
+    auto transform(F&& f) const& -> h_result<typename std::decay<decltype(f(std::declval<const T&>()))>::type> {
+        using result = h_result<typename std::decay<decltype(f(std::declval<const T&>()))>::type>;
+        if (FAILED(status)) return result(status);
+        return result(status, f(value));
+    }
+    template<typename F>
+    auto transform(F&& f) && -> h_result<typename std::decay<decltype(f(std::declval<T&&>()))>::type> {
+        using result = h_result<typename std::decay<decltype(f(std::declval<T&&>()))>::type>;
+        if (FAILED(status)) return result(status);
+        return result(status, f(static_cast<T&&>(value)));
+    }
+
+    // This if it holds a value, else `f(status)` (returning an `h_result<T>` or `h_optional<T>`), e.g. a fallback
+    template<typename F>
+    h_result or_else(F&& f) const& {
+        static_assert(std::is_same<typename detail::continuation_result<decltype(f(HRESULT()))>::type, h_result>::value,
+                      "h_result::or_else: the continuation must return h_result<T> or h_optional<T>");
+        if (SUCCEEDED(status)) return *this;
+        return h_result(f(status));
+    }
+    template<typename F>
+    h_result or_else(F&& f) && {
+        static_assert(std::is_same<typename detail::continuation_result<decltype(f(HRESULT()))>::type, h_result>::value,
+                      "h_result::or_else: the continuation must return h_result<T> or h_optional<T>");
+        if (SUCCEEDED(status)) return static_cast<h_result&&>(*this);
+        return h_result(f(status));
+    }
+private:
+    HRESULT status;
+    T value;
+};
+
+// To start a chain from a call that returns an `h_optional<T>`
+template<typename T>
+h_result<T> as_result(h_optional<T>&& x) {
+    return h_result<T>(static_cast<h_optional<T>&&>(x));
+}
+template<typename T>
+h_result<T> as_result(const h_optional<T>& x) {
+    return h_result<T>(x);
+}
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_H_RESULT_H_
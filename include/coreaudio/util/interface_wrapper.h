@@ -1,14 +1,25 @@
 #ifndef WINDOWS_COREAUDIO_WRAPPER_INTERFACE_WRAPPER_H_
 #define WINDOWS_COREAUDIO_WRAPPER_INTERFACE_WRAPPER_H_
 
+#include "coreaudio/util/call_observer.h"
 #include "coreaudio/util/smart_pointers.h"
 
 namespace coreaudio {
 namespace detail {
 
-template<typename T>
+/**
+ * Base of the wrapper types. Holds the `com_pointer<T>`.
+ *
+ * Every COM call made through `value` should go through `observe("Method", [&] { return value.get()->Method(...); })`
+ * so that `Observer` (see `null_call_observer`) sees it.
+ *
+ * @tparam T The COM interface type
+ * @tparam Observer The call observer policy. Defaults to `COREAUDIO_CALL_OBSERVER`.
+ */
+template<typename T, typename Observer = default_call_observer>
 struct interface_wrapper {
     using raw_interface = T;
+    using call_observer = Observer;
 
     constexpr interface_wrapper() noexcept = default;
     constexpr explicit interface_wrapper(std::nullptr_t) noexcept {}
@@ -26,6 +37,11 @@ struct interface_wrapper {
         return value.get();
     }
 protected:
+    template<typename F>
+    HRESULT observe(const char* name, F&& f) const noexcept(noexcept(f())) {
+        return observe_call<Observer>(value.get(), name, f);
+    }
+
     com_pointer<raw_interface> value;
 };
 
@@ -0,0 +1,550 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_METRICS_H_
+#define WINDOWS_COREAUDIO_WRAPPER_METRICS_H_
+
+#include "windows.h"
+#include "audioclient.h"
+#include "devicetopology.h"
+#include "endpointvolume.h"
+#include "mmdeviceapi.h"
+#include "objidl.h"
+#include "propsys.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/qpc_time.h"
+#include "coreaudio/util/throw_com_error.h"
+
+
+namespace coreaudio {
+
+namespace detail {
+
+// Name of a COM interface in the metrics: the interface's name for the ones the wrapper calls, else its IID
+template<typename Interface>
+struct metrics_interface_name {
+    static const char* get() noexcept {
+        struct iid_text {
+            char chars[39];
+            explicit iid_text(const GUID& g) noexcept {
+                static const char hex[] = "0123456789ABCDEF";
+                unsigned char bytes[16];
+                for (int i = 0; i < 4; ++i) bytes[i] = static_cast<unsigned char>(g.Data1 >> (24 - 8 * i));
+                for (int i = 0; i < 2; ++i) bytes[4 + i] = static_cast<unsigned char>(g.Data2 >> (8 - 8 * i));
+                for (int i = 0; i < 2; ++i) bytes[6 + i] = static_cast<unsigned char>(g.Data3 >> (8 - 8 * i));
+                std::memcpy(bytes + 8, g.Data4, 8);
+                char* out = chars;
+                *out++ = '{';
+                for (int i = 0; i < 16; ++i) {
+                    if (i == 4 || i == 6 || i == 8 || i == 10) *out++ = '-';
+                    *out++ = hex[bytes[i] >> 4];
+                    *out++ = hex[bytes[i] & 15];
+                }
+                *out++ = '}';
+                *out = 0;
+            }
+        };
+        static const iid_text text(__uuidof(Interface));
+        return text.chars;
+    }
+};
+
+#define COREAUDIO_METRICS_INTERFACE_NAME(I) \
+    template<> struct metrics_interface_name<I> { static const char* get() noexcept { return #I; } };
+COREAUDIO_METRICS_INTERFACE_NAME(IUnknown)
+COREAUDIO_METRICS_INTERFACE_NAME(IMMDeviceEnumerator)
+COREAUDIO_METRICS_INTERFACE_NAME(IMMDeviceCollection)
+COREAUDIO_METRICS_INTERFACE_NAME(IMMDevice)
+COREAUDIO_METRICS_INTERFACE_NAME(IMMEndpoint)
+COREAUDIO_METRICS_INTERFACE_NAME(IPropertyStore)
+COREAUDIO_METRICS_INTERFACE_NAME(IAudioEndpointVolume)
+COREAUDIO_METRICS_INTERFACE_NAME(IAudioClient)
+COREAUDIO_METRICS_INTERFACE_NAME(IAudioCaptureClient)
+COREAUDIO_METRICS_INTERFACE_NAME(IAudioRenderClient)
+COREAUDIO_METRICS_INTERFACE_NAME(IAudioClock)
+COREAUDIO_METRICS_INTERFACE_NAME(IAudioClockAdjustment)
+COREAUDIO_METRICS_INTERFACE_NAME(IDeviceTopology)
+COREAUDIO_METRICS_INTERFACE_NAME(IConnector)
+COREAUDIO_METRICS_INTERFACE_NAME(IPart)
+COREAUDIO_METRICS_INTERFACE_NAME(IPartsList)
+COREAUDIO_METRICS_INTERFACE_NAME(IKsJackDescription)
+COREAUDIO_METRICS_INTERFACE_NAME(IGlobalInterfaceTable)
+#undef COREAUDIO_METRICS_INTERFACE_NAME
+
+// A distinct address per interface type
+template<typename Interface>
+const void* metrics_interface_tag() noexcept {
+    static const char tag = 0;
+    return &tag;
+}
+
+}
+
+/**
+ * Counts, failure codes and latency histograms of every COM call made through the wrapper (see `metrics_call_observer`),
+ * and named event counters (notifications, glitches, ...) that the library adds to through the observer's
+ * `count_event`, and the application can add to as well. Recording is lock-free
+ * and doesn't allocate: fixed tables, with each counter split into `shard_count` cache lines that threads are spread
+ * over. `expose` and `dump` write it all in the Prometheus text exposition format.
+ *
+ * Everything lives in the static `instance()`, zero-initialized, so no memory is touched before the first call.
+ */
+struct metrics_registry {
+    static constexpr std::size_t shard_count = 8;
+    static constexpr std::size_t max_call_sites = 256;
+    static constexpr std::size_t max_counters = 64;
+    static constexpr std::size_t max_failure_codes = 64;
+    // Latency buckets: up to 1, 4, 16, ..., 4^10 µs (about a second), then everything slower
+    static constexpr std::size_t bucket_count = 12;
+
+    struct call_site;
+
+    /**
+     * A named event counter. The name must outlive the registry (a string literal), and is written as the `name`
+     * label of `coreaudio_events_total`.
+     */
+    struct counter {
+        void add(std::uint64_t n = 1) noexcept {
+            shards[shard()].value.fetch_add(n, std::memory_order_relaxed);
+        }
+        std::uint64_t value() const noexcept {
+            std::uint64_t sum = 0;
+            for (const shard_value& s : shards) sum += s.value.load(std::memory_order_relaxed);
+            return sum;
+        }
+        // nullptr for the counter given out once the table is full
+        const char* name() const noexcept {
+            return counter_name.load(std::memory_order_acquire);
+        }
+    private:
+        friend struct metrics_registry;
+        struct alignas(64) shard_value {
+            std::atomic<std::uint64_t> value;
+        };
+
+        std::atomic<const char*> counter_name;
+        shard_value shards[shard_count];
+    };
+
+    static metrics_registry& instance() noexcept {
+        static metrics_registry registry;
+        return registry;
+    }
+
+    // Turns recording on or off (on by default). Off, an observed call costs one relaxed load.
+    void set_enabled(bool enabled) noexcept {
+        disabled.store(!enabled, std::memory_order_relaxed);
+    }
+    bool enabled() const noexcept {
+        return !disabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * The site of `Interface::method` (`method` being a string literal), registered on first use; nullptr if the
+     * table is full (the call is then counted in `unrecorded`).
+     */
+    template<typename Interface>
+    call_site* site(const char* method) noexcept {
+        return find_site(detail::metrics_interface_tag<Interface>(), detail::metrics_interface_name<Interface>::get(), method);
+    }
+
+    /**
+     * The counter named `name`, registered on first use. Names are compared by content, so the same literal in
+     * several translation units is one counter. Once the table is full, all new names share one counter.
+     */
+    counter& get_counter(const char* name) noexcept {
+        std::size_t h = hash_name(name);
+        for (std::size_t probe = 0; probe < max_counters; ++probe) {
+            counter& c = counters[(h + probe) % max_counters];
+            const char* existing = c.counter_name.load(std::memory_order_acquire);
+            if (!existing && c.counter_name.compare_exchange_strong(existing, name, std::memory_order_acq_rel)) return c;
+            if (existing == name || std::strcmp(existing, name) == 0) return c;
+        }
+        return overflow_counter;
+    }
+
+    // Calls that couldn't be recorded because the site table was full (or while their site was being registered)
+    std::uint64_t unrecorded() const noexcept {
+        return unrecorded_calls.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Everything recorded, in the Prometheus text exposition format. Sites of the same method registered twice
+     * (string literals aren't merged across translation units) are summed. Throws whatever `std::string` throws.
+     */
+    std::string expose() const;
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void dump(const std::wstring& path) const {
+        throw_com_error(dump(std::nothrow, path));
+    }
+#endif
+    /**
+     * Writes `expose()` to `path.new`, then moves it over `path`, so a reader never sees half a dump.
+     * Throws whatever `std::string` and `std::wstring` throw.
+     */
+    HRESULT dump(std::nothrow_t, const std::wstring& path) const {
+        std::string text = expose();
+        std::wstring pending = path + L".new";
+        HANDLE f = CreateFileW(pending.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (f == INVALID_HANDLE_VALUE) return HRESULT_FROM_WIN32(GetLastError());
+        DWORD written = 0;
+        HRESULT status = S_OK;
+        if (!WriteFile(f, text.data(), static_cast<DWORD>(text.size()), &written, nullptr) || written != text.size()) {
+            status = HRESULT_FROM_WIN32(GetLastError());
+            if (SUCCEEDED(status)) status = E_FAIL;
+        }
+        CloseHandle(f);
+        if (SUCCEEDED(status) && !MoveFileExW(pending.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) status = HRESULT_FROM_WIN32(GetLastError());
+        if (FAILED(status)) DeleteFileW(pending.c_str());
+        return status;
+    }
+
+    struct call_site {
+        void record(LONGLONG elapsed, HRESULT status) noexcept {
+            std::uint64_t microseconds = elapsed > 0 ? static_cast<std::uint64_t>(elapsed) / 10 : 0;
+            std::size_t bucket = 0;
+            while (bucket + 1 < bucket_count && microseconds > bucket_bound(bucket)) ++bucket;
+            shard_values& s = shards[shard()];
+            s.calls.fetch_add(1, std::memory_order_relaxed);
+            s.microseconds.fetch_add(microseconds, std::memory_order_relaxed);
+            s.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+            if (FAILED(status)) s.failures.fetch_add(1, std::memory_order_relaxed);
+        }
+    private:
+        friend struct metrics_registry;
+        struct alignas(64) shard_values {
+            std::atomic<std::uint64_t> calls;
+            std::atomic<std::uint64_t> failures;
+            std::atomic<std::uint64_t> microseconds;
+            std::atomic<std::uint64_t> buckets[bucket_count];
+        };
+
+        std::atomic<const char*> method;
+        std::atomic<const void*> interface_tag;
+        std::atomic<const char*> interface_name;  // Set last, once the site is registered
+        shard_values shards[shard_count];
+    };
+
+    // Counts a failed call by its HRESULT
+    void record_failure(HRESULT status) noexcept {
+        const std::uint32_t code = static_cast<std::uint32_t>(status);
+        std::size_t h = static_cast<std::size_t>(code * 2654435761u);
+        for (std::size_t probe = 0; probe < max_failure_codes; ++probe) {
+            failure_code& f = failure_codes[(h + probe) % max_failure_codes];
+            std::uint32_t existing = f.code.load(std::memory_order_acquire);
+            if (existing == 0 && f.code.compare_exchange_strong(existing, code, std::memory_order_acq_rel)) existing = code;
+            if (existing == code) {
+                f.count.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        other_failures.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Upper bound of latency bucket `i` (< bucket_count - 1) in µs
+    static constexpr std::uint64_t bucket_bound(std::size_t i) noexcept {
+        return std::uint64_t(1) << (2 * i);
+    }
+private:
+    struct failure_code {
+        std::atomic<std::uint32_t> code;  // 0 if free
+        std::atomic<std::uint64_t> count;
+    };
+
+    // Each thread records into one shard, picked round-robin when it first records
+    static std::size_t shard() noexcept {
+        static std::atomic<std::size_t> next{0};
+        thread_local std::size_t index = next.fetch_add(1, std::memory_order_relaxed) % shard_count;
+        return index;
+    }
+
+    static std::size_t hash(const void* a, const void* b) noexcept {
+        std::uint64_t x = reinterpret_cast<std::uintptr_t>(a) ^ (static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(b)) * 0x9E3779B97F4A7C15ull);
+        x ^= x >> 29;
+        x *= 0xBF58476D1CE4E5B9ull;
+        return static_cast<std::size_t>(x ^ (x >> 32));
+    }
+
+    // FNV-1a
+    static std::size_t hash_name(const char* name) noexcept {
+        std::uint64_t x = 0xCBF29CE484222325ull;
+        for (; *name; ++name) x = (x ^ static_cast<unsigned char>(*name)) * 0x100000001B3ull;
+        return static_cast<std::size_t>(x ^ (x >> 32));
+    }
+
+    call_site* find_site(const void* tag, const char* interface_name, const char* method) noexcept {
+        std::size_t h = hash(method, tag);
+        for (std::size_t probe = 0; probe < max_call_sites; ++probe) {
+            call_site& s = sites[(h + probe) % max_call_sites];
+            const char* existing = s.method.load(std::memory_order_acquire);
+            if (!existing && s.method.compare_exchange_strong(existing, method, std::memory_order_acq_rel)) {
+                s.interface_tag.store(tag, std::memory_order_relaxed);
+                s.interface_name.store(interface_name, std::memory_order_release);
+                return &s;
+            }
+            if (existing != method) continue;
+            const char* name = s.interface_name.load(std::memory_order_acquire);
+            if (!name) break;  // Being registered, maybe for this very interface
+            if (s.interface_tag.load(std::memory_order_relaxed) == tag) return &s;
+        }
+        unrecorded_calls.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    static void append_escaped(std::string& out, const char* s) {
+        for (; *s; ++s) {
+            if (*s == '\\' || *s == '"') out += '\\';
+            if (*s == '\n') {
+                out += "\\n";
+                continue;
+            }
+            out += *s;
+        }
+    }
+
+    static void append_number(std::string& out, std::uint64_t n) {
+        char digits[20];
+        std::size_t count = 0;
+        do {
+            digits[count++] = static_cast<char>('0' + n % 10);
+            n /= 10;
+        } while (n);
+        while (count) out += digits[--count];
+    }
+
+    std::atomic<bool> disabled;
+    std::atomic<std::uint64_t> unrecorded_calls;
+    std::atomic<std::uint64_t> other_failures;
+    call_site sites[max_call_sites];
+    counter counters[max_counters];
+    counter overflow_counter;
+    failure_code failure_codes[max_failure_codes];
+};
+
+inline std::string metrics_registry::expose() const {
+    struct totals {
+        std::uint64_t calls = 0;
+        std::uint64_t failures = 0;
+        std::uint64_t microseconds = 0;
+        std::uint64_t buckets[bucket_count] = {};
+    };
+    auto same = [](const call_site& a, const call_site& b) {
+        return std::strcmp(a.method.load(std::memory_order_relaxed), b.method.load(std::memory_order_relaxed)) == 0 &&
+            std::strcmp(a.interface_name.load(std::memory_order_relaxed), b.interface_name.load(std::memory_order_relaxed)) == 0;
+    };
+
+    std::string calls;
+    std::string failures;
+    std::string durations;
+    calls += "# HELP coreaudio_calls_total COM calls made through the wrapper.\n# TYPE coreaudio_calls_total counter\n";
+    failures += "# HELP coreaudio_call_failures_total COM calls that returned a failure HRESULT.\n# TYPE coreaudio_call_failures_total counter\n";
+    durations += "# HELP coreaudio_call_duration_microseconds Duration of COM calls.\n# TYPE coreaudio_call_duration_microseconds histogram\n";
+    for (std::size_t i = 0; i < max_call_sites; ++i) {
+        const call_site& s = sites[i];
+        if (!s.interface_name.load(std::memory_order_acquire)) continue;
+        bool seen = false;
+        for (std::size_t j = 0; j < i && !seen; ++j) {
+            seen = sites[j].interface_name.load(std::memory_order_acquire) && same(sites[j], s);
+        }
+        if (seen) continue;
+        totals t;
+        for (std::size_t j = i; j < max_call_sites; ++j) {
+            const call_site& other = sites[j];
+            if (!other.interface_name.load(std::memory_order_acquire) || !same(other, s)) continue;
+            for (const call_site::shard_values& shard : other.shards) {
+                t.calls += shard.calls.load(std::memory_order_relaxed);
+                t.failures += shard.failures.load(std::memory_order_relaxed);
+                t.microseconds += shard.microseconds.load(std::memory_order_relaxed);
+                for (std::size_t b = 0; b < bucket_count; ++b) t.buckets[b] += shard.buckets[b].load(std::memory_order_relaxed);
+            }
+        }
+        std::string labels = "interface=\"";
+        append_escaped(labels, s.interface_name.load(std::memory_order_relaxed));
+        labels += "\",method=\"";
+        append_escaped(labels, s.method.load(std::memory_order_relaxed));
+        labels += '"';
+
+        calls += "coreaudio_calls_total{" + labels + "} ";
+        append_number(calls, t.calls);
+        calls += '\n';
+        failures += "coreaudio_call_failures_total{" + labels + "} ";
+        append_number(failures, t.failures);
+        failures += '\n';
+        // Buckets are cumulative in the exposition format. Shards are read one by one while calls are recorded,
+        // so the +Inf bucket is the count.
+        std::uint64_t cumulative = 0;
+        for (std::size_t b = 0; b < bucket_count; ++b) {
+            cumulative += t.buckets[b];
+            durations += "coreaudio_call_duration_microseconds_bucket{" + labels + ",le=\"";
+            if (b + 1 < bucket_count) append_number(durations, bucket_bound(b)); else durations += "+Inf";
+            durations += "\"} ";
+            append_number(durations, cumulative);
+            durations += '\n';
+        }
+        durations += "coreaudio_call_duration_microseconds_sum{" + labels + "} ";
+        append_number(durations, t.microseconds);
+        durations += "\ncoreaudio_call_duration_microseconds_count{" + labels + "} ";
+        append_number(durations, cumulative);
+        durations += '\n';
+    }
+
+    std::string out = calls + failures + durations;
+    out += "# HELP coreaudio_failures_total Failed COM calls by HRESULT.\n# TYPE coreaudio_failures_total counter\n";
+    for (const failure_code& f : failure_codes) {
+        std::uint32_t code = f.code.load(std::memory_order_acquire);
+        if (code == 0) continue;
+        static const char hex[] = "0123456789abcdef";
+        out += "coreaudio_failures_total{hresult=\"0x";
+        for (int shift = 28; shift >= 0; shift -= 4) out += hex[(code >> shift) & 15];
+        out += "\"} ";
+        append_number(out, f.count.load(std::memory_order_relaxed));
+        out += '\n';
+    }
+    out += "coreaudio_failures_total{hresult=\"other\"} ";
+    append_number(out, other_failures.load(std::memory_order_relaxed));
+    out += "\n# HELP coreaudio_events_total Events counted by the library or the application.\n# TYPE coreaudio_events_total counter\n";
+    for (const counter& c : counters) {
+        const char* name = c.name();
+        if (!name) continue;
+        out += "coreaudio_events_total{name=\"";
+        append_escaped(out, name);
+        out += "\"} ";
+        append_number(out, c.value());
+        out += '\n';
+    }
+    out += "coreaudio_events_total{name=\"other\"} ";
+    append_number(out, overflow_counter.value());
+    out += "\n# HELP coreaudio_unrecorded_calls_total COM calls not recorded because the site table was full.\n"
+           "# TYPE coreaudio_unrecorded_calls_total counter\ncoreaudio_unrecorded_calls_total ";
+    append_number(out, unrecorded());
+    out += '\n';
+    return out;
+}
+
+/**
+ * A call observer (see `null_call_observer`) recording into `metrics_registry::instance()`. Install it with
+ *
+ *     #define COREAUDIO_CALL_OBSERVER ::coreaudio::metrics_call_observer
+ *     #include "coreaudio/util/metrics.h"
+ *
+ * before any other coreaudio header.
+ */
+struct metrics_call_observer {
+    struct token {
+        metrics_registry::call_site* site;  // nullptr if not recording
+        LONGLONG start;
+    };
+
+    template<typename Interface>
+    static token before_call(Interface*, const char* name) noexcept {
+        metrics_registry& r = metrics_registry::instance();
+        if (!r.enabled()) return { nullptr, 0 };
+        return { r.site<Interface>(name), qpc_now() };
+    }
+    template<typename Interface>
+    static void after_call(const token& t, Interface*, const char*, HRESULT status) noexcept {
+        if (!t.site) return;
+        t.site->record(qpc_now() - t.start, status);
+        if (FAILED(status)) metrics_registry::instance().record_failure(status);
+    }
+
+    // Adds to the counter `name` while recording is enabled
+    static void count_event(const char* name, std::uint64_t n) noexcept {
+        metrics_registry& r = metrics_registry::instance();
+        if (r.enabled()) r.get_counter(name).add(n);
+    }
+};
+
+/**
+ * Dumps a `metrics_registry` to a file (see `metrics_registry::dump`) every `interval` on its own thread, and once
+ * more when destroyed.
+ */
+struct metrics_dumper {
+    metrics_dumper(const metrics_dumper&) = delete;
+    metrics_dumper& operator=(const metrics_dumper&) = delete;
+
+    ~metrics_dumper() {
+        // Not started if the first dump failed
+        if (!thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+        write();
+    }
+
+#ifndef COREAUDIO_NOEXCEPTIONS
+    static std::unique_ptr<metrics_dumper> start(std::wstring path, std::chrono::milliseconds interval,
+                                                 const metrics_registry& registry = metrics_registry::instance()) {
+        return static_cast<std::unique_ptr<metrics_dumper>&&>(*start(std::nothrow, static_cast<std::wstring&&>(path), interval, registry));
+    }
+#endif
+    /**
+     * Dumps once, failing with that dump's failure (e.g. if the directory doesn't exist), then starts the thread.
+     * Throws whatever `std::thread` throws.
+     */
+    static h_optional<std::unique_ptr<metrics_dumper>> start(std::nothrow_t, std::wstring path, std::chrono::milliseconds interval,
+                                                             const metrics_registry& registry = metrics_registry::instance()) {
+        std::unique_ptr<metrics_dumper> d(new (std::nothrow) metrics_dumper(static_cast<std::wstring&&>(path), interval, registry));
+        if (!d) return { E_OUTOFMEMORY, nullptr };
+        HRESULT status = d->write();
+        if (FAILED(status)) return { status, nullptr };
+        metrics_dumper* raw = d.get();
+        d->thread = std::thread([raw] { raw->run(); });
+        return { S_OK, static_cast<std::unique_ptr<metrics_dumper>&&>(d) };
+    }
+
+    // Result of the last dump
+    HRESULT last_status() const noexcept {
+        return status.load(std::memory_order_relaxed);
+    }
+private:
+    metrics_dumper(std::wstring path, std::chrono::milliseconds interval, const metrics_registry& registry) noexcept
+        : path(static_cast<std::wstring&&>(path)), interval(interval), registry(registry) {}
+
+    void run() noexcept {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_for(lock, interval, [this] { return stopping; })) {
+            lock.unlock();
+            write();
+            lock.lock();
+        }
+    }
+
+    HRESULT write() noexcept {
+        HRESULT result;
+        try {
+            result = registry.dump(std::nothrow, path);
+        } catch (const std::bad_alloc&) {
+            result = E_OUTOFMEMORY;
+        }
+        status.store(result, std::memory_order_relaxed);
+        return result;
+    }
+
+    const std::wstring path;
+    const std::chrono::milliseconds interval;
+    const metrics_registry& registry;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::atomic<HRESULT> status{S_OK};
+    std::thread thread;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_METRICS_H_
@@ -0,0 +1,23 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_QPC_TIME_H_
+#define WINDOWS_COREAUDIO_WRAPPER_QPC_TIME_H_
+
+#include "windows.h"
+
+
+namespace coreaudio {
+
+// The performance counter now, in 100 ns units (the unit of `IAudioClock::GetPosition`'s QPC position)
+inline LONGLONG qpc_now() noexcept {
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    // Split to avoid overflowing for large counter values
+    LONGLONG seconds = counter.QuadPart / frequency.QuadPart;
+    LONGLONG rest = counter.QuadPart % frequency.QuadPart;
+    return seconds * 10000000 + rest * 10000000 / frequency.QuadPart;
+}
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_QPC_TIME_H_
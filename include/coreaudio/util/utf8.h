@@ -0,0 +1,115 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_UTF8_H_
+#define WINDOWS_COREAUDIO_WRAPPER_UTF8_H_
+
+#include <cstddef>
+#include <cwchar>
+#include <string>
+
+#include "coreaudio/dsp/simd.h"
+
+
+namespace coreaudio {
+
+namespace detail {
+
+constexpr bool wchar_is_utf16 = WCHAR_MAX <= 0xFFFF;
+
+// Encodes the code unit(s) at in[i] and returns the index after them
+inline std::size_t encode_utf8(const wchar_t* in, std::size_t i, std::size_t n, char*& out) noexcept {
+    unsigned long c = static_cast<unsigned long>(in[i]) & (wchar_is_utf16 ? 0xFFFFul : 0xFFFFFFFFul);
+    ++i;
+    if (c >= 0xD800 && c <= 0xDFFF) {
+        unsigned long low = i < n ? static_cast<unsigned long>(in[i]) & 0xFFFFFFFFul : 0;
+        if (c <= 0xDBFF && low >= 0xDC00 && low <= 0xDFFF) {
+            c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+            ++i;
+        } else {
+            c = 0xFFFD;  // Unpaired surrogate
+        }
+    } else if (c > 0x10FFFF) {
+        c = 0xFFFD;
+    }
+
+    if (c < 0x80) {
+        *out++ = static_cast<char>(c);
+    } else if (c < 0x800) {
+        *out++ = static_cast<char>(0xC0 | (c >> 6));
+        *out++ = static_cast<char>(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        *out++ = static_cast<char>(0xE0 | (c >> 12));
+        *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (c & 0x3F));
+    } else {
+        *out++ = static_cast<char>(0xF0 | (c >> 18));
+        *out++ = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (c & 0x3F));
+    }
+    return i;
+}
+
+}
+
+// Most bytes `utf16_to_utf8` writes for `units` code units
+constexpr std::size_t utf8_capacity(std::size_t units) noexcept {
+    return units * (detail::wchar_is_utf16 ? 3 : 4);
+}
+
+/**
+ * Writes the UTF-8 encoding of the `n` UTF-16 code units at `in` (UTF-32 where `wchar_t` is 32 bits) to `out`, which
+ * must have room for `utf8_capacity(n)` bytes. Unpaired surrogates become U+FFFD. Returns the number of bytes written.
+ *
+ * Runs of 16 ASCII code units (all of a typical endpoint ID) are narrowed 16 at a time with SSE2.
+ */
+inline std::size_t utf16_to_utf8(const wchar_t* in, std::size_t n, char* out) noexcept {
+    char* const begin = out;
+    std::size_t i = 0;
+#if defined(COREAUDIO_SIMD_AVX) || defined(COREAUDIO_SIMD_SSE2)
+    if (detail::wchar_is_utf16) {
+        const __m128i non_ascii = _mm_set1_epi16(static_cast<short>(0xFF80));
+        const __m128i zero = _mm_setzero_si128();
+        while (i + 16 <= n) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 8));
+            __m128i high = _mm_and_si128(_mm_or_si128(a, b), non_ascii);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) == 0xFFFF) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(a, b));
+                out += 16;
+                i += 16;
+                continue;
+            }
+            // Not all ASCII: this block one unit at a time (a surrogate pair may end one unit past it)
+            std::size_t block_end = i + 16;
+            while (i < block_end) i = detail::encode_utf8(in, i, n, out);
+        }
+    }
+#endif
+    while (i < n) {
+        if (static_cast<unsigned long>(in[i]) < 0x80) {
+            *out++ = static_cast<char>(in[i++]);
+            continue;
+        }
+        i = detail::encode_utf8(in, i, n, out);
+    }
+    return static_cast<std::size_t>(out - begin);
+}
+
+/**
+ * Appends the UTF-8 encoding of the `n` code units at `in` to `out`. Only allocates if `out` doesn't have the
+ * capacity already, so a string reused across calls stops allocating once it is large enough.
+ * Throws whatever `std::string` throws.
+ */
+inline void append_utf8(std::string& out, const wchar_t* in, std::size_t n) {
+    std::size_t size = out.size();
+    out.resize(size + utf8_capacity(n));
+    out.resize(size + utf16_to_utf8(in, n, &out[size]));
+}
+
+// `in` is NUL-terminated
+inline void append_utf8(std::string& out, const wchar_t* in) {
+    if (in) append_utf8(out, in, std::wcslen(in));
+}
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_UTF8_H_
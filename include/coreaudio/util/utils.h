@@ -1,7 +1,10 @@
 #ifndef WINDOWS_COREAUDIO_WRAPPER_UTILS_H_
 #define WINDOWS_COREAUDIO_WRAPPER_UTILS_H_
 
+#include "coreaudio/util/call_observer.h"
+#include "coreaudio/util/com_ref.h"
 #include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/h_result.h"
 #include "coreaudio/util/has_uuid.h"
 #include "coreaudio/util/indexed_dynamic_iterator.h"
 #include "coreaudio/util/interface_wrapper.h"
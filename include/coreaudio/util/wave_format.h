@@ -0,0 +1,47 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_WAVE_FORMAT_H_
+#define WINDOWS_COREAUDIO_WRAPPER_WAVE_FORMAT_H_
+
+#include "windows.h"
+#include "mmreg.h"
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+
+namespace coreaudio {
+
+/**
+ * Bytes of `f` to read: a `WAVE_FORMAT_PCM` format may be a 16-byte `PCMWAVEFORMAT` (a `WAVEFORMATEX` without
+ * `cbSize`), any other one is a `WAVEFORMATEX` followed by `cbSize` bytes.
+ */
+inline std::size_t wave_format_size(const WAVEFORMATEX* f) noexcept {
+    return f->wFormatTag == WAVE_FORMAT_PCM ? offsetof(WAVEFORMATEX, cbSize) : sizeof(WAVEFORMATEX) + f->cbSize;
+}
+
+// As above for a format stored in `bytes` bytes (e.g. a `VT_BLOB` property); 0 if they are too few to hold it
+inline std::size_t wave_format_size(const BYTE* data, std::size_t bytes) noexcept {
+    if (!data || bytes < offsetof(WAVEFORMATEX, cbSize)) return 0;
+    WORD tag;
+    std::memcpy(&tag, data + offsetof(WAVEFORMATEX, wFormatTag), sizeof(tag));
+    if (tag == WAVE_FORMAT_PCM) return offsetof(WAVEFORMATEX, cbSize);
+    if (bytes < sizeof(WAVEFORMATEX)) return 0;
+    WORD extra;
+    std::memcpy(&extra, data + offsetof(WAVEFORMATEX, cbSize), sizeof(extra));
+    return sizeof(WAVEFORMATEX) + extra <= bytes ? sizeof(WAVEFORMATEX) + extra : 0;
+}
+
+/**
+ * Copies the `wave_format_size(f)` bytes of `f` into `out`, padded to a whole `WAVEFORMATEX` (with a `cbSize` of 0)
+ * so that it can be read as one. Throws whatever `std::vector` throws (usually `std::bad_alloc`).
+ */
+inline void copy_wave_format(const WAVEFORMATEX* f, std::vector<BYTE>& out) {
+    const BYTE* bytes = reinterpret_cast<const BYTE*>(f);
+    std::size_t size = wave_format_size(f);
+    out.assign(bytes, bytes + size);
+    if (size < sizeof(WAVEFORMATEX)) out.resize(sizeof(WAVEFORMATEX), 0);
+}
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_WAVE_FORMAT_H_
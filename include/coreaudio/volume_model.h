@@ -0,0 +1,280 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_VOLUME_MODEL_H_
+#define WINDOWS_COREAUDIO_WRAPPER_VOLUME_MODEL_H_
+
+#include "windows.h"
+#include "endpointvolume.h"
+#include "propidl.h"
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <string>
+
+#include "coreaudio/device_interfaces/endpoint_volume.h"
+#include "coreaudio/util/h_optional.h"
+
+
+namespace coreaudio {
+
+namespace detail {
+
+// Natural log good to double precision, usable in constant expressions. `x` must be positive.
+constexpr double constexpr_ln(double x) noexcept {
+    int exponent = 0;
+    while (x >= 2) { x /= 2; ++exponent; }
+    while (x < 1) { x *= 2; --exponent; }
+    // ln(x) = 2 atanh((x - 1) / (x + 1)), and |t| <= 1/3 here
+    double t = (x - 1) / (x + 1);
+    double t2 = t * t;
+    double term = t;
+    double sum = 0;
+    for (int k = 1; k < 40; k += 2) {
+        sum += term / k;
+        term *= t2;
+    }
+    return 2 * sum + exponent * 0.69314718055994530942;
+}
+
+constexpr double constexpr_exp(double x) noexcept {
+    constexpr double ln2 = 0.69314718055994530942;
+    int k = static_cast<int>(x / ln2 + (x < 0 ? -0.5 : 0.5));
+    double r = x - k * ln2;  // |r| <= ln(2) / 2
+    double term = 1;
+    double sum = 1;
+    for (int n = 1; n < 24; ++n) {
+        term *= r / n;
+        sum += term;
+    }
+    for (; k > 0; --k) sum *= 2;
+    for (; k < 0; ++k) sum /= 2;
+    return sum;
+}
+
+constexpr double dB_to_gain(double dB) noexcept {
+    return constexpr_exp(dB * (0.11512925464970228420 /* ln(10) / 20 */));
+}
+
+constexpr double gain_to_dB(double gain) noexcept {
+    return constexpr_ln(gain) * (8.68588963806503655302 /* 20 / ln(10) */);
+}
+
+}
+
+/**
+ * How a slider position in [0, 1] maps onto the endpoint's dB range.
+ *
+ * linear_dB: evenly spaced in dB (like the hardware steps).
+ * amplitude: the position is the amplitude gain relative to the maximum (quiet end is cramped).
+ * cubic: the gain is the position cubed, close to perceived loudness.
+ *
+ * The amplitude-based tapers reach the minimum before the slider does (below the minimum, the position is clamped).
+ */
+enum class volume_taper { linear_dB, amplitude, cubic };
+
+constexpr float taper_to_dB(volume_taper taper, float position, float min_dB, float max_dB) noexcept {
+    if (position <= 0) return min_dB;
+    if (position >= 1) return max_dB;
+    if (taper == volume_taper::linear_dB) return min_dB + position * (max_dB - min_dB);
+    double dB = max_dB + (taper == volume_taper::cubic ? 3 : 1) * detail::gain_to_dB(position);
+    return dB < min_dB ? min_dB : static_cast<float>(dB);
+}
+
+constexpr float taper_from_dB(volume_taper taper, float dB, float min_dB, float max_dB) noexcept {
+    if (dB <= min_dB) return 0;
+    if (dB >= max_dB) return 1;
+    if (taper == volume_taper::linear_dB) return (dB - min_dB) / (max_dB - min_dB);
+    return static_cast<float>(detail::dB_to_gain((dB - max_dB) / (taper == volume_taper::cubic ? 3 : 1)));
+}
+
+/**
+ * Conversions between slider position, dB, amplitude gain and hardware volume step for one endpoint, built once
+ * from `get_volume_range` and `get_step_count` so that a UI can convert on every mouse move without COM calls.
+ *
+ * Position↔dB follow the taper exactly and steps are exact. dB→gain is read from a table of `table_points` points
+ * with linear interpolation, within 0.01 dB for ranges up to 200 dB. "Gain" is the linear amplitude ratio to full
+ * scale, not `endpoint_volume`'s scalar, whose taper is up to the audio engine: to set exactly what the model shows,
+ * set the level in dB or step to a step.
+ *
+ * Everything is constexpr, so a model of known hardware can be built at compile time.
+ */
+struct volume_model {
+    static constexpr std::size_t table_points = 257;
+
+    constexpr volume_model() noexcept = default;
+
+    constexpr volume_model(endpoint_volume::volume_range range, UINT step_count, DWORD hardware_support,
+                           volume_taper taper = volume_taper::cubic) noexcept :
+        range(range), steps(step_count), support(hardware_support), curve(taper) {
+        if (!(range.max_dB > range.min_dB)) {
+            this->range.max_dB = range.min_dB;
+            return;
+        }
+        for (std::size_t i = 0; i < table_points; ++i) {
+            float x = static_cast<float>(i) / (table_points - 1);
+            dB_to_gain_table[i] = static_cast<float>(detail::dB_to_gain(range.min_dB + x * (range.max_dB - range.min_dB)));
+        }
+    }
+
+    // Reads the range, step count and hardware support of `v`
+    static h_optional<volume_model> make(const endpoint_volume& v, volume_taper taper = volume_taper::cubic) noexcept {
+        h_optional<endpoint_volume::volume_range> range = v.get_volume_range(std::nothrow);
+        if (!range) return { range.get_status(), volume_model() };
+        h_optional<UINT> steps = v.get_step_count(std::nothrow);
+        if (!steps) return { steps.get_status(), volume_model() };
+        h_optional<DWORD> support = v.query_hardware_support(std::nothrow);
+        if (!support) return { support.get_status(), volume_model() };
+        return { S_OK, volume_model(range.get_unchecked(), steps.get_unchecked(), support.get_unchecked(), taper) };
+    }
+
+    constexpr float position_to_dB(float position) const noexcept {
+        return taper_to_dB(curve, position, range.min_dB, range.max_dB);
+    }
+    constexpr float dB_to_position(float dB) const noexcept {
+        return taper_from_dB(curve, dB, range.min_dB, range.max_dB);
+    }
+
+    constexpr float dB_to_gain(float dB) const noexcept {
+        return lookup(dB_to_gain_table, dB_fraction(dB));
+    }
+    constexpr float gain_to_dB(float gain) const noexcept {
+        if (gain <= 0) return range.min_dB;
+        return clamp_dB(static_cast<float>(detail::gain_to_dB(gain)));
+    }
+
+    // Nearest step to `dB`. 0 if the endpoint has no steps.
+    constexpr UINT dB_to_step(float dB) const noexcept {
+        if (steps < 2) return 0;
+        return static_cast<UINT>(dB_fraction(dB) * (steps - 1) + 0.5f);
+    }
+    constexpr float step_to_dB(UINT step) const noexcept {
+        if (steps < 2) return range.min_dB;
+        if (step >= steps) step = steps - 1;
+        return range.min_dB + (range.max_dB - range.min_dB) * static_cast<float>(step) / (steps - 1);
+    }
+    // `dB` rounded to a level the hardware can represent
+    constexpr float snap_dB(float dB) const noexcept {
+        return steps < 2 ? clamp_dB(dB) : step_to_dB(dB_to_step(dB));
+    }
+
+    constexpr UINT position_to_step(float position) const noexcept {
+        return dB_to_step(position_to_dB(position));
+    }
+    constexpr float step_to_position(UINT step) const noexcept {
+        return dB_to_position(step_to_dB(step));
+    }
+
+    constexpr float min_dB() const noexcept { return range.min_dB; }
+    constexpr float max_dB() const noexcept { return range.max_dB; }
+    constexpr float increment_dB() const noexcept { return range.increment_dB; }
+    constexpr UINT step_count() const noexcept { return steps; }
+    // `ENDPOINT_HARDWARE_SUPPORT_*` flags
+    constexpr DWORD hardware_support() const noexcept { return support; }
+    constexpr volume_taper taper() const noexcept { return curve; }
+
+    // Whether the models were built from the same range, steps and hardware support
+    constexpr bool same_hardware(const volume_model& other) const noexcept {
+        return range.min_dB == other.range.min_dB && range.max_dB == other.range.max_dB &&
+            range.increment_dB == other.range.increment_dB && steps == other.steps && support == other.support;
+    }
+private:
+    constexpr float clamp_dB(float dB) const noexcept {
+        return dB < range.min_dB ? range.min_dB : (dB > range.max_dB ? range.max_dB : dB);
+    }
+    constexpr float dB_fraction(float dB) const noexcept {
+        return range.max_dB > range.min_dB ? (clamp_dB(dB) - range.min_dB) / (range.max_dB - range.min_dB) : 0.0f;
+    }
+    static constexpr float lookup(const float (&table)[table_points], float x) noexcept {
+        if (!(x > 0)) return table[0];
+        if (x >= 1) return table[table_points - 1];
+        float at = x * (table_points - 1);
+        std::size_t i = static_cast<std::size_t>(at);
+        float t = at - static_cast<float>(i);
+        return table[i] + t * (table[i + 1] - table[i]);
+    }
+
+    endpoint_volume::volume_range range{0, 0, 0};
+    UINT steps = 0;
+    DWORD support = 0;
+    volume_taper curve = volume_taper::cubic;
+    float dB_to_gain_table[table_points] = {};
+};
+
+/**
+ * The `volume_model` of one endpoint, rebuilt when the endpoint's hardware may have changed.
+ *
+ * Forward `IMMNotificationClient::OnPropertyValueChanged` and `OnDeviceStateChanged` to the handlers below (these
+ * are thread-safe): a driver or format change of the device can change its range, steps or hardware support. Or
+ * call `check` now and then to compare against the endpoint. Everything else is not thread-safe.
+ */
+struct volume_model_cache {
+    // Throws whatever `std::wstring` throws
+    explicit volume_model_cache(std::wstring device_id, volume_taper taper = volume_taper::cubic) :
+        device_id(static_cast<std::wstring&&>(device_id)), curve(taper) {}
+
+    volume_model_cache(const volume_model_cache&) = delete;
+    volume_model_cache& operator=(const volume_model_cache&) = delete;
+
+    /**
+     * The model of `v` (the endpoint volume of this cache's device), built if this is the first call or the cache
+     * was invalidated since. Valid until the next call.
+     */
+    h_optional<const volume_model*> get(std::nothrow_t, const endpoint_volume& v) noexcept {
+        unsigned long current = invalidations.load(std::memory_order_acquire);
+        if (built && current == seen_invalidations) return { S_OK, &model };
+        v.reset_step_count_cache();
+        h_optional<volume_model> fresh = volume_model::make(v, curve);
+        if (!fresh) return { fresh.get_status(), nullptr };
+        model = fresh.get_unchecked();
+        built = true;
+        seen_invalidations = current;
+        return { S_OK, &model };
+    }
+
+    /**
+     * Asks `v` for its hardware support, range and step count (three calls) and invalidates the cache if they
+     * differ from the model's. Returns whether they did.
+     */
+    h_optional<bool> check(std::nothrow_t, const endpoint_volume& v) noexcept {
+        if (!built) return { S_OK, false };
+        v.reset_step_count_cache();
+        h_optional<volume_model> fresh = volume_model::make(v, curve);
+        if (!fresh) return { fresh.get_status(), false };
+        if (fresh.get_unchecked().same_hardware(model)) return { S_OK, false };
+        invalidate();
+        return { S_OK, true };
+    }
+
+    // Thread-safe. The model is rebuilt the next time it is used.
+    void invalidate() noexcept {
+        invalidations.fetch_add(1, std::memory_order_release);
+    }
+
+    // Thread-safe. Returns true if this invalidated the cache.
+    bool on_property_value_changed(LPCWSTR changed_device_id, const PROPERTYKEY&) noexcept {
+        if (!changed_device_id || device_id != changed_device_id) return false;
+        invalidate();
+        return true;
+    }
+
+    // Thread-safe. Returns true if this invalidated the cache.
+    bool on_device_state_changed(LPCWSTR changed_device_id, DWORD) noexcept {
+        if (!changed_device_id || device_id != changed_device_id) return false;
+        invalidate();
+        return true;
+    }
+
+    const std::wstring& id() const noexcept {
+        return device_id;
+    }
+private:
+    const std::wstring device_id;
+    const volume_taper curve;
+    volume_model model;
+    bool built = false;
+    std::atomic<unsigned long> invalidations{0};
+    unsigned long seen_invalidations = 0;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_VOLUME_MODEL_H_
@@ -0,0 +1,216 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_VOLUME_MONITOR_H_
+#define WINDOWS_COREAUDIO_WRAPPER_VOLUME_MONITOR_H_
+
+#include "windows.h"
+#include "audioclient.h"
+#include "mmdeviceapi.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "coreaudio/device.h"
+#include "coreaudio/device_collection.h"
+#include "coreaudio/device_enumerator.h"
+#include "coreaudio/device_interfaces/endpoint_volume.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/qpc_time.h"
+#include "coreaudio/util/smart_pointers.h"
+#include "coreaudio/util/throw_com_error.h"
+
+
+namespace coreaudio {
+
+// A difference between two sweeps of a `volume_monitor`
+struct volume_change {
+    std::size_t index;  // Of the endpoint in the monitor
+    float volume;
+    float previous_volume;  // Negative if this is the first sample of the endpoint
+    bool muted;
+    bool previous_muted;
+    LONGLONG time;  // When the new values were read, see `qpc_now`
+};
+
+/**
+ * Samples the master volume and mute of a set of endpoints, for periodic recording.
+ *
+ * `attach` activates an `endpoint_volume` for each active endpoint once and keeps it (reusing the ones already
+ * held for endpoints that are still active). Each `sweep` then only makes the two calls per endpoint, writes the
+ * values into contiguous per-field arrays (`volumes()`, `muted()`, `times()`, `statuses()`, indexed like `id(i)`),
+ * and returns a change record for each endpoint whose values differ from the previous sweep. A sweep doesn't
+ * allocate.
+ *
+ * An endpoint whose read fails keeps its previous values (and reports the failure in `statuses()`). Once one is
+ * invalidated (e.g. unplugged), `needs_attach()` is true until the next `attach`.
+ *
+ * Not thread-safe.
+ */
+struct volume_monitor {
+#ifndef COREAUDIO_NOEXCEPTIONS
+    void attach(const device_enumerator& e, EDataFlow data_flow = eAll) {
+        throw_com_error(attach(std::nothrow, e, data_flow));
+    }
+#endif
+    /**
+     * Replaces the endpoint set with the active endpoints of `data_flow`. Endpoints that fail to activate are left
+     * out. Throws whatever `std::wstring` and `std::vector` throw.
+     */
+    HRESULT attach(std::nothrow_t, const device_enumerator& e, EDataFlow data_flow = eAll) {
+        h_optional<device_collection> collection = e.enum_audio_endpoints(std::nothrow, data_flow, DEVICE_STATE_ACTIVE);
+        if (!collection) return collection.get_status();
+        const device_collection& c = collection.get_unchecked();
+
+        volume_monitor next;
+        next.reserve(c.size());
+        // Endpoints kept, as (index in `next`, index here). They are only moved over once nothing can throw anymore,
+        // so that an exception leaves this monitor as it was.
+        std::vector<std::pair<std::size_t, std::size_t>> kept;
+        kept.reserve(c.size());
+        for (std::size_t i = 0; i < c.size(); ++i) {
+            h_optional<device> d = c.at(std::nothrow, i);
+            if (!d) continue;
+            h_optional<task_memory_pointer<WCHAR>> id = d.get_unchecked().id(std::nothrow);
+            if (!id) continue;
+            std::size_t existing = find(id.get_unchecked().get());
+            if (existing != npos && !invalidated[existing]) {
+                kept.emplace_back(next.size(), existing);
+                next.push(std::wstring(), endpoint_volume(), volume_values[existing], muted_values[existing], times_read[existing],
+                          read_statuses[existing], seen[existing]);
+                continue;
+            }
+            h_optional<endpoint_volume> v = d.get_unchecked().activate_endpoint_volume(std::nothrow);
+            if (!v) continue;
+            next.push(id.get_unchecked().get(), static_cast<endpoint_volume&&>(v.get_unchecked()), -1.0f, 0, 0, S_FALSE, 0);
+        }
+        for (const std::pair<std::size_t, std::size_t>& k : kept) {
+            next.ids[k.first].swap(ids[k.second]);
+            next.interfaces[k.first] = static_cast<endpoint_volume&&>(interfaces[k.second]);
+        }
+        swap(next);
+        return S_OK;
+    }
+
+    // Reads every endpoint once. The returned changes are valid until the next sweep or attach.
+    const std::vector<volume_change>& sweep() noexcept {
+        changes.clear();
+        for (std::size_t i = 0; i < interfaces.size(); ++i) {
+            const endpoint_volume& v = interfaces[i];
+            h_optional<float> level = v.get_master_volume_level_scalar(std::nothrow);
+            h_optional<bool> mute = level ? v.is_muted(std::nothrow) : h_optional<bool>(level.get_status(), false);
+            LONGLONG now = qpc_now();
+            read_statuses[i] = mute.get_status();
+            if (!mute) {
+                if (mute.get_status() == AUDCLNT_E_DEVICE_INVALIDATED) invalidated[i] = 1;
+                continue;
+            }
+            float volume = level.get_unchecked();
+            std::uint8_t muted = mute.get_unchecked() ? 1 : 0;
+            if (!seen[i] || volume != volume_values[i] || muted != muted_values[i]) {
+                // Reserved by `attach`, so this doesn't allocate
+                changes.push_back({ i, volume, seen[i] ? volume_values[i] : -1.0f, muted != 0, muted_values[i] != 0, now });
+            }
+            volume_values[i] = volume;
+            muted_values[i] = muted;
+            times_read[i] = now;
+            seen[i] = 1;
+        }
+        return changes;
+    }
+
+    std::size_t size() const noexcept {
+        return ids.size();
+    }
+    const std::wstring& id(std::size_t i) const noexcept {
+        return ids[i];
+    }
+    // Index of the endpoint with ID `id`, or `npos`
+    std::size_t find(LPCWSTR id) const noexcept {
+        for (std::size_t i = 0; i < ids.size(); ++i) {
+            if (ids[i] == id) return i;
+        }
+        return npos;
+    }
+    const endpoint_volume& get_endpoint_volume(std::size_t i) const noexcept {
+        return interfaces[i];
+    }
+
+    // Master volume scalars of the last successful read of each endpoint (negative if never read)
+    const std::vector<float>& volumes() const noexcept {
+        return volume_values;
+    }
+    // 1 if muted
+    const std::vector<std::uint8_t>& muted() const noexcept {
+        return muted_values;
+    }
+    // When each endpoint was last read successfully, see `qpc_now`
+    const std::vector<LONGLONG>& times() const noexcept {
+        return times_read;
+    }
+    // Result of each endpoint's last read (S_FALSE if not read yet)
+    const std::vector<HRESULT>& statuses() const noexcept {
+        return read_statuses;
+    }
+
+    // Whether an endpoint was invalidated since the last `attach`
+    bool needs_attach() const noexcept {
+        for (std::uint8_t i : invalidated) {
+            if (i) return true;
+        }
+        return false;
+    }
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+private:
+    void reserve(std::size_t n) {
+        ids.reserve(n);
+        interfaces.reserve(n);
+        volume_values.reserve(n);
+        muted_values.reserve(n);
+        times_read.reserve(n);
+        read_statuses.reserve(n);
+        seen.reserve(n);
+        invalidated.reserve(n);
+        changes.reserve(n);
+    }
+
+    void push(std::wstring id, endpoint_volume&& v, float volume, std::uint8_t muted, LONGLONG time, HRESULT status, std::uint8_t was_seen) {
+        ids.push_back(static_cast<std::wstring&&>(id));
+        interfaces.push_back(static_cast<endpoint_volume&&>(v));
+        volume_values.push_back(volume);
+        muted_values.push_back(muted);
+        times_read.push_back(time);
+        read_statuses.push_back(status);
+        seen.push_back(was_seen);
+        invalidated.push_back(0);
+    }
+
+    void swap(volume_monitor& other) noexcept {
+        ids.swap(other.ids);
+        interfaces.swap(other.interfaces);
+        volume_values.swap(other.volume_values);
+        muted_values.swap(other.muted_values);
+        times_read.swap(other.times_read);
+        read_statuses.swap(other.read_statuses);
+        seen.swap(other.seen);
+        invalidated.swap(other.invalidated);
+        changes.swap(other.changes);
+        changes.clear();
+    }
+
+    std::vector<std::wstring> ids;
+    std::vector<endpoint_volume> interfaces;
+    std::vector<float> volume_values;
+    std::vector<std::uint8_t> muted_values;
+    std::vector<LONGLONG> times_read;
+    std::vector<HRESULT> read_statuses;
+    std::vector<std::uint8_t> seen;
+    std::vector<std::uint8_t> invalidated;
+    std::vector<volume_change> changes;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_VOLUME_MONITOR_H_
@@ -0,0 +1,244 @@
+#ifndef WINDOWS_COREAUDIO_WRAPPER_WATCHDOG_H_
+#define WINDOWS_COREAUDIO_WRAPPER_WATCHDOG_H_
+
+#include "windows.h"
+#include "mmdeviceapi.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "coreaudio/apartment_executor.h"
+#include "coreaudio/device.h"
+#include "coreaudio/device_collection.h"
+#include "coreaudio/device_enumerator.h"
+#include "coreaudio/util/agile_reference.h"
+#include "coreaudio/util/h_optional.h"
+#include "coreaudio/util/qpc_time.h"
+
+
+namespace coreaudio {
+
+namespace detail {
+
+template<typename...>
+struct make_void {
+    using type = void;
+};
+
+// How `watchdog::run` carries a result back to the caller: anything but a wrapper as it is
+template<typename R, typename = void>
+struct watchdog_transport {
+    using type = R;
+    static R pack(R&& r) {
+        return static_cast<R&&>(r);
+    }
+    static R unpack(R&& r) {
+        return static_cast<R&&>(r);
+    }
+};
+
+// A wrapper through an `agile_reference`, made on the worker and resolved on the caller
+template<typename Wrapper>
+struct watchdog_transport<h_optional<Wrapper>, typename make_void<typename Wrapper::raw_interface>::type> {
+    using type = h_optional<agile_reference<Wrapper>>;
+    static type pack(h_optional<Wrapper>&& r) noexcept {
+        if (!r) return { r.get_status(), agile_reference<Wrapper>() };
+        return agile_reference<Wrapper>::make(r.get_unchecked());
+    }
+    static h_optional<Wrapper> unpack(type&& t) noexcept {
+        if (!t) return { t.get_status(), Wrapper() };
+        return t.get_unchecked().resolve(std::nothrow);
+    }
+};
+
+}
+
+/**
+ * A call site guarded by a `watchdog`: its deadline, and a histogram of how long its calls took.
+ *
+ * Bucket `i` counts calls that took [2^i, 2^(i+1)) µs (bucket 0 also counts faster ones, the last one slower ones).
+ * Durations are measured on the worker around the call itself, so calls the caller stopped waiting for are counted
+ * when they finally return. Everything is thread-safe.
+ *
+ * Usually a static per call site. It must outlive the calls made through it, including abandoned ones.
+ */
+struct watchdog_site {
+    static constexpr std::size_t bucket_count = 32;
+
+    watchdog_site(const char* name, std::chrono::milliseconds deadline) noexcept : site_name(name), deadline_ms(deadline.count()) {}
+
+    watchdog_site(const watchdog_site&) = delete;
+    watchdog_site& operator=(const watchdog_site&) = delete;
+
+    const char* name() const noexcept {
+        return site_name;
+    }
+
+    std::chrono::milliseconds deadline() const noexcept {
+        return std::chrono::milliseconds(deadline_ms.load(std::memory_order_relaxed));
+    }
+    void set_deadline(std::chrono::milliseconds deadline) noexcept {
+        deadline_ms.store(deadline.count(), std::memory_order_relaxed);
+    }
+
+    std::uint64_t bucket(std::size_t i) const noexcept {
+        return buckets[i].load(std::memory_order_relaxed);
+    }
+    // Lower edge of bucket `i`
+    static std::uint64_t bucket_floor_microseconds(std::size_t i) noexcept {
+        return i == 0 ? 0 : std::uint64_t(1) << i;
+    }
+
+    // Calls that returned
+    std::uint64_t calls() const noexcept {
+        return finished.load(std::memory_order_relaxed);
+    }
+    // Calls whose caller got a timeout
+    std::uint64_t timeouts() const noexcept {
+        return timed_out.load(std::memory_order_relaxed);
+    }
+    // Calls started and not returned yet (hung ones among them)
+    std::uint64_t in_flight() const noexcept {
+        return started.load(std::memory_order_relaxed) - finished.load(std::memory_order_relaxed);
+    }
+    std::uint64_t max_microseconds() const noexcept {
+        return longest.load(std::memory_order_relaxed);
+    }
+
+    // Upper edge of the bucket holding the `p`-th quantile (0..1) of the durations; 0 if there were no calls
+    std::uint64_t quantile_microseconds(double p) const noexcept {
+        std::uint64_t counts[bucket_count];
+        std::uint64_t total = 0;
+        for (std::size_t i = 0; i < bucket_count; ++i) total += counts[i] = bucket(i);
+        if (total == 0) return 0;
+        // Nearest rank: the smallest duration with at least `p` of the calls at or below it
+        double wanted = p * static_cast<double>(total);
+        std::uint64_t rank = static_cast<std::uint64_t>(wanted);
+        if (static_cast<double>(rank) < wanted) ++rank;
+        rank = rank == 0 ? 0 : (rank > total ? total : rank) - 1;
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            if (rank < counts[i]) return i + 1 < bucket_count ? bucket_floor_microseconds(i + 1) : max_microseconds();
+            rank -= counts[i];
+        }
+        return max_microseconds();
+    }
+
+    // Clears the counts (calls in flight stay counted as such)
+    void reset() noexcept {
+        for (std::atomic<std::uint64_t>& b : buckets) b.store(0, std::memory_order_relaxed);
+        started.fetch_sub(finished.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+        timed_out.store(0, std::memory_order_relaxed);
+        longest.store(0, std::memory_order_relaxed);
+    }
+private:
+    friend struct watchdog;
+
+    void call_started() noexcept {
+        started.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void call_finished(std::uint64_t microseconds) noexcept {
+        std::size_t i = 0;
+        while (i + 1 < bucket_count && (microseconds >> (i + 1)) != 0) ++i;
+        buckets[i].fetch_add(1, std::memory_order_relaxed);
+        std::uint64_t previous = longest.load(std::memory_order_relaxed);
+        while (microseconds > previous && !longest.compare_exchange_weak(previous, microseconds, std::memory_order_relaxed)) {}
+        finished.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const char* const site_name;
+    std::atomic<long long> deadline_ms;
+    std::atomic<std::uint64_t> buckets[bucket_count] = {};
+    std::atomic<std::uint64_t> started{0};
+    std::atomic<std::uint64_t> finished{0};
+    std::atomic<std::uint64_t> timed_out{0};
+    std::atomic<std::uint64_t> longest{0};
+};
+
+/**
+ * Runs Core Audio calls that can hang (while the audio service restarts, or with a misbehaving driver) on its own
+ * MTA workers, and stops waiting for them at their site's deadline: the caller gets
+ * `HRESULT_FROM_WIN32(ERROR_TIMEOUT)` while the call runs on in the background and is dropped when it returns.
+ *
+ * The calls get wrappers valid on the worker (see `apartment_executor::submit`). A wrapper they return (as an
+ * `h_optional`) is marshaled back through an `agile_reference` unless it is agile, so the caller (usually an STA
+ * thread) gets one valid in its own apartment; any other result is handed back as it is.
+ *
+ * Each hung call holds a worker, and later calls queue behind them, so size the pool for the hangs to tolerate.
+ * Destroying the watchdog waits for the calls still running.
+ */
+struct watchdog {
+    // Starts `threads` workers. Throws whatever `apartment_executor::make` throws.
+    static h_optional<std::unique_ptr<watchdog>> make(std::size_t threads = 2) {
+        h_optional<std::unique_ptr<apartment_executor>> e = apartment_executor::make(threads);
+        if (!e) return { e.get_status(), nullptr };
+        return { S_OK, std::unique_ptr<watchdog>(new watchdog(static_cast<std::unique_ptr<apartment_executor>&&>(e.get_unchecked()))) };
+    }
+
+    /**
+     * `f(handles...)` (returning an `HRESULT` or an `h_optional<T>`) on a worker, or a timeout after
+     * `site.deadline()`. Fails with the `agile_reference` failure if a returned wrapper can't be marshaled.
+     * Throws whatever `apartment_executor::submit` throws, and whatever `f` throws if it returns in time.
+     */
+    template<typename F, typename... Wrappers>
+    auto run(watchdog_site& site, F&& f, const Wrappers&... handles) -> decltype(f(std::declval<const Wrappers&>()...)) {
+        using result_type = decltype(f(std::declval<const Wrappers&>()...));
+        using transport = detail::watchdog_transport<result_type>;
+        using transported_type = typename transport::type;
+        watchdog_site* s = &site;
+        std::future<transported_type> result = executor->submit([s, f = std::forward<F>(f)](const Wrappers&... w) mutable -> transported_type {
+            struct timer {
+                watchdog_site* site;
+                LONGLONG start;
+                ~timer() {
+                    LONGLONG elapsed = qpc_now() - start;
+                    site->call_finished(elapsed > 0 ? static_cast<std::uint64_t>(elapsed / 10) : 0);
+                }
+            };
+            s->call_started();
+            timer t{ s, qpc_now() };
+            return transport::pack(f(w...));
+        }, handles...);
+        if (result.wait_for(site.deadline()) == std::future_status::timeout) {
+            site.timed_out.fetch_add(1, std::memory_order_relaxed);
+            return detail::failed_result<result_type>::make(HRESULT_FROM_WIN32(ERROR_TIMEOUT));
+        }
+        return transport::unpack(result.get());
+    }
+
+    h_optional<device_collection> enum_audio_endpoints(watchdog_site& site, const device_enumerator& e, EDataFlow data_flow,
+                                                       DWORD state_mask = DEVICE_STATEMASK_ALL) {
+        return run(site, [data_flow, state_mask](const device_enumerator& e) { return e.enum_audio_endpoints(std::nothrow, data_flow, state_mask); }, e);
+    }
+
+    h_optional<device> get_default_endpoint(watchdog_site& site, const device_enumerator& e, EDataFlow data_flow, ERole role = eConsole) {
+        return run(site, [data_flow, role](const device_enumerator& e) { return e.get_default_endpoint(std::nothrow, data_flow, role); }, e);
+    }
+
+    h_optional<endpoint_volume> activate_endpoint_volume(watchdog_site& site, const device& d, DWORD class_ctx = CLSCTX_ALL) {
+        return run(site, [class_ctx](const device& d) { return d.activate_endpoint_volume(std::nothrow, class_ctx); }, d);
+    }
+
+    h_optional<audio_client> activate_audio_client(watchdog_site& site, const device& d, DWORD class_ctx = CLSCTX_ALL) {
+        return run(site, [class_ctx](const device& d) { return d.activate_audio_client(std::nothrow, class_ctx); }, d);
+    }
+
+    apartment_executor& get_executor() noexcept {
+        return *executor;
+    }
+private:
+    explicit watchdog(std::unique_ptr<apartment_executor> executor) noexcept : executor(static_cast<std::unique_ptr<apartment_executor>&&>(executor)) {}
+
+    std::unique_ptr<apartment_executor> executor;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_WATCHDOG_H_
@@ -0,0 +1,185 @@
+// Module interface unit of the wrapper: `import windows_coreaudio_wrapper;` instead of including the headers.
+//
+// Windows SDK macros (`S_OK`, `DEVICE_STATE_ACTIVE`, `eRender`, ...) aren't exported from a named module, so a
+// translation unit that needs them still includes the SDK headers it uses (e.g. "mmdeviceapi.h"). Configuration
+// macros (`COREAUDIO_NOEXCEPTIONS`, `COREAUDIO_CALL_OBSERVER`, `COREAUDIO_SIMD_*`) have to be set when building this
+// unit, not where it is imported.
+module;
+
+#include "windows.h"
+
+#include "coreaudio/coreaudio.h"
+#include "coreaudio/apartment_executor.h"
+#include "coreaudio/audio_profile.h"
+#include "coreaudio/capture_file_writer.h"
+#include "coreaudio/capture_group.h"
+#include "coreaudio/device_cache.h"
+#include "coreaudio/device_interfaces/device_interfaces.h"
+#include "coreaudio/device_name_index.h"
+#include "coreaudio/device_snapshot.h"
+#include "coreaudio/event_bus.h"
+#include "coreaudio/dsp/channel_mixer.h"
+#include "coreaudio/dsp/clock_regression.h"
+#include "coreaudio/dsp/resampler.h"
+#include "coreaudio/format_cache.h"
+#include "coreaudio/loopback_capture.h"
+#include "coreaudio/resilient_interface.h"
+#include "coreaudio/shared_state.h"
+#include "coreaudio/stream_clock.h"
+#include "coreaudio/topology_graph.h"
+#include "coreaudio/util/agile_reference.h"
+#include "coreaudio/util/broadcast_ring.h"
+#include "coreaudio/util/callback_object.h"
+#include "coreaudio/util/com_ref.h"
+#include "coreaudio/util/metrics.h"
+#include "coreaudio/util/qpc_time.h"
+#include "coreaudio/util/utf8.h"
+#include "coreaudio/util/wave_format.h"
+#include "coreaudio/volume_model.h"
+#include "coreaudio/volume_monitor.h"
+#include "coreaudio/watchdog.h"
+
+export module windows_coreaudio_wrapper;
+
+export namespace coreaudio {
+
+// util
+using coreaudio::h_optional;
+using coreaudio::h_result;
+using coreaudio::as_result;
+using coreaudio::com_pointer;
+using coreaudio::task_memory_pointer;
+using coreaudio::com_ref;
+using coreaudio::agile_reference;
+using coreaudio::broadcast_ring;
+using coreaudio::callback_object;
+using coreaudio::null_call_observer;
+using coreaudio::metrics_registry;
+using coreaudio::metrics_call_observer;
+using coreaudio::metrics_dumper;
+using coreaudio::default_call_observer;
+using coreaudio::qpc_now;
+using coreaudio::utf8_capacity;
+using coreaudio::utf16_to_utf8;
+using coreaudio::append_utf8;
+using coreaudio::wave_format_size;
+using coreaudio::copy_wave_format;
+#ifndef COREAUDIO_NOEXCEPTIONS
+using coreaudio::throw_com_error;
+#endif
+
+// Wrappers
+using coreaudio::com_context;
+using coreaudio::device;
+using coreaudio::device_collection;
+using coreaudio::device_enumerator;
+using coreaudio::notification_client;
+using coreaudio::audio_capture_client;
+using coreaudio::audio_client;
+using coreaudio::audio_clock;
+using coreaudio::audio_clock_adjustment;
+using coreaudio::device_topology;
+using coreaudio::endpoint_volume;
+
+// Built on the wrappers
+using coreaudio::is_invalidation_error;
+using coreaudio::resilience_policy;
+using coreaudio::resilient_interface;
+using coreaudio::resilient_endpoint_volume;
+using coreaudio::format_cache;
+using coreaudio::loopback_capture_options;
+using coreaudio::shared_loopback_capture;
+using coreaudio::loopback_capture_registry;
+using coreaudio::capture_container;
+using coreaudio::capture_writer_options;
+using coreaudio::capture_writer_stats;
+using coreaudio::capture_file_writer;
+using coreaudio::capture_group_options;
+using coreaudio::capture_member_stats;
+using coreaudio::capture_group;
+using coreaudio::stream_clock;
+using coreaudio::device_snapshot_entry;
+using coreaudio::device_snapshot_failure;
+using coreaudio::device_snapshot;
+using coreaudio::operator==;
+using coreaudio::operator!=;
+using coreaudio::cached_device;
+using coreaudio::device_cache_image;
+using coreaudio::device_cache_change;
+using coreaudio::device_cache;
+using coreaudio::device_name_index;
+using coreaudio::topology_node;
+using coreaudio::topology_graph;
+using coreaudio::topology_graph_cache;
+using coreaudio::apartment_executor;
+using coreaudio::profile_switch;
+using coreaudio::endpoint_profile;
+using coreaudio::audio_profile;
+using coreaudio::endpoint_policy;
+using coreaudio::profile_setting;
+using coreaudio::profile_change;
+using coreaudio::profile_diff;
+using coreaudio::device_state_event;
+using coreaudio::default_device_event;
+using coreaudio::property_event;
+using coreaudio::endpoint_volume_event;
+using coreaudio::session_event;
+using coreaudio::audio_event_batch;
+using coreaudio::event_bus_stats;
+using coreaudio::event_bus;
+using coreaudio::watchdog_site;
+using coreaudio::watchdog;
+using coreaudio::shared_state_publisher;
+using coreaudio::shared_device_state;
+using coreaudio::shared_state_reader;
+using coreaudio::volume_change;
+using coreaudio::volume_monitor;
+using coreaudio::volume_taper;
+using coreaudio::taper_to_dB;
+using coreaudio::taper_from_dB;
+using coreaudio::volume_model;
+using coreaudio::volume_model_cache;
+
+namespace dsp {
+
+using coreaudio::dsp::polyphase_resampler;
+using coreaudio::dsp::clock_regression;
+using coreaudio::dsp::downmix_options;
+using coreaudio::dsp::mix_matrix;
+using coreaudio::dsp::channel_mixer;
+using coreaudio::dsp::channel_count;
+using coreaudio::dsp::channel_index;
+
+namespace speaker {
+
+using coreaudio::dsp::speaker::front_left;
+using coreaudio::dsp::speaker::front_right;
+using coreaudio::dsp::speaker::front_center;
+using coreaudio::dsp::speaker::low_frequency;
+using coreaudio::dsp::speaker::back_left;
+using coreaudio::dsp::speaker::back_right;
+using coreaudio::dsp::speaker::front_left_of_center;
+using coreaudio::dsp::speaker::front_right_of_center;
+using coreaudio::dsp::speaker::back_center;
+using coreaudio::dsp::speaker::side_left;
+using coreaudio::dsp::speaker::side_right;
+using coreaudio::dsp::speaker::top_center;
+using coreaudio::dsp::speaker::top_front_left;
+using coreaudio::dsp::speaker::top_front_center;
+using coreaudio::dsp::speaker::top_front_right;
+using coreaudio::dsp::speaker::top_back_left;
+using coreaudio::dsp::speaker::top_back_center;
+using coreaudio::dsp::speaker::top_back_right;
+using coreaudio::dsp::speaker::all;
+using coreaudio::dsp::speaker::mono;
+using coreaudio::dsp::speaker::stereo;
+using coreaudio::dsp::speaker::quad;
+using coreaudio::dsp::speaker::surround_5_1;
+using coreaudio::dsp::speaker::surround_7_1;
+using coreaudio::dsp::speaker::surround_7_1_4;
+
+}
+
+}
+
+}
@@ -0,0 +1,78 @@
+# Configures sample/compile_bench in BINARY_DIR, then rebuilds each variant from scratch and prints how long it took.
+#
+# cmake -DBINARY_DIR=<dir> [-DGENERATOR=<generator>] [-DCXX_COMPILER=<compiler>] [-DCXX_FLAGS=<flags>]
+#       [-DTUS=<translation units per variant>] [-DMODULE=ON] [-DCONFIG=Release] -P measure.cmake
+cmake_minimum_required(VERSION 3.13.0)
+
+if(NOT BINARY_DIR)
+    message(FATAL_ERROR "measure.cmake: set BINARY_DIR")
+endif()
+if(NOT CONFIG)
+    set(CONFIG Release)
+endif()
+if(NOT TUS)
+    set(TUS 64)
+endif()
+
+set(configure_args -S "${CMAKE_CURRENT_LIST_DIR}" -B "${BINARY_DIR}" "-DCMAKE_BUILD_TYPE=${CONFIG}"
+    "-DCOREAUDIO_COMPILE_BENCHMARK_TUS=${TUS}" "-DCOREAUDIO_BUILD_MODULE=${MODULE}")
+if(GENERATOR)
+    list(APPEND configure_args -G "${GENERATOR}")
+endif()
+if(CXX_COMPILER)
+    list(APPEND configure_args "-DCMAKE_CXX_COMPILER=${CXX_COMPILER}")
+endif()
+if(CXX_FLAGS)
+    list(APPEND configure_args "-DCMAKE_CXX_FLAGS=${CXX_FLAGS}")
+endif()
+execute_process(COMMAND "${CMAKE_COMMAND}" ${configure_args} OUTPUT_QUIET RESULT_VARIABLE failed)
+if(failed)
+    message(FATAL_ERROR "measure.cmake: configuring ${BINARY_DIR} failed")
+endif()
+
+# Microseconds where the timestamp supports it (CMake 3.23), whole seconds otherwise
+function(now out)
+    if(CMAKE_VERSION VERSION_GREATER_EQUAL 3.23)
+        string(TIMESTAMP t "%s%f" UTC)
+    else()
+        string(TIMESTAMP t "%s000000" UTC)
+    endif()
+    set(${out} ${t} PARENT_SCOPE)
+endfunction()
+
+function(build target)
+    execute_process(COMMAND "${CMAKE_COMMAND}" --build "${BINARY_DIR}" --config ${CONFIG} --target ${target}
+                    OUTPUT_VARIABLE output ERROR_VARIABLE output RESULT_VARIABLE failed)
+    if(failed)
+        message(FATAL_ERROR "measure.cmake: building ${target} failed:\n${output}")
+    endif()
+endfunction()
+
+set(variants header fwd)
+if(EXISTS "${BINARY_DIR}/module")
+    # Built once up front: its cost is paid once per build, not per translation unit
+    build(windows_coreaudio_wrapper_module)
+    list(APPEND variants module)
+endif()
+
+set(header_us 0)
+foreach(variant IN LISTS variants)
+    # Only the generated sources are touched, so exactly the variant's translation units are recompiled
+    file(GLOB sources "${BINARY_DIR}/${variant}/*.cpp")
+    build(compile_bench_${variant})
+    file(TOUCH ${sources})
+    now(start)
+    build(compile_bench_${variant})
+    now(stop)
+    math(EXPR us "${stop} - ${start}")
+    math(EXPR ms "${us} / 1000")
+    if(variant STREQUAL header)
+        set(header_us ${us})
+        message(STATUS "${variant}: ${TUS} translation units in ${ms} ms")
+    elseif(header_us GREATER 0)
+        math(EXPR percent "${us} * 100 / ${header_us}")
+        message(STATUS "${variant}: ${TUS} translation units in ${ms} ms (${percent}% of header)")
+    else()
+        message(STATUS "${variant}: ${TUS} translation units in ${ms} ms")
+    endif()
+endforeach()
@@ -0,0 +1,388 @@
+// In-process fakes of `IMMDeviceEnumerator`, `IMMDeviceCollection`, `IMMDevice` and `IAudioEndpointVolume`
+// that can add, remove and change the state of endpoints from any thread (firing `IMMNotificationClient`
+// notifications like the real enumerator), and that randomly fail calls with injected `HRESULT`s.
+#ifndef WINDOWS_COREAUDIO_WRAPPER_SAMPLE_FAKE_ENDPOINTS_H_
+#define WINDOWS_COREAUDIO_WRAPPER_SAMPLE_FAKE_ENDPOINTS_H_
+
+#include <Windows.h>
+#include <audioclient.h>
+#include <endpointvolume.h>
+#include <mmdeviceapi.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "coreaudio/util/callback_object.h"
+#include "coreaudio/util/smart_pointers.h"
+
+
+namespace fake {
+
+enum class fault_site { item, get_id, activate, volume, count };
+
+/**
+ * Fails calls at each `fault_site` with probability `rate` (out of 65536), with one of the `HRESULT`s in `errors`.
+ * Configure before starting any threads.
+ */
+struct fault_injector {
+    std::uint32_t rate[static_cast<int>(fault_site::count)] = {};
+    std::vector<HRESULT> errors = { E_NOTFOUND, AUDCLNT_E_DEVICE_INVALIDATED, E_OUTOFMEMORY };
+    std::atomic<std::uint64_t> injected[static_cast<int>(fault_site::count)] = {};
+
+    void set_rate(fault_site site, double probability) noexcept {
+        rate[static_cast<int>(site)] = static_cast<std::uint32_t>(probability * 65536.0);
+    }
+
+    void set_all_rates(double probability) noexcept {
+        for (int i = 0; i < static_cast<int>(fault_site::count); ++i) set_rate(static_cast<fault_site>(i), probability);
+    }
+
+    HRESULT maybe_fail(fault_site site) noexcept {
+        int i = static_cast<int>(site);
+        if (rate[i] == 0 || errors.empty()) return S_OK;
+        std::uint32_t r = next_random();
+        if ((r & 0xFFFF) >= rate[i]) return S_OK;
+        injected[i].fetch_add(1, std::memory_order_relaxed);
+        return errors[(r >> 16) % errors.size()];
+    }
+private:
+    static std::uint32_t next_random() noexcept {
+        thread_local std::uint32_t state = static_cast<std::uint32_t>(GetCurrentThreadId()) * 2654435761u | 1u;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+};
+
+template<typename I>
+using com_object = coreaudio::callback_object<I>;
+
+struct device;
+
+struct endpoint_volume final : com_object<IAudioEndpointVolume> {
+    endpoint_volume(device* d, std::uint32_t generation) noexcept;
+
+    HRESULT STDMETHODCALLTYPE RegisterControlChangeNotify(IAudioEndpointVolumeCallback* callback) override { return callback ? check() : E_POINTER; }
+    HRESULT STDMETHODCALLTYPE UnregisterControlChangeNotify(IAudioEndpointVolumeCallback* callback) override { return callback ? S_OK : E_POINTER; }
+    HRESULT STDMETHODCALLTYPE GetChannelCount(UINT* count) override;
+    HRESULT STDMETHODCALLTYPE SetMasterVolumeLevel(float level_dB, LPCGUID) override;
+    HRESULT STDMETHODCALLTYPE SetMasterVolumeLevelScalar(float level, LPCGUID) override;
+    HRESULT STDMETHODCALLTYPE GetMasterVolumeLevel(float* level_dB) override;
+    HRESULT STDMETHODCALLTYPE GetMasterVolumeLevelScalar(float* level) override;
+    HRESULT STDMETHODCALLTYPE SetChannelVolumeLevel(UINT i, float level_dB, LPCGUID) override { return i < 2 ? SetMasterVolumeLevel(level_dB, nullptr) : E_INVALIDARG; }
+    HRESULT STDMETHODCALLTYPE SetChannelVolumeLevelScalar(UINT i, float level, LPCGUID) override { return i < 2 ? SetMasterVolumeLevelScalar(level, nullptr) : E_INVALIDARG; }
+    HRESULT STDMETHODCALLTYPE GetChannelVolumeLevel(UINT i, float* level_dB) override { return i < 2 ? GetMasterVolumeLevel(level_dB) : E_INVALIDARG; }
+    HRESULT STDMETHODCALLTYPE GetChannelVolumeLevelScalar(UINT i, float* level) override { return i < 2 ? GetMasterVolumeLevelScalar(level) : E_INVALIDARG; }
+    HRESULT STDMETHODCALLTYPE SetMute(BOOL mute, LPCGUID) override;
+    HRESULT STDMETHODCALLTYPE GetMute(BOOL* mute) override;
+    HRESULT STDMETHODCALLTYPE GetVolumeStepInfo(UINT* step, UINT* step_count) override;
+    HRESULT STDMETHODCALLTYPE VolumeStepUp(LPCGUID) override;
+    HRESULT STDMETHODCALLTYPE VolumeStepDown(LPCGUID) override;
+    HRESULT STDMETHODCALLTYPE QueryHardwareSupport(DWORD* mask) override;
+    HRESULT STDMETHODCALLTYPE GetVolumeRange(float* min_dB, float* max_dB, float* increment_dB) override;
+private:
+    HRESULT check() noexcept;
+
+    coreaudio::com_pointer<IMMDevice> owner;
+    device* d;
+    std::uint32_t generation;
+};
+
+struct device final : com_object<IMMDevice> {
+    device(std::wstring id, DWORD state, fault_injector& faults) : id(static_cast<std::wstring&&>(id)), faults(faults), state(state) {}
+
+    HRESULT STDMETHODCALLTYPE Activate(REFIID iid, DWORD, PROPVARIANT*, void** ppv) override {
+        if (!ppv) return E_POINTER;
+        *ppv = nullptr;
+        HRESULT hr = faults.maybe_fail(fault_site::activate);
+        if (FAILED(hr)) return hr;
+        if (state.load(std::memory_order_acquire) != DEVICE_STATE_ACTIVE) return AUDCLNT_E_DEVICE_INVALIDATED;
+        if (iid != __uuidof(IAudioEndpointVolume)) return E_NOINTERFACE;
+        *ppv = static_cast<IAudioEndpointVolume*>(new endpoint_volume(this, generation.load(std::memory_order_acquire)));
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OpenPropertyStore(DWORD, IPropertyStore** store) override {
+        if (!store) return E_POINTER;
+        *store = nullptr;
+        return E_NOTIMPL;
+    }
+    HRESULT STDMETHODCALLTYPE GetId(LPWSTR* out) override {
+        if (!out) return E_POINTER;
+        *out = nullptr;
+        HRESULT hr = faults.maybe_fail(fault_site::get_id);
+        if (FAILED(hr)) return hr;
+        std::size_t bytes = (id.size() + 1) * sizeof(WCHAR);
+        LPWSTR copy = static_cast<LPWSTR>(CoTaskMemAlloc(bytes));
+        if (!copy) return E_OUTOFMEMORY;
+        std::memcpy(copy, id.c_str(), bytes);
+        *out = copy;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE GetState(DWORD* out) override {
+        if (!out) return E_POINTER;
+        *out = state.load(std::memory_order_acquire);
+        return S_OK;
+    }
+
+    // Changing the state away from active invalidates every activated interface
+    void set_state(DWORD new_state) noexcept {
+        if (state.exchange(new_state, std::memory_order_acq_rel) != new_state) {
+            generation.fetch_add(1, std::memory_order_acq_rel);
+        }
+    }
+
+    const std::wstring id;
+    fault_injector& faults;
+    std::atomic<DWORD> state;
+    std::atomic<std::uint32_t> generation{0};
+    std::atomic<float> volume{1.0f};
+    std::atomic<BOOL> mute{FALSE};
+};
+
+inline endpoint_volume::endpoint_volume(device* d, std::uint32_t generation) noexcept : d(d), generation(generation) {
+    d->AddRef();
+    owner.reset(d);
+}
+
+inline HRESULT endpoint_volume::check() noexcept {
+    HRESULT hr = d->faults.maybe_fail(fault_site::volume);
+    if (FAILED(hr)) return hr;
+    if (d->generation.load(std::memory_order_acquire) != generation) return AUDCLNT_E_DEVICE_INVALIDATED;
+    return S_OK;
+}
+
+inline HRESULT endpoint_volume::GetChannelCount(UINT* count) {
+    if (!count) return E_POINTER;
+    HRESULT hr = check();
+    *count = SUCCEEDED(hr) ? 2 : 0;
+    return hr;
+}
+inline HRESULT endpoint_volume::SetMasterVolumeLevel(float level_dB, LPCGUID) {
+    if (level_dB < -64.0f || level_dB > 0.0f) return E_INVALIDARG;
+    return SetMasterVolumeLevelScalar(1.0f + level_dB / 64.0f, nullptr);
+}
+inline HRESULT endpoint_volume::SetMasterVolumeLevelScalar(float level, LPCGUID) {
+    if (level < 0.0f || level > 1.0f) return E_INVALIDARG;
+    HRESULT hr = check();
+    if (SUCCEEDED(hr)) d->volume.store(level, std::memory_order_relaxed);
+    return hr;
+}
+inline HRESULT endpoint_volume::GetMasterVolumeLevel(float* level_dB) {
+    float level = 0;
+    HRESULT hr = GetMasterVolumeLevelScalar(&level);
+    if (level_dB) *level_dB = (level - 1.0f) * 64.0f;
+    return hr;
+}
+inline HRESULT endpoint_volume::GetMasterVolumeLevelScalar(float* level) {
+    if (!level) return E_POINTER;
+    HRESULT hr = check();
+    *level = SUCCEEDED(hr) ? d->volume.load(std::memory_order_relaxed) : 0.0f;
+    return hr;
+}
+inline HRESULT endpoint_volume::SetMute(BOOL mute, LPCGUID) {
+    HRESULT hr = check();
+    if (SUCCEEDED(hr)) d->mute.store(mute, std::memory_order_relaxed);
+    return hr;
+}
+inline HRESULT endpoint_volume::GetMute(BOOL* mute) {
+    if (!mute) return E_POINTER;
+    HRESULT hr = check();
+    *mute = SUCCEEDED(hr) ? d->mute.load(std::memory_order_relaxed) : FALSE;
+    return hr;
+}
+inline HRESULT endpoint_volume::GetVolumeStepInfo(UINT* step, UINT* step_count) {
+    HRESULT hr = check();
+    if (step) *step = SUCCEEDED(hr) ? static_cast<UINT>(d->volume.load(std::memory_order_relaxed) * 64.0f + 0.5f) : 0;
+    if (step_count) *step_count = SUCCEEDED(hr) ? 65 : 0;
+    return hr;
+}
+inline HRESULT endpoint_volume::VolumeStepUp(LPCGUID) {
+    float level = 0;
+    HRESULT hr = GetMasterVolumeLevelScalar(&level);
+    if (FAILED(hr)) return hr;
+    return SetMasterVolumeLevelScalar((std::min)(1.0f, level + 1.0f / 64.0f), nullptr);
+}
+inline HRESULT endpoint_volume::VolumeStepDown(LPCGUID) {
+    float level = 0;
+    HRESULT hr = GetMasterVolumeLevelScalar(&level);
+    if (FAILED(hr)) return hr;
+    return SetMasterVolumeLevelScalar((std::max)(0.0f, level - 1.0f / 64.0f), nullptr);
+}
+inline HRESULT endpoint_volume::QueryHardwareSupport(DWORD* mask) {
+    if (!mask) return E_POINTER;
+    HRESULT hr = check();
+    *mask = 0;
+    return hr;
+}
+inline HRESULT endpoint_volume::GetVolumeRange(float* min_dB, float* max_dB, float* increment_dB) {
+    if (!min_dB || !max_dB || !increment_dB) return E_POINTER;
+    HRESULT hr = check();
+    *min_dB = -64.0f;
+    *max_dB = 0.0f;
+    *increment_dB = 1.0f;
+    return hr;
+}
+
+struct device_collection final : com_object<IMMDeviceCollection> {
+    explicit device_collection(std::vector<device*> devices, fault_injector& faults) noexcept : devices(static_cast<std::vector<device*>&&>(devices)), faults(faults) {}
+
+    HRESULT STDMETHODCALLTYPE GetCount(UINT* count) override {
+        if (!count) return E_POINTER;
+        *count = static_cast<UINT>(devices.size());
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE Item(UINT i, IMMDevice** out) override {
+        if (!out) return E_POINTER;
+        *out = nullptr;
+        if (i >= devices.size()) return E_INVALIDARG;
+        HRESULT hr = faults.maybe_fail(fault_site::item);
+        if (FAILED(hr)) return hr;
+        devices[i]->AddRef();
+        *out = devices[i];
+        return S_OK;
+    }
+private:
+    ~device_collection() override {
+        for (device* d : devices) d->Release();
+    }
+
+    std::vector<device*> devices;
+    fault_injector& faults;
+};
+
+/**
+ * The fake enumerator. `add_device`, `remove_device` and `set_state` can be called from any thread, and call
+ * the registered notification clients synchronously on that thread (outside of any lock).
+ */
+struct device_enumerator final : com_object<IMMDeviceEnumerator> {
+    explicit device_enumerator(fault_injector& faults) noexcept : faults(faults) {}
+
+    HRESULT STDMETHODCALLTYPE EnumAudioEndpoints(EDataFlow, DWORD state_mask, IMMDeviceCollection** out) override {
+        if (!out) return E_POINTER;
+        *out = nullptr;
+        std::vector<device*> matching;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            matching.reserve(devices.size());
+            for (device* d : devices) {
+                if (d->state.load(std::memory_order_acquire) & state_mask) {
+                    d->AddRef();
+                    matching.push_back(d);
+                }
+            }
+        }
+        *out = new device_collection(static_cast<std::vector<device*>&&>(matching), faults);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE GetDefaultAudioEndpoint(EDataFlow, ERole, IMMDevice** out) override {
+        if (!out) return E_POINTER;
+        *out = nullptr;
+        std::lock_guard<std::mutex> lock(m);
+        for (device* d : devices) {
+            if (d->state.load(std::memory_order_acquire) == DEVICE_STATE_ACTIVE) {
+                d->AddRef();
+                *out = d;
+                return S_OK;
+            }
+        }
+        return E_NOTFOUND;
+    }
+    HRESULT STDMETHODCALLTYPE GetDevice(LPCWSTR id, IMMDevice** out) override {
+        if (!id || !out) return E_POINTER;
+        *out = nullptr;
+        std::lock_guard<std::mutex> lock(m);
+        for (device* d : devices) {
+            if (d->id == id) {
+                d->AddRef();
+                *out = d;
+                return S_OK;
+            }
+        }
+        return E_NOTFOUND;
+    }
+    HRESULT STDMETHODCALLTYPE RegisterEndpointNotificationCallback(IMMNotificationClient* client) override {
+        if (!client) return E_POINTER;
+        std::lock_guard<std::mutex> lock(m);
+        client->AddRef();
+        clients.push_back(client);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE UnregisterEndpointNotificationCallback(IMMNotificationClient* client) override {
+        if (!client) return E_POINTER;
+        std::lock_guard<std::mutex> lock(m);
+        auto it = std::find(clients.begin(), clients.end(), client);
+        if (it == clients.end()) return E_NOTFOUND;
+        clients.erase(it);
+        client->Release();
+        return S_OK;
+    }
+
+    void add_device(const std::wstring& id) {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            for (device* d : devices) {
+                if (d->id == id) return;
+            }
+            devices.push_back(new device(id, DEVICE_STATE_ACTIVE, faults));
+        }
+        notify([&](IMMNotificationClient* c) { c->OnDeviceAdded(id.c_str()); });
+    }
+
+    void remove_device(const std::wstring& id) {
+        device* removed = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            auto it = std::find_if(devices.begin(), devices.end(), [&](device* d) { return d->id == id; });
+            if (it == devices.end()) return;
+            removed = *it;
+            devices.erase(it);
+        }
+        removed->set_state(DEVICE_STATE_NOTPRESENT);
+        removed->Release();
+        notify([&](IMMNotificationClient* c) { c->OnDeviceRemoved(id.c_str()); });
+    }
+
+    void set_state(const std::wstring& id, DWORD state) {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            auto it = std::find_if(devices.begin(), devices.end(), [&](device* d) { return d->id == id; });
+            if (it == devices.end()) return;
+            (*it)->set_state(state);
+        }
+        notify([&](IMMNotificationClient* c) { c->OnDeviceStateChanged(id.c_str(), state); });
+    }
+private:
+    ~device_enumerator() override {
+        for (device* d : devices) d->Release();
+        for (IMMNotificationClient* c : clients) c->Release();
+    }
+
+    template<typename F>
+    void notify(F&& f) {
+        std::vector<IMMNotificationClient*> to_notify;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            to_notify = clients;
+            for (IMMNotificationClient* c : to_notify) c->AddRef();
+        }
+        for (IMMNotificationClient* c : to_notify) {
+            f(c);
+            c->Release();
+        }
+    }
+
+    fault_injector& faults;
+    std::mutex m;
+    std::vector<device*> devices;
+    std::vector<IMMNotificationClient*> clients;
+};
+
+}
+
+#endif  // WINDOWS_COREAUDIO_WRAPPER_SAMPLE_FAKE_ENDPOINTS_H_
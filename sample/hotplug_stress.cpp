@@ -0,0 +1,249 @@
+// Hotplug-storm stress harness.
+//
+// Several "storm" threads add, remove and change the state of bursts of endpoints on a fake enumerator (see
+// fake_endpoints.h), firing notifications from each thread, while "reader" threads enumerate, `to_vector` and
+// poke every device, and a notification client re-resolves and activates each endpoint it is told about.
+// `E_NOTFOUND`, `AUDCLNT_E_DEVICE_INVALIDATED` and `E_OUTOFMEMORY` are injected into `Item`, `GetId`, `Activate`
+// and the volume calls.
+//
+// Usage: hotplug_stress [seconds = 5] [fault probability = 0.01] [storm threads = 4] [reader threads = 4]
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Count every COM call made through the wrappers, and which HRESULTs they fail with
+namespace stress {
+
+struct failure_counts {
+    std::mutex m;
+    std::map<HRESULT, std::uint64_t> by_status;
+    std::atomic<std::uint64_t> calls{0};
+};
+
+inline failure_counts& failures() {
+    static failure_counts counts;
+    return counts;
+}
+
+struct counting_call_observer {
+    struct token {};
+
+    template<typename Interface>
+    static token before_call(Interface*, const char*) noexcept {
+        failures().calls.fetch_add(1, std::memory_order_relaxed);
+        return {};
+    }
+    template<typename Interface>
+    static void after_call(const token&, Interface*, const char*, HRESULT status) noexcept {
+        if (FAILED(status)) {
+            std::lock_guard<std::mutex> lock(failures().m);
+            ++failures().by_status[status];
+        }
+    }
+};
+
+}
+
+#define COREAUDIO_CALL_OBSERVER ::stress::counting_call_observer
+#define COREAUDIO_NOEXCEPTIONS
+#include "coreaudio/coreaudio.h"
+#include "coreaudio/notification_client.h"
+
+#include "fake_endpoints.h"
+
+
+namespace stress {
+
+using clock = std::chrono::steady_clock;
+
+// Each thread records into its own `latencies`, which are merged after the threads are joined.
+struct latencies {
+    std::vector<std::uint32_t> enumerate_us;
+    std::vector<std::uint32_t> to_vector_us;
+    std::vector<std::uint32_t> notification_us;
+    std::uint64_t failed_operations = 0;
+
+    void merge(const latencies& other) {
+        enumerate_us.insert(enumerate_us.end(), other.enumerate_us.begin(), other.enumerate_us.end());
+        to_vector_us.insert(to_vector_us.end(), other.to_vector_us.begin(), other.to_vector_us.end());
+        notification_us.insert(notification_us.end(), other.notification_us.begin(), other.notification_us.end());
+        failed_operations += other.failed_operations;
+    }
+};
+
+inline std::uint32_t microseconds_since(clock::time_point start) {
+    return static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count());
+}
+
+// Resolves and activates every device it is notified about, like a real client rebuilding its state
+struct storm_client final : coreaudio::notification_client {
+    explicit storm_client(const coreaudio::device_enumerator& e) noexcept : e(e) {}
+
+    HRESULT STDMETHODCALLTYPE OnDeviceStateChanged(LPCWSTR id, DWORD) override { return handle(id); }
+    HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR id) override { return handle(id); }
+    HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR id) override { return handle(id); }
+
+    latencies take() {
+        std::lock_guard<std::mutex> lock(m);
+        latencies result;
+        std::swap(result, recorded);
+        return result;
+    }
+private:
+    HRESULT handle(LPCWSTR id) {
+        clock::time_point start = clock::now();
+        bool failed = true;
+        coreaudio::h_optional<coreaudio::device> d = e.get_device(std::nothrow, id);
+        if (d) {
+            coreaudio::h_optional<coreaudio::endpoint_volume> v = d.get_unchecked().activate_endpoint_volume(std::nothrow);
+            failed = !v || !v.get_unchecked().get_master_volume_level_scalar(std::nothrow);
+        }
+        std::uint32_t elapsed = microseconds_since(start);
+        std::lock_guard<std::mutex> lock(m);
+        recorded.notification_us.push_back(elapsed);
+        if (failed) ++recorded.failed_operations;
+        return S_OK;
+    }
+
+    const coreaudio::device_enumerator& e;
+    std::mutex m;
+    latencies recorded;
+};
+
+inline std::wstring endpoint_id(unsigned storm, unsigned i) {
+    return L"{0.0.0.00000000}.{storm-" + std::to_wstring(storm) + L"-endpoint-" + std::to_wstring(i) + L"}";
+}
+
+// A dock connecting: a dozen endpoints arrive at once, flap between states, then disappear
+void storm(fake::device_enumerator* e, unsigned storm_index, const std::atomic<bool>& stop, std::atomic<std::uint64_t>& notifications) {
+    constexpr unsigned burst = 12;
+    static const DWORD states[] = { DEVICE_STATE_DISABLED, DEVICE_STATE_UNPLUGGED, DEVICE_STATE_ACTIVE };
+    while (!stop.load(std::memory_order_relaxed)) {
+        for (unsigned i = 0; i < burst; ++i) e->add_device(endpoint_id(storm_index, i));
+        for (DWORD state : states) {
+            for (unsigned i = 0; i < burst; ++i) e->set_state(endpoint_id(storm_index, i), state);
+        }
+        for (unsigned i = 0; i < burst; ++i) e->remove_device(endpoint_id(storm_index, i));
+        notifications.fetch_add(burst * 5, std::memory_order_relaxed);
+    }
+}
+
+void reader(const coreaudio::device_enumerator& e, const std::atomic<bool>& stop, latencies& out) {
+    std::vector<coreaudio::device> devices;
+    while (!stop.load(std::memory_order_relaxed)) {
+        clock::time_point start = clock::now();
+        coreaudio::h_optional<coreaudio::device_collection> c = e.enum_audio_endpoints(std::nothrow, eRender, DEVICE_STATEMASK_ALL);
+        out.enumerate_us.push_back(microseconds_since(start));
+        if (!c) {
+            ++out.failed_operations;
+            continue;
+        }
+
+        devices.clear();
+        start = clock::now();
+        coreaudio::h_optional<UINT> written = c.get_unchecked().to_vector(std::nothrow, devices);
+        out.to_vector_us.push_back(microseconds_since(start));
+        if (!written) ++out.failed_operations;
+
+        for (const coreaudio::device& d : devices) {
+            if (!d.id(std::nothrow)) ++out.failed_operations;
+            coreaudio::h_optional<coreaudio::endpoint_volume> v = d.activate_endpoint_volume(std::nothrow);
+            if (!v) {
+                ++out.failed_operations;
+                continue;
+            }
+            if (!v.get_unchecked().is_muted(std::nothrow)) ++out.failed_operations;
+        }
+    }
+}
+
+void print_latencies(const char* name, std::vector<std::uint32_t>& us, double seconds) {
+    std::cout << name << ": " << us.size() << " (" << static_cast<std::uint64_t>(us.size() / seconds) << "/s)";
+    if (!us.empty()) {
+        std::sort(us.begin(), us.end());
+        auto percentile = [&](double p) { return us[static_cast<std::size_t>(p * (us.size() - 1))]; };
+        std::cout << "  p50 " << percentile(0.5) << "us  p99 " << percentile(0.99)
+                  << "us  p99.9 " << percentile(0.999) << "us  max " << us.back() << "us";
+    }
+    std::cout << '\n';
+}
+
+}
+
+
+int main(int argc, char** argv) {
+    using namespace coreaudio;
+
+    double seconds = argc > 1 ? std::atof(argv[1]) : 5.0;
+    double fault_probability = argc > 2 ? std::atof(argv[2]) : 0.01;
+    unsigned storm_threads = argc > 3 ? static_cast<unsigned>(std::atoi(argv[3])) : 4;
+    unsigned reader_threads = argc > 4 ? static_cast<unsigned>(std::atoi(argv[4])) : 4;
+
+    h_optional<com_context> ctx = com_context::make(COINIT_MULTITHREADED);
+    if (!ctx) {
+        std::cerr << "CoInitializeEx failed: " << std::hex << ctx.get_status() << '\n';
+        return 1;
+    }
+
+    fake::fault_injector faults;
+    faults.set_all_rates(fault_probability);
+    fake::device_enumerator* fake_enumerator = new fake::device_enumerator(faults);
+    fake_enumerator->AddRef();  // One reference for `e`, one for the storm threads
+    device_enumerator e(fake_enumerator);
+
+    stress::storm_client* client = new stress::storm_client(e);
+    e.register_endpoint_notification_callback(std::nothrow, client);
+
+    std::atomic<bool> stop{false};
+    std::atomic<std::uint64_t> notifications{0};
+    std::vector<stress::latencies> reader_latencies(reader_threads);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < storm_threads; ++i) {
+        threads.emplace_back(stress::storm, fake_enumerator, i, std::cref(stop), std::ref(notifications));
+    }
+    for (unsigned i = 0; i < reader_threads; ++i) {
+        threads.emplace_back([&, i] {
+            h_optional<com_context> thread_ctx = com_context::make(COINIT_MULTITHREADED);
+            stress::reader(e, stop, reader_latencies[i]);
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(true);
+    for (std::thread& t : threads) t.join();
+
+    e.unregister_endpoint_notification_callback(std::nothrow, client);
+    stress::latencies total = client->take();
+    client->Release();
+    fake_enumerator->Release();
+    for (const stress::latencies& l : reader_latencies) total.merge(l);
+
+    std::cout << storm_threads << " storm threads, " << reader_threads << " reader threads, "
+              << seconds << "s, fault probability " << fault_probability << "\n\n";
+    std::cout << "notifications fired: " << notifications.load() << " (" << static_cast<std::uint64_t>(notifications.load() / seconds) << "/s)\n";
+    stress::print_latencies("enum_audio_endpoints", total.enumerate_us, seconds);
+    stress::print_latencies("to_vector", total.to_vector_us, seconds);
+    stress::print_latencies("notification handling", total.notification_us, seconds);
+
+    static const char* const site_names[] = { "Item", "GetId", "Activate", "volume" };
+    std::cout << "\ninjected faults:";
+    for (int i = 0; i < static_cast<int>(fake::fault_site::count); ++i) {
+        std::cout << "  " << site_names[i] << ' ' << faults.injected[i].load();
+    }
+    std::cout << "\nfailed operations: " << total.failed_operations << '\n';
+    std::cout << "wrapped COM calls: " << stress::failures().calls.load() << ", failures by HRESULT:\n";
+    for (const auto& failure : stress::failures().by_status) {
+        std::cout << "  0x" << std::hex << static_cast<std::uint32_t>(failure.first) << std::dec << ": " << failure.second << '\n';
+    }
+}
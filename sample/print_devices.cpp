@@ -3,6 +3,7 @@
 
 #include <map>
 #include <iostream>
+#include <string>
 
 // #define COREAUDIO_NOEXCEPTIONS
 #include "coreaudio/coreaudio.h"
@@ -16,26 +17,31 @@
 #endif
 
 
-std::map<DWORD, const wchar_t*>* namep;
+std::map<DWORD, const char*>* namep;
 
 #ifndef COREAUDIO_NOEXCEPTIONS
 void test(const coreaudio::com_context& ctx) {
     using namespace coreaudio;
     device_enumerator e(ctx);
     device_collection coll = e.enum_audio_endpoints(eCapture);
+    // UTF-8, reusing the same two buffers for every device
+    std::string id;
+    std::string name;
     for (device f : coll) {
-        std::wcout << f.id().get() << L": " << (*namep)[f.state()] << L"\n";
+        f.id(id);
+        f.friendly_name(name);
+        std::cout << id << " (" << name << "): " << (*namep)[f.state()] << "\n";
     }
 }
 
 
 int main() {
-    std::map<DWORD, const wchar_t*> name;
+    std::map<DWORD, const char*> name;
     namep = &name;
-    name[DEVICE_STATE_ACTIVE] = L"active";
-    name[DEVICE_STATE_DISABLED] = L"disabled";
-    name[DEVICE_STATE_NOTPRESENT] = L"not present";
-    name[DEVICE_STATE_UNPLUGGED] = L"unplugged";
+    name[DEVICE_STATE_ACTIVE] = "active";
+    name[DEVICE_STATE_DISABLED] = "disabled";
+    name[DEVICE_STATE_NOTPRESENT] = "not present";
+    name[DEVICE_STATE_UNPLUGGED] = "unplugged";
 
     try {
         // test(coreaudio::com_context::adopt_initialization{});
@@ -51,55 +57,40 @@ int main() {
 #else
 HRESULT test(const coreaudio::com_context& ctx) noexcept {
     using namespace coreaudio;
-    device_enumerator e;
-    {
-        h_optional<device_enumerator> attempt_e = device_enumerator::make(ctx);
-        if (!attempt_e) return attempt_e.get_status();
-        e = static_cast<device_enumerator&&>(attempt_e.get_unchecked());
-    }
-    device_collection coll;
-    {
-        h_optional<device_collection> attempt_coll = e.enum_audio_endpoints(std::nothrow, eCapture);
-        if (!attempt_coll) return attempt_coll.get_status();
-        coll = static_cast<device_collection&&>(attempt_coll.get_unchecked());
-    }
-    for (std::size_t i = 0; i < coll.size(); ++i) {
-        h_optional<device> d = coll.at(std::nothrow, i);
+    h_result<device_collection> coll = as_result(device_enumerator::make(ctx)).and_then([](const device_enumerator& e) {
+        return e.enum_audio_endpoints(std::nothrow, eCapture);
+    });
+    if (!coll) return coll.get_status();
+    // UTF-8, reusing the same two buffers for every device
+    std::string id;
+    std::string name;
+    for (std::size_t i = 0; i < coll.get_unchecked().size(); ++i) {
+        h_result<device> d = coll.get_unchecked().at(std::nothrow, i);
         if (!d) return d.get_status();
-        h_optional<task_memory_pointer<WCHAR>> id = d.get_unchecked().id(std::nothrow);
-        if (!id) return id.get_status();
-        std::wcout << id.get_unchecked().get() << L": ";
-        h_optional<DWORD> state = d.get_unchecked().state(std::nothrow);
+        HRESULT status = d.get_unchecked().id(std::nothrow, id);
+        if (FAILED(status)) return status;
+        status = d.get_unchecked().friendly_name(std::nothrow, name);
+        if (FAILED(status)) return status;
+        h_result<const char*> state = as_result(d.get_unchecked().state(std::nothrow)).transform([](DWORD s) { return (*namep)[s]; });
         if (!state) return state.get_status();
-        std::wcout << (*namep)[state.get_unchecked()] << L"\n";
+        std::cout << id << " (" << name << "): " << state.get_unchecked() << "\n";
     }
     return S_OK;
 }
 
 
 int main() {
-    std::map<DWORD, const wchar_t*> name;
+    std::map<DWORD, const char*> name;
     namep = &name;
-    name[DEVICE_STATE_ACTIVE] = L"active";
-    name[DEVICE_STATE_DISABLED] = L"disabled";
-    name[DEVICE_STATE_NOTPRESENT] = L"not present";
-    name[DEVICE_STATE_UNPLUGGED] = L"unplugged";
+    name[DEVICE_STATE_ACTIVE] = "active";
+    name[DEVICE_STATE_DISABLED] = "disabled";
+    name[DEVICE_STATE_NOTPRESENT] = "not present";
+    name[DEVICE_STATE_UNPLUGGED] = "unplugged";
 
     using namespace coreaudio;
 
-    HRESULT status;
-
-    com_context c = com_context::adopt_initialization{};
-
-    {
-        h_optional<com_context> attempt_initialize = com_context::make();
-        status = attempt_initialize.get_status();
-        if (SUCCEEDED(status)) c = static_cast<com_context&&>(attempt_initialize.get_unchecked());
-    }
-
-    if (SUCCEEDED(status)) {
-        status = test(c);
-    }
+    h_result<com_context> c = com_context::make();
+    HRESULT status = c ? test(c.get_unchecked()) : c.get_status();
 
     if (FAILED(status)) {
         std::cerr << "HRESULT error(" << status << ")\n" << std::flush;
@@ -0,0 +1,58 @@
+// Records what the default render endpoint plays to a WAV file, through a shared loopback capture.
+//
+// Usage: record_loopback [output.wav = loopback.wav] [seconds = 10]
+
+#include <Windows.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "coreaudio/coreaudio.h"
+#include "coreaudio/capture_file_writer.h"
+#include "coreaudio/loopback_capture.h"
+
+int wmain(int argc, wchar_t** argv) {
+    using namespace coreaudio;
+    const wchar_t* path = argc > 1 ? argv[1] : L"loopback.wav";
+    DWORD seconds = argc > 2 ? static_cast<DWORD>(std::wcstoul(argv[2], nullptr, 10)) : 10;
+
+    h_optional<com_context> ctx = com_context::make(COINIT_MULTITHREADED);
+    if (!ctx) return ctx.get_status();
+    h_optional<device_enumerator> e = device_enumerator::make(ctx.get_unchecked());
+    if (!e) return e.get_status();
+    h_optional<device> render = e.get_unchecked().get_default_endpoint(std::nothrow, eRender);
+    if (!render) return render.get_status();
+
+    loopback_capture_registry registry;
+    h_optional<std::shared_ptr<shared_loopback_capture>> capture = registry.acquire(render.get_unchecked());
+    if (!capture) return capture.get_status();
+    broadcast_ring::reader reader = capture.get_unchecked()->open_reader();
+
+    h_optional<std::unique_ptr<capture_file_writer>> writer = capture_file_writer::open(path, capture.get_unchecked()->format());
+    if (!writer) return writer.get_status();
+
+    std::vector<unsigned char> copy;
+    ULONGLONG end = GetTickCount64() + seconds * 1000ull;
+    while (GetTickCount64() < end && SUCCEEDED(capture.get_unchecked()->status())) {
+        broadcast_ring::packet p;
+        while (reader.acquire(p)) {
+            // `release` fails only if the capture lapped this loop while it copied (2 s behind by default), in which
+            // case the copy may be torn and the reader counts the packet as lost
+            copy.assign(p.data, p.data + p.bytes);
+            if (reader.release(p)) writer.get_unchecked()->write(copy.data(), copy.size());
+        }
+        Sleep(5);
+    }
+
+    HRESULT status = writer.get_unchecked()->finalize();
+    capture_writer_stats stats = writer.get_unchecked()->stats();
+    std::printf(
+        "%llu bytes written, %llu dropped (%llu writes), %llu packets lost in the ring, status 0x%08lX\n",
+        static_cast<unsigned long long>(stats.bytes_written), static_cast<unsigned long long>(stats.bytes_dropped),
+        static_cast<unsigned long long>(stats.writes_dropped), static_cast<unsigned long long>(reader.lost_packets()),
+        static_cast<unsigned long>(status)
+    );
+    return SUCCEEDED(status) ? 0 : status;
+}
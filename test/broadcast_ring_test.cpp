@@ -0,0 +1,68 @@
+// Checks that broadcast_ring readers notice packets overwritten after the write position wraps around.
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "coreaudio/util/broadcast_ring.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* what) {
+    if (!condition) {
+        std::printf("FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+void write(coreaudio::broadcast_ring& ring, std::size_t bytes, unsigned char value) {
+    unsigned char* p = ring.begin_write(bytes);
+    std::memset(p, value, bytes);
+    ring.commit_write(0, 0, 0, 0);
+}
+
+// A packet at the end of the ring survives a wrap while newer packets at the front are overwritten
+void newer_packets_overwritten_after_wrap() {
+    std::shared_ptr<coreaudio::broadcast_ring> ring = coreaudio::broadcast_ring::make(100, 8);
+    write(*ring, 45, 0);  // 0: [0, 45)
+    write(*ring, 45, 1);  // 1: [45, 90)
+    write(*ring, 10, 2);  // 2: [90, 100)
+    coreaudio::broadcast_ring::reader r(ring);
+    write(*ring, 20, 3);  // 3: [0, 20), drops 0
+    write(*ring, 20, 4);  // 4: [20, 40)
+
+    coreaudio::broadcast_ring::packet p;
+    check(r.acquire(p) && p.sequence == 3 && p.data[0] == 3, "acquire packet 3");
+    write(*ring, 65, 5);  // 5: [0, 65), drops 1, 3 and 4 but not 2
+    check(p.data[0] == 5, "packet 3 was overwritten");
+    check(!r.release(p), "release reports the overwritten packet");
+
+    check(r.acquire(p) && p.sequence == 5 && p.data[0] == 5, "reader skips to packet 5");
+    check(r.release(p), "packet 5 is intact");
+    check(r.lost_packets() == 2, "packets 3 and 4 counted as lost");
+}
+
+// Every packet before one the new packet overlaps is dropped too, even if it doesn't overlap itself
+void oldest_only_moves_forward_in_sequence() {
+    std::shared_ptr<coreaudio::broadcast_ring> ring = coreaudio::broadcast_ring::make(100, 8);
+    coreaudio::broadcast_ring::reader r(ring);
+    write(*ring, 45, 0);
+    write(*ring, 45, 1);
+    write(*ring, 10, 2);
+    write(*ring, 20, 3);  // Drops 0
+    write(*ring, 20, 4);
+    write(*ring, 65, 5);  // Drops 1, 3 and 4, so 2 as well
+    coreaudio::broadcast_ring::packet p;
+    check(r.acquire(p) && p.sequence == 5, "first intact packet is 5");
+    check(r.release(p), "packet 5 is intact");
+}
+
+}
+
+int main() {
+    newer_packets_overwritten_after_wrap();
+    oldest_only_moves_forward_in_sequence();
+    if (failures == 0) std::printf("broadcast_ring_test: all passed\n");
+    return failures == 0 ? 0 : 1;
+}